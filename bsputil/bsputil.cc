@@ -36,8 +36,10 @@
 #include <set>
 #include <list>
 #include <algorithm> // std::sort
+#include <atomic>
 #include <string>
 #include <fstream>
+#include <tbb/parallel_for_each.h>
 
 /* FIXME - share header with qbsp, etc. */
 struct wadinfo_t
@@ -666,6 +668,64 @@ struct planelist_t
     }
 };
 
+static const bspversion_t *FindBSPVersion(const char *short_name)
+{
+    for (const bspversion_t *bspver : bspversions) {
+        if (!strcmp(short_name, bspver->short_name)) {
+            return bspver;
+        }
+    }
+
+    Error("Unsupported format {}", short_name);
+}
+
+/*
+ * ==================
+ * ConvertBSPFiles
+ *
+ * --convert with more than one file; converts them in parallel, each
+ * writing <name>-<format>.bsp next to the input
+ * ==================
+ */
+static int ConvertBSPFiles(const char *format, const std::vector<fs::path> &files)
+{
+    const bspversion_t *to_version = FindBSPVersion(format);
+
+    std::atomic_size_t bytes_read = 0, converted = 0, failed = 0;
+    auto start = I_FloatTime();
+
+    tbb::parallel_for_each(files, [&](const fs::path &file) {
+        try {
+            fs::path source = file;
+            bspdata_t bspdata;
+
+            LoadBSPFile(source, &bspdata);
+            ConvertBSPFormat(&bspdata, &bspver_generic);
+
+            if (!ConvertBSPFormat(&bspdata, to_version)) {
+                logging::print("ERROR: {} exceeds the limits of {}\n", file, to_version->name);
+                failed++;
+                return;
+            }
+
+            WriteBSPFile(source.replace_filename(source.stem().string() + "-" + format + ".bsp"), &bspdata);
+
+            bytes_read += fs::file_size(file);
+            converted++;
+        } catch (const std::exception &e) {
+            logging::print("ERROR: {}: {}\n", file, e.what());
+            failed++;
+        }
+    });
+
+    const double elapsed = std::max((I_FloatTime() - start).count(), 1e-6);
+
+    logging::print("converted {} of {} files in {:.3}s: {:.1f} MB/s, {:.1f} maps/s\n", converted.load(), files.size(),
+        elapsed, bytes_read / (1024.0 * 1024.0) / elapsed, converted / elapsed);
+
+    return failed ? 1 : 0;
+}
+
 int bsputil_main(int argc, char **argv)
 {
     logging::preinitialize();
@@ -676,6 +736,7 @@ int bsputil_main(int argc, char **argv)
     if (argc == 1) {
         printf(
             "usage: bsputil [--replace-entities] [--extract-entities] [--extract-textures] [--convert bsp29|bsp2|bsp2rmq|q2bsp] [--check] [--modelinfo]\n"
+            "[--convert bsp29|bsp2|bsp2rmq|q2bsp bspfile bspfile...]\n"
             "[--check] [--compare otherbsp] [--findfaces x y z nx ny nz] [--findleaf x y z] [--settexinfo facenum texinfonum]\n"
             "[--decompile] [--decompile-geomonly] [--decompile-hull n]\n"
             "[--extract-bspx-lump lump_name output_file_name]\n"
@@ -684,6 +745,13 @@ int bsputil_main(int argc, char **argv)
         exit(1);
     }
 
+    // --convert <format> file1.bsp file2.bsp ...; only when every argument after the
+    // format is a file, so `--convert bsp2 --check foo.bsp` still runs both commands
+    if (argc > 4 && !strcmp(argv[1], "--convert") &&
+        std::all_of(argv + 3, argv + argc, [](const char *arg) { return fs::is_regular_file(arg); })) {
+        return ConvertBSPFiles(argv[2], {argv + 3, argv + argc});
+    }
+
     fs::path source = argv[argc - 1];
 
     if (!fs::exists(source)) {
@@ -1065,22 +1133,9 @@ int bsputil_main(int argc, char **argv)
                 Error("--convert requires an argument");
             }
 
-            const bspversion_t *fmt = nullptr;
-
-            for (const bspversion_t *bspver : bspversions) {
-                if (!strcmp(argv[i], bspver->short_name)) {
-                    fmt = bspver;
-                    break;
-                }
-            }
-
-            if (!fmt) {
-                Error("Unsupported format {}", argv[i]);
-            }
-
-            ConvertBSPFormat(&bspdata, fmt);
+            ConvertBSPFormat(&bspdata, FindBSPVersion(argv[i]));
 
-            WriteBSPFile(source.replace_filename(source.stem().string() + "-" + argv[i]), &bspdata);
+            WriteBSPFile(source.replace_filename(source.stem().string() + "-" + argv[i] + ".bsp"), &bspdata);
 
         } else if (!strcmp(argv[i], "--extract-entities")) {
 
@@ -30,9 +30,14 @@
 #include <limits.h>
 
 #include <fmt/core.h>
+#include <fmt/chrono.h>
 
 #include <atomic>
+#include <functional>
 #include <mutex>
+#include <optional>
+#include <sstream>
+#include <tbb/parallel_for_each.h>
 
 void lump_t::stream_write(std::ostream &s) const
 {
@@ -2006,16 +2011,8 @@ static bool BSPVersionSupported(int32_t ident, std::optional<int32_t> version, c
  * =========================================================================
  */
 
-// move structured data if the input and output
-// are of the same type
-template<typename T>
-inline void CopyArray(T &in, T &out)
-{
-    out = in;
-}
-
 // convert structured data if we're different types
-template<typename T, typename F, typename = std::enable_if_t<!std::is_same_v<T, F>>>
+template<typename T, typename F>
 inline void CopyArray(std::vector<F> &from, std::vector<T> &to)
 {
     to.reserve(from.size());
@@ -2028,17 +2025,9 @@ inline void CopyArray(std::vector<F> &from, std::vector<T> &to)
     }
 }
 
-// move structured data if the input and output
-// are of the same type
-template<typename T, typename F>
-inline void CopyArray(F &in, T &out)
-{
-    out = in;
-}
-
 // convert structured data if we're different types
 // with numeric casting for arrays
-template<typename T, typename F, size_t N, typename = std::enable_if_t<!std::is_same_v<T, F>>>
+template<typename T, typename F, size_t N>
 inline void CopyArray(std::vector<std::array<F, N>> &from, std::vector<std::array<T, N>> &to)
 {
     to.reserve(from.size());
@@ -2051,28 +2040,123 @@ inline void CopyArray(std::vector<std::array<F, N>> &from, std::vector<std::arra
     }
 }
 
+// convert structured data if we're different, non-vector types
+template<typename T, typename F>
+inline void CopyArray(F &in, T &out)
+{
+    out = in;
+}
+
+// Lumps of the same type are moved from one BSP to the other; ones that
+// need converting are copied element by element. Converting is done first
+// so a narrowing conversion that overflows leaves `from` untouched.
+struct convert_lumps_t
+{
+    template<typename F, typename T>
+    void operator()(F &from, T &to) const
+    {
+        if constexpr (!std::is_same_v<F, T>) {
+            CopyArray(from, to);
+        }
+    }
+};
+
+struct move_lumps_t
+{
+    template<typename F, typename T>
+    void operator()(F &from, T &to) const
+    {
+        if constexpr (std::is_same_v<F, T>) {
+            to = std::move(from);
+        }
+    }
+};
+
+// same as the two above at once, releasing converted lumps as we go so
+// only one copy of each lump is alive at a time
+struct convert_and_release_lumps_t
+{
+    template<typename F, typename T>
+    void operator()(F &from, T &to) const
+    {
+        if constexpr (std::is_same_v<F, T>) {
+            to = std::move(from);
+        } else {
+            CopyArray(from, to);
+            from = F{};
+        }
+    }
+};
+
+// calls f(q1 lump, generic lump) for each Q1-esque lump, except models
+template<typename T, typename F>
+inline void ForEachQ1Lump(T &bsp, mbsp_t &mbsp, const F &f)
+{
+    f(bsp.dentdata, mbsp.dentdata);
+    f(bsp.dplanes, mbsp.dplanes);
+    f(bsp.dtex, mbsp.dtex);
+    f(bsp.dvertexes, mbsp.dvertexes);
+    f(bsp.dvisdata, mbsp.dvis.bits);
+    f(bsp.dnodes, mbsp.dnodes);
+    f(bsp.texinfo, mbsp.texinfo);
+    f(bsp.dfaces, mbsp.dfaces);
+    f(bsp.dlightdata, mbsp.dlightdata);
+    f(bsp.dclipnodes, mbsp.dclipnodes);
+    f(bsp.dleafs, mbsp.dleafs);
+    f(bsp.dmarksurfaces, mbsp.dleaffaces);
+    f(bsp.dedges, mbsp.dedges);
+    f(bsp.dsurfedges, mbsp.dsurfedges);
+}
+
+// calls f(q2 lump, generic lump) for each Q2-esque lump
+template<typename T, typename F>
+inline void ForEachQ2Lump(T &bsp, mbsp_t &mbsp, const F &f)
+{
+    f(bsp.dentdata, mbsp.dentdata);
+    f(bsp.dplanes, mbsp.dplanes);
+    f(bsp.dvertexes, mbsp.dvertexes);
+    f(bsp.dvis, mbsp.dvis);
+    f(bsp.dnodes, mbsp.dnodes);
+    f(bsp.texinfo, mbsp.texinfo);
+    f(bsp.dfaces, mbsp.dfaces);
+    f(bsp.dlightdata, mbsp.dlightdata);
+    f(bsp.dleafs, mbsp.dleafs);
+    f(bsp.dleaffaces, mbsp.dleaffaces);
+    f(bsp.dleafbrushes, mbsp.dleafbrushes);
+    f(bsp.dedges, mbsp.dedges);
+    f(bsp.dsurfedges, mbsp.dsurfedges);
+    f(bsp.dmodels, mbsp.dmodels);
+    f(bsp.dbrushes, mbsp.dbrushes);
+    f(bsp.dbrushsides, mbsp.dbrushsides);
+    f(bsp.dareas, mbsp.dareas);
+    f(bsp.dareaportals, mbsp.dareaportals);
+}
+
+// flips the argument order, for going from generic to a specific format
+template<typename F>
+struct from_generic_t
+{
+    const F &f;
+
+    template<typename A, typename B>
+    void operator()(A &format_lump, B &generic_lump) const
+    {
+        f(generic_lump, format_lump);
+    }
+};
+
 // Convert from a Q1-esque format to Generic
 template<typename T>
 inline void ConvertQ1BSPToGeneric(T &bsp, mbsp_t &mbsp)
 {
-    CopyArray(bsp.dentdata, mbsp.dentdata);
-    CopyArray(bsp.dplanes, mbsp.dplanes);
-    CopyArray(bsp.dtex, mbsp.dtex);
-    CopyArray(bsp.dvertexes, mbsp.dvertexes);
-    CopyArray(bsp.dvisdata, mbsp.dvis.bits);
-    CopyArray(bsp.dnodes, mbsp.dnodes);
-    CopyArray(bsp.texinfo, mbsp.texinfo);
-    CopyArray(bsp.dfaces, mbsp.dfaces);
-    CopyArray(bsp.dlightdata, mbsp.dlightdata);
-    CopyArray(bsp.dclipnodes, mbsp.dclipnodes);
-    CopyArray(bsp.dleafs, mbsp.dleafs);
-    CopyArray(bsp.dmarksurfaces, mbsp.dleaffaces);
-    CopyArray(bsp.dedges, mbsp.dedges);
-    CopyArray(bsp.dsurfedges, mbsp.dsurfedges);
+    convert_and_release_lumps_t f;
+
+    ForEachQ1Lump(bsp, mbsp, f);
+
     if (std::holds_alternative<dmodelh2_vector>(bsp.dmodels)) {
-        CopyArray(std::get<dmodelh2_vector>(bsp.dmodels), mbsp.dmodels);
+        f(std::get<dmodelh2_vector>(bsp.dmodels), mbsp.dmodels);
     } else {
-        CopyArray(std::get<dmodelq1_vector>(bsp.dmodels), mbsp.dmodels);
+        f(std::get<dmodelq1_vector>(bsp.dmodels), mbsp.dmodels);
     }
 }
 
@@ -2080,81 +2164,51 @@ inline void ConvertQ1BSPToGeneric(T &bsp, mbsp_t &mbsp)
 template<typename T>
 inline void ConvertQ2BSPToGeneric(T &bsp, mbsp_t &mbsp)
 {
-    CopyArray(bsp.dentdata, mbsp.dentdata);
-    CopyArray(bsp.dplanes, mbsp.dplanes);
-    CopyArray(bsp.dvertexes, mbsp.dvertexes);
-    CopyArray(bsp.dvis, mbsp.dvis);
-    CopyArray(bsp.dnodes, mbsp.dnodes);
-    CopyArray(bsp.texinfo, mbsp.texinfo);
-    CopyArray(bsp.dfaces, mbsp.dfaces);
-    CopyArray(bsp.dlightdata, mbsp.dlightdata);
-    CopyArray(bsp.dleafs, mbsp.dleafs);
-    CopyArray(bsp.dleaffaces, mbsp.dleaffaces);
-    CopyArray(bsp.dleafbrushes, mbsp.dleafbrushes);
-    CopyArray(bsp.dedges, mbsp.dedges);
-    CopyArray(bsp.dsurfedges, mbsp.dsurfedges);
-    CopyArray(bsp.dmodels, mbsp.dmodels);
-    CopyArray(bsp.dbrushes, mbsp.dbrushes);
-    CopyArray(bsp.dbrushsides, mbsp.dbrushsides);
-    CopyArray(bsp.dareas, mbsp.dareas);
-    CopyArray(bsp.dareaportals, mbsp.dareaportals);
+    ForEachQ2Lump(bsp, mbsp, convert_and_release_lumps_t{});
 }
 
-// Convert from a Q1-esque format to Generic
+// Convert from Generic to a Q1-esque format
 template<typename T>
 inline T ConvertGenericToQ1BSP(mbsp_t &mbsp, const bspversion_t *to_version)
 {
     T bsp{};
 
-    // copy or convert data
-    CopyArray(mbsp.dentdata, bsp.dentdata);
-    CopyArray(mbsp.dplanes, bsp.dplanes);
-    CopyArray(mbsp.dtex, bsp.dtex);
-    CopyArray(mbsp.dvertexes, bsp.dvertexes);
-    CopyArray(mbsp.dvis.bits, bsp.dvisdata);
-    CopyArray(mbsp.dnodes, bsp.dnodes);
-    CopyArray(mbsp.texinfo, bsp.texinfo);
-    CopyArray(mbsp.dfaces, bsp.dfaces);
-    CopyArray(mbsp.dlightdata, bsp.dlightdata);
-    CopyArray(mbsp.dclipnodes, bsp.dclipnodes);
-    CopyArray(mbsp.dleafs, bsp.dleafs);
-    CopyArray(mbsp.dleaffaces, bsp.dmarksurfaces);
-    CopyArray(mbsp.dedges, bsp.dedges);
-    CopyArray(mbsp.dsurfedges, bsp.dsurfedges);
+    auto convert_models = [&](const auto &f) {
+        if (to_version->game->id == GAME_HEXEN_II) {
+            f(mbsp.dmodels, std::get<dmodelh2_vector>(bsp.dmodels));
+        } else {
+            f(mbsp.dmodels, std::get<dmodelq1_vector>(bsp.dmodels));
+        }
+    };
+
     if (to_version->game->id == GAME_HEXEN_II) {
-        CopyArray(mbsp.dmodels, bsp.dmodels.template emplace<dmodelh2_vector>());
+        bsp.dmodels.template emplace<dmodelh2_vector>();
     } else {
-        CopyArray(mbsp.dmodels, bsp.dmodels.template emplace<dmodelq1_vector>());
+        bsp.dmodels.template emplace<dmodelq1_vector>();
     }
 
+    // convert data first; this is what can throw
+    ForEachQ1Lump(bsp, mbsp, from_generic_t<convert_lumps_t>{convert_lumps_t{}});
+    convert_models(convert_lumps_t{});
+
+    // then move the rest
+    ForEachQ1Lump(bsp, mbsp, from_generic_t<move_lumps_t>{move_lumps_t{}});
+    convert_models(move_lumps_t{});
+
     return bsp;
 }
 
-// Convert from a Q2-esque format to Generic
+// Convert from Generic to a Q2-esque format
 template<typename T>
 inline T ConvertGenericToQ2BSP(mbsp_t &mbsp, const bspversion_t *to_version)
 {
     T bsp{};
 
-    // copy or convert data
-    CopyArray(mbsp.dentdata, bsp.dentdata);
-    CopyArray(mbsp.dplanes, bsp.dplanes);
-    CopyArray(mbsp.dvertexes, bsp.dvertexes);
-    CopyArray(mbsp.dvis, bsp.dvis);
-    CopyArray(mbsp.dnodes, bsp.dnodes);
-    CopyArray(mbsp.texinfo, bsp.texinfo);
-    CopyArray(mbsp.dfaces, bsp.dfaces);
-    CopyArray(mbsp.dlightdata, bsp.dlightdata);
-    CopyArray(mbsp.dleafs, bsp.dleafs);
-    CopyArray(mbsp.dleaffaces, bsp.dleaffaces);
-    CopyArray(mbsp.dleafbrushes, bsp.dleafbrushes);
-    CopyArray(mbsp.dedges, bsp.dedges);
-    CopyArray(mbsp.dsurfedges, bsp.dsurfedges);
-    CopyArray(mbsp.dmodels, bsp.dmodels);
-    CopyArray(mbsp.dbrushes, bsp.dbrushes);
-    CopyArray(mbsp.dbrushsides, bsp.dbrushsides);
-    CopyArray(mbsp.dareas, bsp.dareas);
-    CopyArray(mbsp.dareaportals, bsp.dareaportals);
+    // convert data first; this is what can throw
+    ForEachQ2Lump(bsp, mbsp, from_generic_t<convert_lumps_t>{convert_lumps_t{}});
+
+    // then move the rest
+    ForEachQ2Lump(bsp, mbsp, from_generic_t<move_lumps_t>{move_lumps_t{}});
 
     return bsp;
 }
@@ -2476,6 +2530,8 @@ void LoadBSPFile(fs::path &filename, bspdata_t *bspdata)
 
     filename = fs::resolveArchivePath(filename);
 
+    logging::stats_input(filename, file_data->size());
+
     imemstream stream(file_data->data(), file_data->size());
 
     stream >> endianness<std::endian::little>;
@@ -2593,39 +2649,72 @@ struct bspfile_t
         q2_dheader_t q2header;
     };
 
-    std::ofstream stream;
+    // a lump that's serialized into its own buffer; these are filled in
+    // parallel, then written out in order
+    struct lump_buffer_t
+    {
+        const char *name;
+        // header entry to fill in
+        lump_t *lump;
+        // null if the lump is already in file order and is written straight from `source`
+        std::function<void(std::ostream &)> serialize;
+        // if known up front, the buffer is allocated once and serialized into directly
+        std::optional<size_t> size;
+        std::string data;
+        std::string_view source;
+        duration elapsed;
+
+        // what gets written to the file
+        std::string_view bytes() const { return serialize ? std::string_view(data) : source; }
+    };
+
+    std::vector<lump_buffer_t> buffers;
+
+    struct bspx_buffer_t
+    {
+        const std::string *name;
+        const std::vector<uint8_t> *data;
+    };
+
+    std::vector<bspx_buffer_t> bspx_buffers;
 
 private:
-    // write structured lump data from vector
-    template<typename T>
-    inline void write_lump(size_t lump_num, const std::vector<T> &data)
+    inline lump_t &header_lump(size_t lump_num)
     {
         Q_assert(version->lumps.size() > lump_num);
-        const lumpspec_t &lumpspec = version->lumps.begin()[lump_num];
-        lump_t *lumps;
 
         if (version->version.has_value()) {
-            lumps = q2header.lumps.data();
+            return q2header.lumps[lump_num];
         } else {
-            lumps = q1header.lumps.data();
+            return q1header.lumps[lump_num];
         }
+    }
 
-        lump_t &lump = lumps[lump_num];
+    // write structured lump data from vector
+    template<typename T>
+    inline void write_lump(size_t lump_num, const std::vector<T> &data)
+    {
+        const lumpspec_t &lumpspec = version->lumps.begin()[lump_num];
 
-        lump.fileofs = stream.tellp();
+        if constexpr (std::is_arithmetic_v<T> && std::endian::native == std::endian::little) {
+            // already in file order, so there's nothing to serialize or copy
+            Q_assert(lumpspec.size == sizeof(T));
 
-        for (auto &v : data)
-            stream <= v;
+            buffers.push_back({lumpspec.name, &header_lump(lump_num), nullptr, std::nullopt, {},
+                {reinterpret_cast<const char *>(data.data()), data.size() * sizeof(T)}});
+            return;
+        }
 
-        auto written = static_cast<int32_t>(stream.tellp()) - lump.fileofs;
+        std::optional<size_t> size;
 
         if (sizeof(T) == 1 || lumpspec.size > 1)
-            Q_assert(written == (lumpspec.size * data.size()));
-
-        lump.filelen = written;
+            size = lumpspec.size * data.size();
 
-        if (written % 4)
-            stream <= padding_n(4 - (written % 4));
+        buffers.push_back({lumpspec.name, &header_lump(lump_num), [&data](std::ostream &stream) {
+                               for (auto &v : data)
+                                   stream <= v;
+                           },
+            size});
     }
 
     // this is only here to satisfy std::visit
@@ -2634,32 +2723,13 @@ private:
     // write structured string data
     inline void write_lump(size_t lump_num, const std::string &data)
     {
-        Q_assert(version->lumps.size() > lump_num);
         const lumpspec_t &lumpspec = version->lumps.begin()[lump_num];
-        lump_t *lumps;
 
         Q_assert(lumpspec.size == 1);
 
-        if (version->version.has_value()) {
-            lumps = q2header.lumps.data();
-        } else {
-            lumps = q1header.lumps.data();
-        }
-
-        lump_t &lump = lumps[lump_num];
-
-        lump.fileofs = stream.tellp();
-
-        stream.write(data.c_str(), data.size() + 1); // null terminator
-
-        auto written = static_cast<int32_t>(stream.tellp()) - lump.fileofs;
-
-        Q_assert(written == data.size() + 1);
-
-        lump.filelen = written;
-
-        if (written % 4)
-            stream <= padding_n(4 - (written % 4));
+        // written straight from the string, including the null terminator
+        buffers.push_back(
+            {lumpspec.name, &header_lump(lump_num), nullptr, std::nullopt, {}, {data.c_str(), data.size() + 1}});
     }
 
     // write structured lump data
@@ -2667,28 +2737,11 @@ private:
     inline void write_lump(size_t lump_num, const T &data)
     {
         const lumpspec_t &lumpspec = version->lumps.begin()[lump_num];
-        lump_t *lumps;
 
         Q_assert(lumpspec.size == 1);
 
-        if (version->version.has_value()) {
-            lumps = q2header.lumps.data();
-        } else {
-            lumps = q1header.lumps.data();
-        }
-
-        lump_t &lump = lumps[lump_num];
-
-        lump.fileofs = stream.tellp();
-
-        data.stream_write(stream);
-
-        auto written = static_cast<int32_t>(stream.tellp()) - lump.fileofs;
-
-        lump.filelen = written;
-
-        if (written % 4)
-            stream <= padding_n(4 - (written % 4));
+        buffers.push_back(
+            {lumpspec.name, &header_lump(lump_num), [&data](std::ostream &stream) { data.stream_write(stream); }});
     }
 
 public:
@@ -2742,40 +2795,114 @@ public:
 
     inline void write_bspx(const bspdata_t &bspdata)
     {
-        if (!bspdata.bspx.entries.size())
-            return;
+        // BSPX lumps are already raw bytes, so they're written straight from bspdata
+        for (auto &x : bspdata.bspx.entries) {
+            bspx_buffers.push_back({&x.first, &x.second});
+        }
+    }
+
+    inline void write_header(std::ostream &stream)
+    {
+        if (version->version.has_value()) {
+            stream <= q2header;
+        } else {
+            stream <= q1header;
+        }
+    }
+
+    // serialize every lump into its buffer, in parallel
+    inline void serialize_lumps()
+    {
+        tbb::parallel_for_each(buffers, [](lump_buffer_t &buffer) {
+            if (!buffer.serialize) {
+                return;
+            }
 
-        if (stream.tellp() & 3)
-            FError("BSPX header is misaligned");
+            logging::trace_zone zone(buffer.name);
+            auto start = I_FloatTime();
 
-        stream <= bspx_header_t(bspdata.bspx.entries.size());
+            if (buffer.size) {
+                buffer.data.resize(*buffer.size);
 
-        auto bspxheader = stream.tellp();
+                if (!buffer.data.empty()) {
+                    omemstream stream(buffer.data.data(), buffer.data.size());
+                    stream << endianness<std::endian::little>;
+                    buffer.serialize(stream);
 
-        // write dummy lump headers
-        for ([[maybe_unused]] auto &_ : bspdata.bspx.entries) {
-            stream <= bspx_lump_t{};
+                    Q_assert(stream && static_cast<size_t>(stream.tellp()) == buffer.data.size());
+                }
+            } else {
+                std::ostringstream stream(std::ios_base::out | std::ios_base::binary);
+                stream << endianness<std::endian::little>;
+                buffer.serialize(stream);
+                buffer.data = std::move(stream).str();
+            }
+
+            buffer.elapsed = I_FloatTime() - start;
+        });
+    }
+
+    // assign file offsets to the lumps, then write the file front to back
+    inline void write_file(std::ofstream &stream)
+    {
+        // header size doesn't depend on its contents
+        std::ostringstream header(std::ios_base::out | std::ios_base::binary);
+        write_header(header);
+
+        auto padding = [](size_t size) { return (4 - (size % 4)) % 4; };
+
+        size_t offset = header.tellp();
+
+        for (auto &buffer : buffers) {
+            buffer.lump->fileofs = offset;
+            buffer.lump->filelen = buffer.bytes().size();
+            offset += buffer.bytes().size() + padding(buffer.bytes().size());
         }
 
+        /*BSPX lumps are at a 4-byte alignment after the last of any official lump*/
         std::vector<bspx_lump_t> xlumps;
-        xlumps.reserve(bspdata.bspx.entries.size());
 
-        for (auto &x : bspdata.bspx.entries) {
-            bspx_lump_t &lump = xlumps.emplace_back();
-            lump.filelen = x.second.size();
-            lump.fileofs = stream.tellp();
-            memcpy(lump.lumpname.data(), x.first.c_str(), std::min(x.first.size(), lump.lumpname.size() - 1));
+        if (!bspx_buffers.empty()) {
+            std::ostringstream bspxheader(std::ios_base::out | std::ios_base::binary);
+            bspxheader <= bspx_header_t(bspx_buffers.size());
+
+            for ([[maybe_unused]] auto &_ : bspx_buffers) {
+                bspxheader <= bspx_lump_t{};
+            }
+
+            offset += static_cast<size_t>(bspxheader.tellp());
 
-            stream.write(reinterpret_cast<const char *>(x.second.data()), x.second.size());
+            for (auto &x : bspx_buffers) {
+                bspx_lump_t &lump = xlumps.emplace_back();
+                lump.filelen = x.data->size();
+                lump.fileofs = offset;
+                memcpy(lump.lumpname.data(), x.name->c_str(), std::min(x.name->size(), lump.lumpname.size() - 1));
 
-            if (x.second.size() % 4)
-                stream <= padding_n(4 - (x.second.size() % 4));
+                offset += x.data->size() + padding(x.data->size());
+            }
         }
 
-        stream.seekp(bspxheader);
+        write_header(stream);
+
+        for (auto &buffer : buffers) {
+            const std::string_view bytes = buffer.bytes();
+            stream.write(bytes.data(), bytes.size());
+            stream <= padding_n(padding(bytes.size()));
+        }
+
+        if (!bspx_buffers.empty()) {
+            stream <= bspx_header_t(bspx_buffers.size());
+
+            for (auto &lump : xlumps)
+                stream <= lump;
 
-        for (auto &lump : xlumps)
-            stream <= lump;
+            for (auto &x : bspx_buffers) {
+                stream.write(reinterpret_cast<const char *>(x.data->data()), x.data->size());
+                stream <= padding_n(padding(x.data->size()));
+            }
+        }
+
+        Q_assert(static_cast<size_t>(stream.tellp()) == offset);
     }
 };
 
@@ -2787,6 +2914,8 @@ public:
  */
 void WriteBSPFile(const fs::path &filename, bspdata_t *bspdata)
 {
+    logging::trace_zone zone(__func__);
+
     bspfile_t bspfile{};
 
     bspfile.version = bspdata->version;
@@ -2799,33 +2928,33 @@ void WriteBSPFile(const fs::path &filename, bspdata_t *bspdata)
     }
 
     logging::print("Writing {} as {}\n", filename, *bspdata->version);
-    bspfile.stream.open(filename, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+    std::ofstream stream(filename, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
 
-    if (!bspfile.stream)
+    if (!stream)
         FError("unable to open {} for writing", filename);
 
-    bspfile.stream << endianness<std::endian::little>;
-
-    /* Save header space, updated after adding the lumps */
-    if (bspfile.version->version.has_value()) {
-        bspfile.stream <= bspfile.q2header;
-    } else {
-        bspfile.stream <= bspfile.q1header;
-    }
+    stream << endianness<std::endian::little>;
 
     std::visit([&bspfile](auto &&arg) { bspfile.write_bsp(arg); }, bspdata->bsp);
-
-    /*BSPX lumps are at a 4-byte alignment after the last of any official lump*/
     bspfile.write_bspx(*bspdata);
 
-    bspfile.stream.seekp(0);
+    auto start = I_FloatTime();
+    bspfile.serialize_lumps();
+    auto serialized = I_FloatTime();
+    bspfile.write_file(stream);
+    stream.close();
+    auto written = I_FloatTime();
 
-    // write the real header
-    if (bspfile.version->version.has_value()) {
-        bspfile.stream <= bspfile.q2header;
-    } else {
-        bspfile.stream <= bspfile.q1header;
+    if (!stream)
+        FError("error writing {}", filename);
+
+    for (auto &buffer : bspfile.buffers) {
+        logging::print(logging::flag::VERBOSE, "    {:<16} {:>10} bytes {:.3}\n", buffer.name, buffer.bytes().size(),
+            buffer.elapsed);
     }
+
+    logging::print(logging::flag::STAT, "     {:.3} serializing lumps, {:.3} writing file\n", serialized - start,
+        written - serialized);
 }
 
 /* ========================================================================= */
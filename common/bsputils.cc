@@ -284,6 +284,41 @@ bool Light_PointInWorld(const mbsp_t *bsp, const qvec3d &point)
     return Light_PointInSolid(bsp, &bsp->dmodels[0], point);
 }
 
+static bool Light_BoxInSolid_r(const mbsp_t *bsp, const int nodenum, const aabb3d &box)
+{
+    if (nodenum < 0) {
+        const mleaf_t *leaf = BSP_GetLeafFromNodeNum(bsp, nodenum);
+
+        if (bsp->loadversion->game->id == GAME_QUAKE_II) {
+            return leaf->contents & Q2_CONTENTS_SOLID;
+        }
+
+        return (leaf->contents == CONTENTS_SOLID || leaf->contents == CONTENTS_SKY);
+    }
+
+    const bsp2_dnode_t *node = &bsp->dnodes[nodenum];
+    const dplane_t &plane = bsp->dplanes[node->planenum];
+
+    // distance from the box center to the plane, and the box's half extent along the plane normal
+    const qvec3d half = box.size() * 0.5;
+    const vec_t dist = plane.distance_to_fast(box.centroid());
+    const vec_t radius =
+        fabs(plane.normal[0]) * half[0] + fabs(plane.normal[1]) * half[1] + fabs(plane.normal[2]) * half[2];
+
+    if (dist > radius + 0.1)
+        return Light_BoxInSolid_r(bsp, node->children[0], box);
+    if (dist < -radius - 0.1)
+        return Light_BoxInSolid_r(bsp, node->children[1], box);
+
+    return Light_BoxInSolid_r(bsp, node->children[0], box) || Light_BoxInSolid_r(bsp, node->children[1], box);
+}
+
+// Tests whether any solid leaf of the world (hull 0) touches the box
+bool Light_BoxInWorld(const mbsp_t *bsp, const aabb3d &box)
+{
+    return Light_BoxInSolid_r(bsp, bsp->dmodels[0].headnode[0], box);
+}
+
 static std::vector<qplane3d> Face_AllocInwardFacingEdgePlanes(const mbsp_t *bsp, const mface_t *face)
 {
     std::vector<qplane3d> out;
@@ -19,16 +19,125 @@
 
 #include <common/entdata.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib> // atoi()
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <common/bsputils.hh>
 #include <common/parser.hh>
 
 #include <fmt/core.h>
 
+/*
+ * ==================
+ * key interning
+ *
+ * Every key ever stored in an entdict_t gets a small integer id. The names
+ * live in a deque so the string_views used as map keys stay valid.
+ *
+ * Lookups go through a per-thread cache first, so the shared lock is only
+ * taken the first time a thread sees a key. Keys that weren't found are
+ * cached too, until the next key is interned.
+ * ==================
+ */
+struct key_atoms_t
+{
+    std::shared_mutex lock;
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, entdict_key_t> ids;
+    // names.size(); written under the unique lock after a key is added
+    std::atomic<size_t> generation = 0;
+};
+
+static key_atoms_t &KeyAtoms()
+{
+    static key_atoms_t atoms;
+    return atoms;
+}
+
+struct key_name_hash_t
+{
+    using is_transparent = void;
+
+    size_t operator()(const std::string_view &key) const { return std::hash<std::string_view>{}(key); }
+};
+
+struct key_atom_cache_t
+{
+    // views into key_atoms_t::names, which never moves or shrinks
+    std::unordered_map<std::string_view, entdict_key_t> ids;
+    // keys that weren't interned as of `generation`
+    std::unordered_set<std::string, key_name_hash_t, std::equal_to<>> missing;
+    size_t generation = 0;
+};
+
+// the id of `key`, or nullopt if no entity has ever had it
+static std::optional<entdict_key_t> FindKeyAtom(const std::string_view &key)
+{
+    thread_local key_atom_cache_t cache;
+
+    if (auto it = cache.ids.find(key); it != cache.ids.end()) {
+        return it->second;
+    }
+
+    auto &atoms = KeyAtoms();
+
+    // read before taking the lock: a key interned after this is either seen
+    // below, or bumps the generation and expires the miss we cache
+    const size_t generation = atoms.generation.load(std::memory_order_acquire);
+
+    if (cache.generation != generation) {
+        cache.missing.clear();
+        cache.generation = generation;
+    } else if (cache.missing.find(key) != cache.missing.end()) {
+        return std::nullopt;
+    }
+
+    std::shared_lock lock(atoms.lock);
+
+    if (auto it = atoms.ids.find(key); it != atoms.ids.end()) {
+        cache.ids.emplace(it->first, it->second);
+        return it->second;
+    }
+
+    cache.missing.emplace(key);
+    return std::nullopt;
+}
+
+static entdict_key_t InternKey(const std::string_view &key)
+{
+    if (auto atom = FindKeyAtom(key)) {
+        return *atom;
+    }
+
+    auto &atoms = KeyAtoms();
+    std::unique_lock lock(atoms.lock);
+
+    // another thread may have added it in the meantime
+    if (auto it = atoms.ids.find(key); it != atoms.ids.end()) {
+        return it->second;
+    }
+
+    const entdict_key_t atom = static_cast<entdict_key_t>(atoms.names.size());
+    atoms.ids.emplace(atoms.names.emplace_back(key), atom);
+    atoms.generation.store(atoms.names.size(), std::memory_order_release);
+    return atom;
+}
+
 entdict_t::entdict_t(std::initializer_list<keyvalue_t> l)
     : keyvalues(l)
 {
+    keys.reserve(keyvalues.size());
+
+    for (auto &kv : keyvalues) {
+        keys.push_back(InternKey(kv.first));
+    }
 }
 
 entdict_t::entdict_t() = default;
@@ -72,15 +181,11 @@ int32_t entdict_t::get_int(const std::string_view &key) const
 
 int32_t entdict_t::get_vector(const std::string_view &key, qvec3d &vec) const
 {
-    std::string value = get(key);
-
-    // FIXME: this fixes ASan triggering on some entities...
-    if (*(value.data() + value.size()) != 0) {
-        *(value.data() + value.size()) = 0;
-    }
+    // std::string is always NUL-terminated, so there's no need to copy it
+    const std::string &value = get(key);
 
     vec = {};
-    return sscanf(value.data(), "%lf %lf %lf", &vec[0], &vec[1], &vec[2]);
+    return sscanf(value.c_str(), "%lf %lf %lf", &vec[0], &vec[1], &vec[2]);
 }
 
 void entdict_t::set(const std::string_view &key, const std::string_view &value)
@@ -94,11 +199,13 @@ void entdict_t::set(const std::string_view &key, const std::string_view &value)
 
     // no existing key; add new
     keyvalues.emplace_back(key, value);
+    keys.push_back(InternKey(key));
 }
 
 void entdict_t::remove(const std::string_view &key)
 {
     if (auto it = find(key); it != keyvalues.end()) {
+        keys.erase(keys.begin() + (it - keyvalues.begin()));
         keyvalues.erase(it);
     }
 }
@@ -108,33 +215,33 @@ void entdict_t::rename(const std::string_view &from, const std::string_view &to)
     const auto it = find(from);
     if (it != end()) {
         auto oldValue = std::move(it->second);
+        keys.erase(keys.begin() + (it - keyvalues.begin()));
         keyvalues.erase(it);
         keyvalues.emplace_back(to, std::move(oldValue));
+        keys.push_back(InternKey(to));
     }
 }
 
 keyvalues_t::iterator entdict_t::find(const std::string_view &key)
 {
-    auto existingIt = keyvalues.end();
-    for (auto it = keyvalues.begin(); it != keyvalues.end(); ++it) {
-        if (key == it->first) {
-            existingIt = it;
-            break;
-        }
+    const auto atom = FindKeyAtom(key);
+
+    if (!atom) {
+        return keyvalues.end();
     }
-    return existingIt;
+
+    return keyvalues.begin() + (std::find(keys.begin(), keys.end(), *atom) - keys.begin());
 }
 
 keyvalues_t::const_iterator entdict_t::find(const std::string_view &key) const
 {
-    auto existingIt = keyvalues.end();
-    for (auto it = keyvalues.begin(); it != keyvalues.end(); ++it) {
-        if (key == it->first) {
-            existingIt = it;
-            break;
-        }
+    const auto atom = FindKeyAtom(key);
+
+    if (!atom) {
+        return keyvalues.end();
     }
-    return existingIt;
+
+    return keyvalues.begin() + (std::find(keys.begin(), keys.end(), *atom) - keys.begin());
 }
 
 bool entdict_t::has(const std::string_view &key) const
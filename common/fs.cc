@@ -24,33 +24,241 @@
 #include "common/log.hh"
 #include <fstream>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <array>
 #include <list>
 #include <stdexcept>
 #include <unordered_map>
 
+#ifdef _WIN32
+#include <windows.h>
+
+// don't break std::min/std::max
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace fs
 {
+/**
+ * Read-only mapping of a whole file. Reading from it is thread-safe,
+ * unlike seekg+read on a shared stream.
+ */
+class mapped_file
+{
+    const uint8_t *ptr = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    explicit mapped_file(const path &p)
+    {
+#ifdef _WIN32
+        file = CreateFileW(p.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Can't open file");
+        }
+
+        LARGE_INTEGER file_size;
+
+        if (!GetFileSizeEx(file, &file_size)) {
+            CloseHandle(file);
+            throw std::runtime_error("Can't get file size");
+        }
+
+        length = static_cast<size_t>(file_size.QuadPart);
+
+        if (length) {
+            mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+            if (mapping) {
+                ptr = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            }
+
+            if (!ptr) {
+                if (mapping) {
+                    CloseHandle(mapping);
+                }
+                CloseHandle(file);
+                throw std::runtime_error("Can't map file");
+            }
+        }
+#else
+        int fd = open(p.c_str(), O_RDONLY);
+
+        if (fd == -1) {
+            throw std::runtime_error("Can't open file");
+        }
+
+        struct stat st;
+
+        if (fstat(fd, &st) == -1) {
+            close(fd);
+            throw std::runtime_error("Can't get file size");
+        }
+
+        length = static_cast<size_t>(st.st_size);
+
+        if (length) {
+            void *view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (view == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Can't map file");
+            }
+
+            ptr = static_cast<const uint8_t *>(view);
+        }
+
+        // the mapping stays valid after the descriptor is closed
+        close(fd);
+#endif
+    }
+
+    ~mapped_file()
+    {
+#ifdef _WIN32
+        if (ptr) {
+            UnmapViewOfFile(ptr);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (ptr) {
+            munmap(const_cast<uint8_t *>(ptr), length);
+        }
+#endif
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    const uint8_t *data() const { return ptr; }
+    size_t size() const { return length; }
+
+    // copies out [offset, offset + size), or nullopt if that's past the end of the file
+    fs::data slice(size_t offset, size_t size) const
+    {
+        if (offset > length || size > length - offset) {
+            return std::nullopt;
+        }
+
+        return std::vector<uint8_t>(ptr + offset, ptr + offset + size);
+    }
+};
+
 struct directory_archive : archive_like
 {
     using archive_like::archive_like;
 
-    bool contains(const path &filename) override
+    // one directory's entries: case-insensitive name -> (name on disk, is a directory)
+    using listing_t =
+        std::unordered_map<std::string, std::pair<path, bool>, case_insensitive_hash, case_insensitive_equal>;
+
+    // relative directory on disk -> its entries; each directory is only listed once a
+    // lookup reaches it, so unrelated subtrees (like the map's own directory) aren't walked
+    std::mutex listings_lock;
+    std::unordered_map<std::string, listing_t> listings;
+
+    // must be called with listings_lock held
+    const listing_t &listing(const path &relative_dir)
     {
-        return exists(!pathname.empty() ? (pathname / filename) : filename);
+        auto [it, inserted] = listings.try_emplace(relative_dir.generic_string());
+
+        if (inserted) {
+            std::error_code ec;
+
+            for (auto entry = directory_iterator(pathname / relative_dir, directory_options::skip_permission_denied, ec);
+                 !ec && entry != directory_iterator(); entry.increment(ec)) {
+                std::error_code entry_ec;
+
+                // is_directory() follows symlinks, so linked directories are searched too
+                if (!entry->exists(entry_ec)) {
+                    continue;
+                }
+
+                const bool is_dir = entry->is_directory(entry_ec);
+                path name = entry->path().filename();
+                it->second.emplace(name.generic_string(), std::make_pair(name, is_dir));
+            }
+        }
+
+        return it->second;
+    }
+
+    // the on-disk path of `filename`, if it exists
+    std::optional<path> find(const path &filename)
+    {
+        // the unnamed archive is for absolute/relative paths, which can be anywhere
+        if (pathname.empty()) {
+            std::error_code ec;
+            auto st = status(filename, ec);
+
+            // !is_directory() is a hack to avoid picking up a dir called "light"
+            // when requesting a texture called "light" (was happening on CI)
+            if (exists(st) && !is_directory(st)) {
+                return filename;
+            }
+
+            return std::nullopt;
+        }
+
+        std::scoped_lock lock(listings_lock);
+
+        // resolve one component at a time, case-insensitively
+        path on_disk;
+
+        for (auto it = filename.begin(); it != filename.end(); ++it) {
+            const listing_t &entries = listing(on_disk);
+            auto entry = entries.find(it->generic_string());
+
+            // everything but the last component has to be a directory
+            if (entry == entries.end() || entry->second.second != (std::next(it) != filename.end())) {
+                return std::nullopt;
+            }
+
+            on_disk /= entry->second.first;
+        }
+
+        if (on_disk.empty()) {
+            return std::nullopt;
+        }
+
+        return pathname / on_disk;
     }
 
+    bool contains(const path &filename) override { return find(filename).has_value(); }
+
     data load(const path &filename) override
     {
-        path p = !pathname.empty() ? (pathname / filename) : filename;
+        auto p = find(filename);
 
-        if (!exists(p)) {
+        if (!p) {
             return std::nullopt;
         }
 
         try {
-            uintmax_t size = file_size(p);
-            std::ifstream stream(p, std::ios_base::in | std::ios_base::binary);
+            uintmax_t size = file_size(*p);
+            std::ifstream stream(*p, std::ios_base::in | std::ios_base::binary);
             std::vector<uint8_t> data(size);
             stream.read(reinterpret_cast<char *>(data.data()), size);
             return data;
@@ -63,7 +271,7 @@ struct directory_archive : archive_like
 
 struct pak_archive : archive_like
 {
-    std::ifstream pakstream;
+    mapped_file pakfile;
 
     struct pak_header
     {
@@ -88,15 +296,16 @@ struct pak_archive : archive_like
 
     inline pak_archive(const path &pathname, bool external)
         : archive_like(pathname, external),
-          pakstream(pathname, std::ios_base::in | std::ios_base::binary)
+          pakfile(pathname)
     {
+        imemstream pakstream(pakfile.data(), pakfile.size());
         pakstream >> endianness<std::endian::little>;
 
         pak_header header;
 
         pakstream >= header;
 
-        if (header.magic != std::array<char, 4>{'P', 'A', 'C', 'K'}) {
+        if (!pakstream || header.magic != std::array<char, 4>{'P', 'A', 'C', 'K'}) {
             throw std::runtime_error("Bad magic");
         }
 
@@ -111,6 +320,11 @@ struct pak_archive : archive_like
 
             pakstream >= file;
 
+            if (!pakstream) {
+                throw std::runtime_error("Truncated directory");
+            }
+
+            file.name.back() = 0;
             files[file.name.data()] = std::make_tuple(file.offset, file.size);
         }
     }
@@ -125,17 +339,13 @@ struct pak_archive : archive_like
             return std::nullopt;
         }
 
-        pakstream.seekg(std::get<0>(it->second));
-        uintmax_t size = std::get<1>(it->second);
-        std::vector<uint8_t> data(size);
-        pakstream.read(reinterpret_cast<char *>(data.data()), size);
-        return data;
+        return pakfile.slice(std::get<0>(it->second), std::get<1>(it->second));
     }
 };
 
 struct wad_archive : archive_like
 {
-    std::ifstream wadstream;
+    mapped_file wadfile;
 
     // WAD Format
     struct wad_header
@@ -168,15 +378,16 @@ struct wad_archive : archive_like
 
     inline wad_archive(const path &pathname, bool external)
         : archive_like(pathname, external),
-          wadstream(pathname, std::ios_base::in | std::ios_base::binary)
+          wadfile(pathname)
     {
+        imemstream wadstream(wadfile.data(), wadfile.size());
         wadstream >> endianness<std::endian::little>;
 
         wad_header header;
 
         wadstream >= header;
 
-        if (header.identification != wad2_ident && header.identification != wad3_ident) {
+        if (!wadstream || (header.identification != wad2_ident && header.identification != wad3_ident)) {
             throw std::runtime_error("Bad magic");
         }
 
@@ -189,6 +400,11 @@ struct wad_archive : archive_like
 
             wadstream >= file;
 
+            if (!wadstream) {
+                throw std::runtime_error("Truncated directory");
+            }
+
+            file.name.back() = 0;
             files[file.name.data()] = std::make_tuple(file.filepos, file.disksize);
         }
     }
@@ -203,26 +419,36 @@ struct wad_archive : archive_like
             return std::nullopt;
         }
 
-        wadstream.seekg(std::get<0>(it->second));
-        uintmax_t size = std::get<1>(it->second);
-        std::vector<uint8_t> data(size);
-        wadstream.read(reinterpret_cast<char *>(data.data()), size);
-        return data;
+        return wadfile.slice(std::get<0>(it->second), std::get<1>(it->second));
     }
 };
 
 static std::shared_ptr<directory_archive> absrel_dir = std::make_shared<directory_archive>("", false);
 std::list<std::shared_ptr<archive_like>> archives, directories;
+// guards `archives` and `directories`; lookups only need a shared lock
+static std::shared_mutex archives_lock;
+
+// whether each path splitArchivePath() has checked is a regular file
+static std::unordered_map<std::string, bool> regular_file_cache;
+static std::mutex regular_file_cache_lock;
 
 /** It's possible to compile quake 1/hexen 2 maps without a qdir */
 void clear()
 {
-    archives.clear();
-    directories.clear();
+    {
+        std::unique_lock lock(archives_lock);
+        archives.clear();
+        directories.clear();
+    }
+
+    std::unique_lock lock(regular_file_cache_lock);
+    regular_file_cache.clear();
 }
 
 inline std::shared_ptr<archive_like> addArchiveInternal(const path &p, bool external)
 {
+    std::unique_lock lock(archives_lock);
+
     if (is_directory(p)) {
         for (auto &dir : directories) {
             if (equivalent(dir->pathname, p)) {
@@ -297,13 +523,12 @@ resolve_result where(const path &p, bool prefer_loose)
         }
     }
 
+    std::shared_lock lock(archives_lock);
+
     for (int32_t pass = 0; pass < 2; pass++) {
         if (prefer_loose != !!pass) {
             // check absolute + relative
-
-            // !is_directory() is a hack to avoid picking up a dir called "light"
-            // when requesting a texture called "light" (was happening on CI)
-            if (exists(p) && !is_directory(p)) {
+            if (absrel_dir->contains(p)) {
                 return {absrel_dir, p};
             }
         } else if (!p.is_absolute()) { // absolute doesn't make sense for other load types
@@ -345,7 +570,21 @@ archive_components splitArchivePath(const path &source)
     // path to see if any piece of it that isn't
     // the last piece matches a file
     for (path archive = source.parent_path(); archive.has_relative_path(); archive = archive.parent_path()) {
-        if (is_regular_file(archive)) {
+        bool is_file;
+
+        {
+            std::unique_lock lock(regular_file_cache_lock);
+            auto [it, inserted] = regular_file_cache.try_emplace(archive.generic_string());
+
+            if (inserted) {
+                std::error_code ec;
+                it->second = is_regular_file(archive, ec);
+            }
+
+            is_file = it->second;
+        }
+
+        if (is_file) {
             return {archive, source.lexically_relative(archive)};
         }
     }
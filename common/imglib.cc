@@ -4,8 +4,17 @@
 #include <common/entdata.h>
 #include <common/json.hh>
 #include <common/log.hh>
+#include <common/parallel.hh>
 #include <common/settings.hh>
 
+#include <fmt/chrono.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <random>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "../3rdparty/stb_image.h"
 
@@ -99,11 +108,23 @@ void init_palette(const gamedef_t *game)
 static void convert_paletted_to_32_bit(
     const std::vector<uint8_t> &pixels, std::vector<qvec4b> &output, const std::vector<qvec3b> &pal)
 {
+    // expand the palette once, so the loop below is a plain table lookup
+    std::array<qvec4b, 256> lookup{};
+
+    for (size_t i = 0; i < std::min(pal.size(), lookup.size()); i++) {
+        lookup[i] = qvec4b(pal[i], 255);
+    }
+
+    // Last palette index is transparent color
+    lookup[255][3] = 0;
+
     output.resize(pixels.size());
 
+    const uint8_t *in = pixels.data();
+    qvec4b *out = output.data();
+
     for (size_t i = 0; i < pixels.size(); i++) {
-        // Last palette index is transparent color
-        output[i] = qvec4b(pal[pixels[i]], pixels[i] == 255 ? 0 : 255);
+        out[i] = lookup[in[i]];
     }
 }
 
@@ -312,20 +333,216 @@ void clear()
 
 qvec3b calculate_average(const std::vector<qvec4b> &pixels)
 {
-    qvec3d avg{};
+    // integer sums with a 0/1 mask instead of a branch, so this vectorizes
+    uint64_t r = 0, g = 0, b = 0;
     size_t n = 0;
 
     for (auto &pixel : pixels) {
         // FIXME: is this valid for transparent averages?
-        if (pixel[3] >= 127) {
-            avg += pixel.xyz();
-            n++;
-        }
+        const uint32_t opaque = pixel[3] >= 127;
+
+        r += pixel[0] * opaque;
+        g += pixel[1] * opaque;
+        b += pixel[2] * opaque;
+        n += opaque;
     }
 
+    qvec3d avg{static_cast<double>(r), static_cast<double>(g), static_cast<double>(b)};
+
     return avg /= n;
 }
 
+/*
+============================================================================
+DECODED TEXTURE CACHE
+
+Decoding .png/.jpg/.tga is by far the slowest part of texture loading, so
+with -texturecache the decoded RGBA is stored on disk, keyed by a hash of
+the file contents. Each entry is a small header followed by the raw pixels,
+so a meta-only lookup just reads the header.
+============================================================================
+*/
+
+constexpr std::array<char, 4> TEXTURECACHE_IDENT = {'E', 'T', 'X', 'C'};
+constexpr uint32_t TEXTURECACHE_VERSION = 1;
+
+static std::atomic_size_t texture_cache_hits, texture_cache_misses;
+
+// 64-bit FNV-1a
+static uint64_t HashTextureData(const std::vector<uint8_t> &data)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (uint8_t c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static fs::path TextureCachePath(const settings::common_settings &options, uint64_t key)
+{
+    return options.texturecache.value() / fmt::format("{:016x}.tex", key);
+}
+
+static std::optional<texture> TextureCache_Load(
+    const fs::path &filename, const std::string_view &name, bool meta_only)
+{
+    std::ifstream file(filename, std::ios_base::in | std::ios_base::binary);
+
+    if (!file) {
+        return std::nullopt;
+    }
+
+    file >> endianness<std::endian::little>;
+
+    std::array<char, 4> ident;
+    uint32_t version, width, height;
+
+    file >= std::tie(ident, version, width, height);
+
+    if (!file || ident != TEXTURECACHE_IDENT || version != TEXTURECACHE_VERSION) {
+        return std::nullopt;
+    }
+
+    // same as load_stb
+    texture tex;
+    tex.meta.extension = ext::STB;
+    tex.meta.name = name;
+    tex.meta.width = tex.width = width;
+    tex.meta.height = tex.height = height;
+
+    if (!meta_only) {
+        tex.pixels.resize(static_cast<size_t>(width) * height);
+        file.read(reinterpret_cast<char *>(tex.pixels.data()), tex.pixels.size() * sizeof(qvec4b));
+
+        if (!file) {
+            return std::nullopt;
+        }
+    }
+
+    return tex;
+}
+
+static void TextureCache_Save(const fs::path &filename, const texture &tex)
+{
+    std::error_code ec;
+    fs::create_directories(filename.parent_path(), ec);
+
+    // write to a temporary name and rename it into place, so other
+    // processes sharing the cache never see a partial file
+    fs::path temp = filename;
+    temp += fmt::format(".{:x}", std::random_device()());
+
+    {
+        std::ofstream file(temp, std::ios_base::out | std::ios_base::binary);
+
+        if (!file) {
+            return;
+        }
+
+        file << endianness<std::endian::little>;
+        file <= std::tie(TEXTURECACHE_IDENT, TEXTURECACHE_VERSION, tex.width, tex.height);
+        file.write(reinterpret_cast<const char *>(tex.pixels.data()), tex.pixels.size() * sizeof(qvec4b));
+
+        if (!file) {
+            file.close();
+            fs::remove(temp, ec);
+            return;
+        }
+    }
+
+    fs::rename(temp, filename, ec);
+
+    if (ec) {
+        fs::remove(temp, ec);
+    }
+}
+
+// whether `filename` is a cache entry, or a temporary one left behind by TextureCache_Save
+static bool IsTextureCacheFile(const fs::path &filename)
+{
+    const std::string name = filename.filename().string();
+    const size_t dot = name.find('.');
+
+    // {:016x}.tex, optionally followed by .{:x}
+    if (dot != 16 || name.compare(dot, 4, ".tex") != 0) {
+        return false;
+    }
+    if (!std::all_of(name.begin(), name.begin() + dot, [](char c) { return std::isxdigit((unsigned char)c); })) {
+        return false;
+    }
+
+    if (name.size() > dot + 4) {
+        return name[dot + 4] == '.';
+    }
+
+    std::ifstream file(filename, std::ios_base::in | std::ios_base::binary);
+    std::array<char, 4> ident;
+    file.read(ident.data(), ident.size());
+
+    return file && ident == TEXTURECACHE_IDENT;
+}
+
+size_t clear_texture_cache(const fs::path &dir)
+{
+    size_t removed = 0;
+    std::error_code ec;
+
+    for (auto it = fs::directory_iterator(dir, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        std::error_code file_ec;
+
+        if (it->is_regular_file(file_ec) && IsTextureCacheFile(it->path()) && fs::remove(it->path(), file_ec)) {
+            removed++;
+        }
+    }
+
+    return removed;
+}
+
+// loads `data` with `loader`, going through the decoded texture cache if it's enabled
+static std::optional<texture> load_cached(const std::string_view &name, const fs::data &data, bool meta_only,
+    const gamedef_t *game, const settings::common_settings &options, decltype(load_wal) *loader)
+{
+    // only stb_image decoding is slow enough to be worth caching
+    if (options.texturecache.value().empty() || loader != load_stb) {
+        return loader(name, data, meta_only, game);
+    }
+
+    const fs::path cache_path = TextureCachePath(options, HashTextureData(data.value()));
+
+    if (auto cached = TextureCache_Load(cache_path, name, meta_only)) {
+        texture_cache_hits++;
+        return cached;
+    }
+
+    texture_cache_misses++;
+
+    // decode the pixels even if we only want the meta, so the cache entry is complete
+    auto texture = loader(name, data, false, game);
+
+    if (texture) {
+        TextureCache_Save(cache_path, *texture);
+
+        if (meta_only) {
+            texture->pixels.clear();
+        }
+    }
+
+    return texture;
+}
+
+void print_texture_cache_stats()
+{
+    const size_t hits = texture_cache_hits.exchange(0);
+    const size_t misses = texture_cache_misses.exchange(0);
+
+    if (hits || misses) {
+        logging::print(logging::flag::STAT, "     texture cache: {} hits, {} misses\n", hits, misses);
+    }
+}
+
 std::tuple<std::optional<img::texture>, fs::resolve_result, fs::data> load_texture(const std::string_view &name,
     bool meta_only, const gamedef_t *game, const settings::common_settings &options, bool no_prefix)
 {
@@ -340,7 +557,7 @@ std::tuple<std::optional<img::texture>, fs::resolve_result, fs::data> load_textu
 
         if (auto pos = fs::where(p, options.filepriority.value() == settings::search_priority_t::LOOSE)) {
             if (auto data = fs::load(pos)) {
-                if (auto texture = ext.loader(name.data(), data, meta_only, game)) {
+                if (auto texture = load_cached(name.data(), data, meta_only, game, options, ext.loader)) {
                     return {texture, pos, data};
                 }
             }
@@ -537,17 +754,10 @@ if (texture) {
 tex.meta.averageColor = img::calculate_average(tex.pixels);
 */
 
-// Load the specified texture from the BSP
-static void AddTextureName(
-    const std::string_view &textureName, const mbsp_t *bsp, const settings::common_settings &options)
+// Load the specified texture by name; runs on worker threads
+static void LoadTextureByName(const std::string &textureName, img::texture &tex, const mbsp_t *bsp,
+    const settings::common_settings &options)
 {
-    if (img::find(textureName)) {
-        return;
-    }
-
-    // always add entry
-    auto &tex = img::textures.emplace(textureName, img::texture{}).first->second;
-
     // find texture & meta
     auto [texture, _0, _1] = img::load_texture(textureName, false, bsp->loadversion->game, options);
 
@@ -577,13 +787,32 @@ static void AddTextureName(
     }
 }
 
+// Adds an empty entry for a texture that isn't in the cache yet, and
+// queues it for loading.
+static void AddTextureName(const std::string_view &textureName, std::vector<std::pair<std::string, img::texture *>> &queue)
+{
+    if (img::find(textureName)) {
+        return;
+    }
+
+    // always add entry
+    auto &tex = img::textures.emplace(textureName, img::texture{}).first->second;
+    queue.emplace_back(textureName, &tex);
+}
+
 // Load all of the referenced textures from the BSP texinfos into
 // the texture cache.
 static void LoadTextures(const mbsp_t *bsp, const settings::common_settings &options)
 {
+    auto start = I_FloatTime();
+
+    // gather the names first; the cache is only modified on this thread, the
+    // entries themselves are filled in in parallel below
+    std::vector<std::pair<std::string, img::texture *>> queue;
+
     // gather all loadable textures...
     for (auto &texinfo : bsp->texinfo) {
-        AddTextureName(texinfo.texture.data(), bsp, options);
+        AddTextureName(texinfo.texture.data(), queue);
     }
 
     // gather textures used by _project_texture.
@@ -593,10 +822,54 @@ static void LoadTextures(const mbsp_t *bsp, const settings::common_settings &opt
         if (entdict.get("classname").find("light") == 0) {
             const auto &tex = entdict.get("_project_texture");
             if (!tex.empty()) {
-                AddTextureName(tex.c_str(), bsp, options);
+                AddTextureName(tex.c_str(), queue);
             }
         }
     }
+
+    auto decode_start = I_FloatTime();
+
+    logging::parallel_for(static_cast<size_t>(0), queue.size(),
+        [&](size_t i) { LoadTextureByName(queue[i].first, *queue[i].second, bsp, options); });
+
+    logging::print(logging::flag::STAT, "     {} textures: {:.3} gathering, {:.3} loading\n", queue.size(),
+        decode_start - start, I_FloatTime() - decode_start);
+}
+
+// Loads one paletted texture from the BSP plus its replacement;
+// runs on worker threads
+static void ConvertTexture(const miptex_t &miptex, img::texture &tex, const mbsp_t *bsp,
+    const settings::common_settings &options)
+{
+    // if the miptex entry isn't a dummy, use it as our base
+    if (miptex.data.size() >= sizeof(dmiptex_t)) {
+        if (auto loaded_tex = img::load_mip(miptex.name, miptex.data, false, bsp->loadversion->game)) {
+            tex = std::move(loaded_tex.value());
+        }
+    }
+
+    // find replacement texture
+    if (auto [texture, _0, _1] = img::load_texture(miptex.name, false, bsp->loadversion->game, options); texture) {
+        tex.width = texture->width;
+        tex.height = texture->height;
+        tex.pixels = std::move(texture->pixels);
+    }
+
+    if (!tex.pixels.size() || !tex.width || !tex.meta.width) {
+        logging::funcprint("WARNING: invalid size data for {}\n", miptex.name);
+        return;
+    }
+
+    if (tex.meta.color_override) {
+        tex.averageColor = *tex.meta.color_override;
+    } else {
+        tex.averageColor = img::calculate_average(tex.pixels);
+    }
+
+    if (tex.meta.width && tex.meta.height) {
+        tex.width_scale = (float)tex.width / (float)tex.meta.width;
+        tex.height_scale = (float)tex.height / (float)tex.meta.height;
+    }
 }
 
 // Load all of the paletted textures from the BSP into
@@ -607,6 +880,10 @@ static void ConvertTextures(const mbsp_t *bsp, const settings::common_settings &
         return;
     }
 
+    auto start = I_FloatTime();
+
+    std::vector<std::pair<const miptex_t *, img::texture *>> queue;
+
     for (auto &miptex : bsp->dtex.textures) {
         if (img::find(miptex.name)) {
             logging::funcprint("WARNING: Texture {} duplicated\n", miptex.name);
@@ -615,37 +892,16 @@ static void ConvertTextures(const mbsp_t *bsp, const settings::common_settings &
 
         // always add entry
         auto &tex = img::textures.emplace(miptex.name, img::texture{}).first->second;
+        queue.emplace_back(&miptex, &tex);
+    }
 
-        // if the miptex entry isn't a dummy, use it as our base
-        if (miptex.data.size() >= sizeof(dmiptex_t)) {
-            if (auto loaded_tex = img::load_mip(miptex.name, miptex.data, false, bsp->loadversion->game)) {
-                tex = std::move(loaded_tex.value());
-            }
-        }
-
-        // find replacement texture
-        if (auto [texture, _0, _1] = img::load_texture(miptex.name, false, bsp->loadversion->game, options); texture) {
-            tex.width = texture->width;
-            tex.height = texture->height;
-            tex.pixels = std::move(texture->pixels);
-        }
-
-        if (!tex.pixels.size() || !tex.width || !tex.meta.width) {
-            logging::funcprint("WARNING: invalid size data for {}\n", miptex.name);
-            continue;
-        }
+    auto decode_start = I_FloatTime();
 
-        if (tex.meta.color_override) {
-            tex.averageColor = *tex.meta.color_override;
-        } else {
-            tex.averageColor = img::calculate_average(tex.pixels);
-        }
+    logging::parallel_for(static_cast<size_t>(0), queue.size(),
+        [&](size_t i) { ConvertTexture(*queue[i].first, *queue[i].second, bsp, options); });
 
-        if (tex.meta.width && tex.meta.height) {
-            tex.width_scale = (float)tex.width / (float)tex.meta.width;
-            tex.height_scale = (float)tex.height / (float)tex.meta.height;
-        }
-    }
+    logging::print(logging::flag::STAT, "     {} textures: {:.3} gathering, {:.3} loading\n", queue.size(),
+        decode_start - start, I_FloatTime() - decode_start);
 }
 
 void load_textures(const mbsp_t *bsp, const settings::common_settings &options)
@@ -659,5 +915,7 @@ void load_textures(const mbsp_t *bsp, const settings::common_settings &options)
     } else {
         logging::print("WARNING: failed to load or convert textures.\n");
     }
+
+    print_texture_cache_stats();
 }
 } // namespace img
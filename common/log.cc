@@ -26,6 +26,7 @@
 #include <fstream>
 #include <iostream>
 #include <mutex>
+#include <thread>
 #include <fmt/ostream.h>
 #include <fmt/chrono.h>
 #include <fmt/color.h>
@@ -34,10 +35,14 @@
 #include <common/log.hh>
 #include <common/settings.hh>
 #include <common/cmdlib.hh>
+#include <common/json.hh>
+
+#include "tbb/global_control.h"
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h> // for OutputDebugStringA
+#include <psapi.h> // for GetProcessMemoryInfo
 
 #ifdef min
 #undef min
@@ -45,6 +50,9 @@
 #ifdef max
 #undef max
 #endif
+#else
+#include <sys/resource.h> // for getrusage
+#include <unistd.h> // for getpid
 #endif
 
 static std::ofstream logfile;
@@ -63,24 +71,593 @@ void preinitialize()
 #endif
 }
 
+static std::mutex print_mutex;
+static print_callback_t active_print_callback;
+
+// one or more messages, collected so they can be written to each target
+// with a single write + flush
+struct print_batch_t
+{
+    std::string file;
+    std::string console;
+
+    void add(flag logflag, std::string_view str)
+    {
+        if (logflag != flag::PERCENT) {
+            file += str;
+        }
+
+        if (!enable_color_codes) {
+            console += str;
+            return;
+        }
+
+        fmt::text_style style;
+
+        if (string_icontains(str, "error")) {
+            style = fmt::fg(fmt::color::red);
+        } else if (string_icontains(str, "warning")) {
+            style = fmt::fg(fmt::terminal_color::yellow);
+        } else if (bitflags<flag>(logflag) & flag::PERCENT) {
+            style = fmt::fg(fmt::terminal_color::bright_black);
+        } else if (bitflags<flag>(logflag) & flag::STAT) {
+            style = fmt::fg(fmt::terminal_color::cyan);
+        }
+
+        // stdout (assume the terminal can render ANSI colors)
+        fmt::format_to(std::back_inserter(console), style, "{}", str);
+    }
+
+    // must be called with print_mutex held
+    void write()
+    {
+        if (!file.empty()) {
+            // log file, if open
+            if (logfile) {
+                logfile << file;
+                logfile.flush();
+            }
+
+#ifdef _WIN32
+            // print to windows console.
+            // if VS's Output window gets support for ANSI colors, we can change this to ansi_str.c_str()
+            OutputDebugStringA(file.c_str());
+#endif
+        }
+
+        if (!console.empty()) {
+            fwrite(console.data(), 1, console.size(), stdout);
+
+            // for TB, etc...
+            fflush(stdout);
+        }
+
+        file.clear();
+        console.clear();
+    }
+};
+
+/*
+ * Between init() and close(), print() hands messages to a writer thread
+ * instead of doing the I/O itself, so worker threads printing -verbose
+ * output don't serialize on the console. Messages go through a bounded
+ * lock-free queue (Vyukov's MPMC ring, used with a single consumer); if it
+ * fills up, producers wait for the writer to catch up.
+ */
+class async_writer_t
+{
+    struct message_t
+    {
+        flag logflag;
+        std::string str;
+    };
+
+    struct cell_t
+    {
+        std::atomic_size_t sequence;
+        message_t message;
+    };
+
+    static constexpr size_t capacity = 8192; // power of 2
+
+    std::unique_ptr<cell_t[]> cells;
+    alignas(64) std::atomic_size_t enqueue_pos = 0;
+    alignas(64) std::atomic_size_t dequeue_pos = 0;
+
+    // number of messages pushed / written so far; the writer sleeps on
+    // `pushed`, flush() sleeps on `written`
+    alignas(64) std::atomic_uint64_t pushed = 0;
+    alignas(64) std::atomic_uint64_t written = 0;
+
+    std::atomic_bool stopping = false;
+    std::thread thread;
+
+    bool try_push(flag logflag, const char *str)
+    {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+
+        for (;;) {
+            cell_t &cell = cells[pos & (capacity - 1)];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+            if (dif == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.message.logflag = logflag;
+                    cell.message.str.assign(str);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (dif < 0) {
+                return false; // full
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // only called by the writer thread
+    bool try_pop(print_batch_t &batch)
+    {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        cell_t &cell = cells[pos & (capacity - 1)];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0) {
+            return false; // empty, or the producer hasn't finished writing this cell
+        }
+
+        dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+        batch.add(cell.message.logflag, cell.message.str);
+        cell.sequence.store(pos + capacity, std::memory_order_release);
+        return true;
+    }
+
+    void run()
+    {
+        print_batch_t batch;
+
+        for (;;) {
+            uint64_t seen = pushed.load();
+            uint64_t count = 0;
+
+            while (try_pop(batch)) {
+                count++;
+            }
+
+            if (count) {
+                {
+                    std::unique_lock lock(print_mutex);
+                    batch.write();
+                }
+
+                written += count;
+                written.notify_all();
+                continue;
+            }
+
+            if (stopping) {
+                break;
+            }
+
+            pushed.wait(seen);
+        }
+    }
+
+public:
+    void start()
+    {
+        if (thread.joinable()) {
+            return;
+        }
+
+        cells = std::make_unique<cell_t[]>(capacity);
+
+        for (size_t i = 0; i < capacity; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        enqueue_pos = 0;
+        dequeue_pos = 0;
+        pushed = 0;
+        written = 0;
+        stopping = false;
+
+        thread = std::thread([this]() { run(); });
+    }
+
+    // writes out everything that's queued and stops the writer thread
+    void stop()
+    {
+        if (!thread.joinable()) {
+            return;
+        }
+
+        stopping = true;
+        pushed++;
+        pushed.notify_one();
+        thread.join();
+
+        cells.reset();
+    }
+
+    bool running() const { return thread.joinable(); }
+
+    void push(flag logflag, const char *str)
+    {
+        while (!try_push(logflag, str)) {
+            // queue is full; make sure the writer is awake and let it drain
+            pushed.notify_one();
+            std::this_thread::yield();
+        }
+
+        pushed++;
+        pushed.notify_one();
+    }
+
+    // blocks until everything pushed before this call has been written
+    void flush()
+    {
+        if (!running() || std::this_thread::get_id() == thread.get_id()) {
+            return;
+        }
+
+        const uint64_t target = pushed.load();
+
+        for (uint64_t w = written.load(); w < target; w = written.load()) {
+            written.wait(w);
+        }
+    }
+
+    ~async_writer_t() { stop(); }
+};
+
+static async_writer_t async_writer;
+
+// -trace
+
+struct trace_event_t
+{
+    const char *name;
+    int64_t start_ns, end_ns;
+};
+
+// each thread appends to its own buffer; they're only read by trace_end(),
+// once the tool is done with its parallel work
+struct trace_thread_t
+{
+    size_t tid;
+    std::vector<trace_event_t> events;
+};
+
+static std::atomic_bool tracing = false;
+static fs::path trace_path;
+static std::string trace_process_name;
+static std::mutex trace_threads_mutex;
+static std::vector<std::shared_ptr<trace_thread_t>> trace_threads;
+static size_t trace_main_tid;
+static const qclock::time_point trace_epoch = qclock::now();
+// trace_epoch on the wall clock, so traces of the tools in a compile (and of
+// separate processes) line up on one timeline
+static const int64_t trace_epoch_system_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+
+static int64_t trace_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(qclock::now() - trace_epoch).count();
+}
+
+static uint64_t trace_pid()
+{
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return getpid();
+#endif
+}
+
+static trace_thread_t &trace_thread()
+{
+    thread_local std::shared_ptr<trace_thread_t> thread;
+
+    if (!thread) {
+        std::unique_lock lock(trace_threads_mutex);
+        thread = std::make_shared<trace_thread_t>();
+        thread->tid = trace_threads.size();
+        trace_threads.push_back(thread);
+    }
+
+    return *thread;
+}
+
+// -statsjson
+
+static std::atomic_bool collecting_stats = false;
+static fs::path stats_path;
+static std::string stats_program_name;
+static std::mutex stats_mutex;
+static json stats_phases, stats_counts, stats_inputs;
+// the phases open on this thread, innermost last
+static thread_local std::vector<const char *> stats_open_phases;
+static int64_t stats_start_ns;
+static double stats_start_cpu;
+
+// user + kernel time of all threads in the process, in seconds
+static double process_cpu_time()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+
+    // 100ns units
+    auto seconds = [](const FILETIME &t) {
+        return ((static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime) / 1e7;
+    };
+
+    return seconds(kernel) + seconds(user);
+#else
+    rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+// peak resident set size, in bytes
+static uint64_t process_peak_memory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+#ifdef __APPLE__
+    return usage.ru_maxrss; // bytes
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
+
+void stats_begin(const fs::path &filename)
+{
+    std::unique_lock lock(stats_mutex);
+
+    stats_path = filename;
+    stats_phases = json::array();
+    stats_counts = json::array();
+    stats_inputs = json::array();
+    stats_start_ns = trace_now();
+    stats_start_cpu = process_cpu_time();
+    collecting_stats = true;
+}
+
+void stats_input(const fs::path &filename, size_t size)
+{
+    if (!collecting_stats) {
+        return;
+    }
+
+    std::unique_lock lock(stats_mutex);
+    stats_inputs.push_back({{"path", filename.string()}, {"size", size}});
+}
+
+static void stats_end()
+{
+    if (!collecting_stats) {
+        return;
+    }
+
+    collecting_stats = false;
+
+    std::unique_lock lock(stats_mutex);
+
+    json stats = {
+        {"program", stats_program_name},
+        {"version", ERICWTOOLS_VERSION},
+        {"threads", tbb::global_control::active_value(tbb::global_control::max_allowed_parallelism)},
+        {"wall_time", (trace_now() - stats_start_ns) / 1e9},
+        {"cpu_time", process_cpu_time() - stats_start_cpu},
+        {"peak_memory", process_peak_memory()},
+        {"inputs", std::move(stats_inputs)},
+        {"phases", std::move(stats_phases)},
+        {"stats", std::move(stats_counts)},
+    };
+
+    std::ofstream f(stats_path);
+
+    if (f) {
+        f << stats.dump(4) << '\n';
+    }
+
+    lock.unlock();
+
+    if (!f) {
+        print("WARNING: couldn't write stats file {}\n", stats_path);
+    } else {
+        print("wrote stats to {}\n", stats_path);
+    }
+}
+
+trace_zone::trace_zone(const char *name, bool phase)
+    : name(name),
+      phase(phase)
+{
+    stats = phase && collecting_stats.load(std::memory_order_relaxed);
+
+    if (tracing.load(std::memory_order_relaxed) || stats) {
+        start_ns = trace_now();
+    }
+
+    if (stats) {
+        start_cpu = process_cpu_time();
+        stats_open_phases.push_back(name);
+    }
+}
+
+trace_zone::~trace_zone()
+{
+    if (stats) {
+        stats_open_phases.pop_back();
+    }
+
+    if (start_ns < 0) {
+        return;
+    }
+
+    const int64_t end_ns = trace_now();
+
+    if (tracing.load(std::memory_order_relaxed)) {
+        trace_thread().events.push_back({name, start_ns, end_ns});
+    }
+
+    if (stats && collecting_stats.load(std::memory_order_relaxed)) {
+        const double cpu = process_cpu_time() - start_cpu;
+
+        std::unique_lock lock(stats_mutex);
+        stats_phases.push_back({{"name", name}, {"start", (start_ns - stats_start_ns) / 1e9},
+            {"wall_time", (end_ns - start_ns) / 1e9}, {"cpu_time", cpu}});
+    }
+}
+
+void trace_begin(const fs::path &filename)
+{
+    trace_main_tid = trace_thread().tid;
+
+    std::unique_lock lock(trace_threads_mutex);
+
+    for (auto &thread : trace_threads) {
+        thread->events.clear();
+    }
+
+    trace_path = filename;
+    tracing = true;
+}
+
+static void write_json_string(std::ofstream &f, std::string_view str)
+{
+    f << '"';
+
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            f << '\\';
+        }
+        f << c;
+    }
+
+    f << '"';
+}
+
+static void trace_end()
+{
+    if (!tracing) {
+        return;
+    }
+
+    tracing = false;
+
+    std::unique_lock lock(trace_threads_mutex);
+    std::ofstream f(trace_path);
+
+    if (!f) {
+        lock.unlock();
+        print("WARNING: couldn't write trace file {}\n", trace_path);
+        return;
+    }
+
+    const uint64_t pid = trace_pid();
+
+    f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    fmt::print(f, "{{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":{},\"tid\":0,\"args\":{{\"name\":", pid);
+    write_json_string(f, trace_process_name);
+    f << "}}";
+
+    size_t num_events = 0;
+
+    for (auto &thread : trace_threads) {
+        if (thread->events.empty()) {
+            continue;
+        }
+
+        fmt::print(f, ",\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{},\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+            pid, thread->tid, thread->tid == trace_main_tid ? "main" : fmt::format("thread {}", thread->tid));
+
+        for (auto &event : thread->events) {
+            f << ",\n{\"name\":";
+            write_json_string(f, event.name);
+            // timestamps are in microseconds since the Unix epoch; printed from integer
+            // nanoseconds since a double can't hold that with sub-microsecond precision
+            const int64_t start_ns = trace_epoch_system_ns + event.start_ns;
+            const int64_t dur_ns = event.end_ns - event.start_ns;
+            fmt::print(f, ",\"ph\":\"X\",\"pid\":{},\"tid\":{},\"ts\":{}.{:03},\"dur\":{}.{:03}}}", pid,
+                thread->tid, start_ns / 1000, start_ns % 1000, dur_ns / 1000, dur_ns % 1000);
+        }
+
+        num_events += thread->events.size();
+        thread->events.clear();
+    }
+
+    f << "\n]}\n";
+    lock.unlock();
+
+    print("wrote {} trace events to {}\n", num_events, trace_path);
+}
+
 void init(const fs::path &filename, const settings::common_settings &settings)
 {
+    // a previous run (e.g. in the test suite) may have thrown before close()
+    close();
+
     if (settings.log.value()) {
         logfile.open(filename);
         fmt::print(logfile, "---- {} / ericw-tools {} ----\n", settings.program_name, ERICWTOOLS_VERSION);
     }
+
+    if (!settings.trace.value().empty()) {
+        trace_process_name = settings.program_name;
+        trace_begin(settings.trace.value());
+    }
+
+    if (!settings.statsjson.value().empty()) {
+        stats_program_name = settings.program_name;
+        stats_begin(settings.statsjson.value());
+    }
+
+    async_writer.start();
+}
+
+void flush()
+{
+    async_writer.flush();
 }
 
 void close()
 {
+    trace_end();
+    stats_end();
+    async_writer.stop();
+
     if (logfile) {
         logfile.close();
     }
 }
 
-static std::mutex print_mutex;
-static print_callback_t active_print_callback;
-
 void set_print_callback(print_callback_t cb)
 {
     active_print_callback = cb;
@@ -97,47 +674,21 @@ void print(flag logflag, const char *str)
         return;
     }
 
-    fmt::text_style style;
+    if (async_writer.running()) {
+        async_writer.push(logflag, str);
 
-    if (enable_color_codes) {
+        // errors are written out before we return, in case we're about to go down
         if (string_icontains(str, "error")) {
-            style = fmt::fg(fmt::color::red);
-        } else if (string_icontains(str, "warning")) {
-            style = fmt::fg(fmt::terminal_color::yellow);
-        } else if (bitflags<flag>(logflag) & flag::PERCENT) {
-            style = fmt::fg(fmt::terminal_color::bright_black);
-        } else if (bitflags<flag>(logflag) & flag::STAT) {
-            style = fmt::fg(fmt::terminal_color::cyan);
+            async_writer.flush();
         }
+        return;
     }
 
-    print_mutex.lock();
-
-    if (logflag != flag::PERCENT) {
-        // log file, if open
-        if (logfile) {
-            logfile << str;
-            logfile.flush();
-        }
-
-#ifdef _WIN32
-        // print to windows console.
-        // if VS's Output window gets support for ANSI colors, we can change this to ansi_str.c_str()
-        OutputDebugStringA(str);
-#endif
-    }
-
-    if (enable_color_codes) {
-        // stdout (assume the terminal can render ANSI colors)
-        fmt::print(style, "{}", str);
-    } else {
-        std::cout << str;
-    }
-
-    // for TB, etc...
-    fflush(stdout);
+    print_batch_t batch;
+    batch.add(logflag, str);
 
-    print_mutex.unlock();
+    std::unique_lock lock(print_mutex);
+    batch.write();
 }
 
 void vprint(flag logflag, fmt::string_view format, fmt::format_args args)
@@ -172,6 +723,7 @@ void assert_(bool success, const char *expr, const char *file, int line)
 {
     if (!success) {
         print("{}:{}: Q_assert({}) failed.\n", file, line, expr);
+        flush();
         // assert(0);
 #ifdef _WIN32
         __debugbreak();
@@ -359,6 +911,18 @@ void stat_tracker_t::print_stats()
     // add 8 char padding just to keep it away from the left side
     size_t number_padding = number_of_digit_padding() + 4;
 
+    if (collecting_stats) {
+        std::unique_lock lock(stats_mutex);
+
+        // the phase these were counted in, if any
+        json phase = stats_open_phases.empty() ? json(nullptr) : json(stats_open_phases.back());
+
+        for (auto &stat : stats) {
+            stats_counts.push_back({{"name", stat.name}, {"phase", phase}, {"count", stat.count.load()},
+                {"warning", stat.is_warning}});
+        }
+    }
+
     for (auto &stat : stats) {
         if (stat.show_even_if_zero || stat.count) {
             print(flag::STAT, "{}{:{}} {}\n", stat.is_warning ? "WARNING: " : "", fmt::group_digits(stat.count.load()),
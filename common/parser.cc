@@ -24,6 +24,8 @@
 #include <common/log.hh>
 #include <common/parser.hh>
 
+#include <cstring>
+
 // parser_source_location
 
 parser_source_location::parser_source_location() = default;
@@ -82,60 +84,82 @@ parser_t::parser_t(const char *str, parser_source_location base_location)
 {
 }
 
+// reports whatever the flags want for a token that isn't on this line
+static bool MissingToken(parseflags flags, const parser_source_location &location)
+{
+    if (flags & PARSE_OPTIONAL)
+        return false;
+    if (flags & PARSE_SAMELINE)
+        FError("{}: Line is incomplete", location);
+    return false;
+}
+
 bool parser_t::parse_token(parseflags flags)
 {
-    /* for peek, we'll do a backup/restore. */
+    /* for peek, parse as normal but remember the result, so the
+       parse_token call that usually follows doesn't redo the work. */
     if (flags & PARSE_PEEK) {
+        flags &= ~PARSE_PEEK;
+
         auto restore = untie(state());
-        bool result = parse_token(flags & ~PARSE_PEEK);
+        bool result = parse_token(flags);
+
+        _lookahead = {std::get<0>(restore), flags, result, was_quoted, _token_start, token.size(), pos,
+            location.line_number};
         state() = restore;
         return result;
     }
 
+    if (_lookahead.from == pos && _lookahead.flags == flags) {
+        _lookahead.from = nullptr;
+
+        was_quoted = _lookahead.was_quoted;
+        token.assign(_lookahead.token_start, _lookahead.token_length);
+        _token_start = _lookahead.token_start;
+        pos = _lookahead.pos;
+        location.line_number = _lookahead.line_number;
+        return _lookahead.result;
+    }
+
     was_quoted = false;
     token.clear();
-    auto token_p = std::back_inserter(token);
 
 skipspace:
     /* skip space */
     while (at_end() || *pos <= 32) {
         if (at_end() || !*pos) {
-            if (flags & PARSE_OPTIONAL)
-                return false;
-            if (flags & PARSE_SAMELINE)
-                FError("{}: Line is incomplete", location);
-            return false;
+            return MissingToken(flags, location);
         }
         if (*pos == '\n') {
-            if (flags & PARSE_OPTIONAL)
-                return false;
-            if (flags & PARSE_SAMELINE)
-                FError("{}: Line is incomplete", location);
+            if (flags & (PARSE_OPTIONAL | PARSE_SAMELINE))
+                return MissingToken(flags, location);
             location.line_number.value()++;
         }
         pos++;
     }
 
     /* comment field */
-    if ((pos[0] == '/' && pos[1] == '/') || pos[0] == ';') { // quark writes ; comments in q2 maps
+    if ((pos[0] == '/' && pos + 1 < end && pos[1] == '/') || pos[0] == ';') { // quark writes ; comments in q2 maps
+        const char *eol = static_cast<const char *>(memchr(pos, '\n', end - pos));
+        if (!eol) {
+            eol = end;
+        }
+
         if (flags & PARSE_COMMENT) {
-            while (*pos && *pos != '\n') {
-                *token_p++ = *pos++;
-            }
-            goto out;
+            const char *nul = static_cast<const char *>(memchr(pos, '\0', eol - pos));
+            _token_start = pos;
+            pos = nul ? nul : eol;
+            token.assign(_token_start, pos);
+            return true;
         }
-        if (flags & PARSE_OPTIONAL)
+        if (flags & (PARSE_OPTIONAL | PARSE_SAMELINE))
+            return MissingToken(flags, location);
+        if (eol == end || memchr(pos, '\0', eol - pos)) {
+            pos = end;
             return false;
-        if (flags & PARSE_SAMELINE)
-            FError("{}: Line is incomplete", location);
-        while (*pos++ != '\n') {
-            if (!*pos) {
-                if (flags & PARSE_SAMELINE)
-                    FError("{}: Line is incomplete", location);
-                return false;
-            }
         }
-        location.line_number.value()++; // count the \n the preceding while() loop just consumed
+        pos = eol + 1;
+        location.line_number.value()++; // count the \n we just skipped
         goto skipspace;
     }
     if (flags & PARSE_COMMENT)
@@ -146,58 +170,75 @@ skipspace:
     if (*pos == '"') {
         was_quoted = true;
         pos++;
-        while (*pos != '"') {
-            if (!*pos)
-                FError("{}: EOF inside quoted token", location);
-            if (*pos == '\\') {
-                // small note. the vanilla quake engine just parses the "foo" stuff then goes and looks for \n
-                // explicitly within strings. this means ONLY \n works, and double-quotes cannot be used either in maps
-                // _NOR SAVED GAMES_. certain editors can write "wad" "c:\foo\" which is completely fucked. so lets try
-                // to prevent more brokenness and encourage map editors to switch to using sane wad keys.
-                switch (pos[1]) {
-                    case 'n':
-                    case '\'':
-                    case 'r':
-                    case 't':
-                    case '\\':
-                    case 'b': // ericw-tools extension, parsed by light, used to toggle bold text
-                              // regular two-char escapes
-                        *token_p++ = *pos++;
-                        break;
-                    case 'x':
-                    case '0':
-                    case '1':
-                    case '2':
-                    case '3':
-                    case '4':
-                    case '5':
-                    case '6':
-                    case '7':
-                    case '8':
-                    case '9': // too lazy to validate these. doesn't break stuff.
-                        break;
-                    case '\"':
-                        if (pos[2] == '\r' || pos[2] == '\n') {
-                            logging::print("WARNING: {}: escaped double-quote at end of string\n", location);
-                        } else {
-                            *token_p++ = *pos++;
+        _token_start = pos;
+
+        // fast path: no escapes before the closing quote
+        const char *quote = static_cast<const char *>(memchr(pos, '"', end - pos));
+
+        if (quote && !memchr(pos, '\\', quote - pos) && !memchr(pos, '\0', quote - pos)) {
+            pos = quote;
+        } else {
+            while (pos >= end || *pos != '"') {
+                if (pos >= end || !*pos)
+                    FError("{}: EOF inside quoted token", location);
+                if (*pos == '\\') {
+                    // small note. the vanilla quake engine just parses the "foo" stuff then goes and looks for \n
+                    // explicitly within strings. this means ONLY \n works, and double-quotes cannot be used either in
+                    // maps _NOR SAVED GAMES_. certain editors can write "wad" "c:\foo\" which is completely fucked. so
+                    // lets try to prevent more brokenness and encourage map editors to switch to using sane wad keys.
+                    // escapes are kept as-is in the token; this only decides which characters they consume.
+                    const char next = (pos + 1 < end) ? pos[1] : '\0';
+
+                    switch (next) {
+                        case 'n':
+                        case '\'':
+                        case 'r':
+                        case 't':
+                        case '\\':
+                        case 'b': // ericw-tools extension, parsed by light, used to toggle bold text
+                                  // regular two-char escapes
+                            pos++;
+                            break;
+                        case 'x':
+                        case '0':
+                        case '1':
+                        case '2':
+                        case '3':
+                        case '4':
+                        case '5':
+                        case '6':
+                        case '7':
+                        case '8':
+                        case '9': // too lazy to validate these. doesn't break stuff.
+                            break;
+                        case '\"': {
+                            const char after = (pos + 2 < end) ? pos[2] : '\0';
+                            if (after == '\r' || after == '\n') {
+                                logging::print("WARNING: {}: escaped double-quote at end of string\n", location);
+                            } else {
+                                pos++;
+                            }
+                            break;
                         }
-                        break;
-                    default:
-                        logging::print("WARNING: {}: Unrecognised string escape - \\{}\n", location, pos[1]);
-                        break;
+                        default:
+                            logging::print("WARNING: {}: Unrecognised string escape - \\{}\n", location, next);
+                            break;
+                    }
                 }
+                pos++;
             }
-            *token_p++ = *pos++;
         }
+
+        token.assign(_token_start, pos);
         pos++;
     } else {
-        while (*pos > 32) {
-            *token_p++ = *pos++;
+        _token_start = pos;
+        while (pos < end && *pos > 32) {
+            pos++;
         }
+        token.assign(_token_start, pos);
     }
 
-out:
     return true;
 }
 
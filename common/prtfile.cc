@@ -24,6 +24,7 @@
 #include <common/bspfile.hh>
 #include <common/ostream.hh>
 
+#include <cmath>
 #include <fstream>
 
 constexpr const char *PORTALFILE = "PRT1";
@@ -65,6 +66,7 @@ prtfile_t LoadPrtFile(const fs::path &name, const bspversion_t *loadversion)
             FError("{} can not be used with Q2\n", PORTALFILE2);
         }
         f >> result.portalleafs_real >> result.portalleafs >> numportals;
+        result.has_cluster_map = true;
 
         if (f.bad())
             FError("unable to parse {} header\n", PORTALFILE);
@@ -73,6 +75,7 @@ prtfile_t LoadPrtFile(const fs::path &name, const bspversion_t *loadversion)
             FError("{} can not be used with Q2\n", PORTALFILEAM);
         }
         f >> result.portalleafs >> numportals >> result.portalleafs_real;
+        result.has_cluster_map = true;
 
         if (f.bad())
             FError("unable to parse {} header\n", PORTALFILE);
@@ -173,6 +176,63 @@ prtfile_t LoadPrtFile(const fs::path &name, const bspversion_t *loadversion)
     return result;
 }
 
+static void WritePrtFloat(std::ofstream &portalFile, double v)
+{
+    // qbsp snaps near-integral coordinates before handing them over, so print those without a fraction
+    if (v == std::floor(v))
+        ewt::print(portalFile, "{} ", static_cast<int>(v));
+    else
+        ewt::print(portalFile, "{} ", v);
+}
+
+void WritePrtFile(const fs::path &name, const prtfile_t &prtfile)
+{
+    std::ofstream portalFile(name, std::ios_base::out); // .prt files are intentionally text mode
+    if (!portalFile)
+        FError("Failed to open {}: {}", name, strerror(errno));
+
+    if (prtfile.has_cluster_map) {
+        ewt::print(portalFile, "{}\n", PORTALFILE2);
+        ewt::print(portalFile, "{}\n", prtfile.portalleafs_real);
+        ewt::print(portalFile, "{}\n", prtfile.portalleafs);
+    } else {
+        ewt::print(portalFile, "{}\n", PORTALFILE);
+        ewt::print(portalFile, "{}\n", prtfile.portalleafs);
+    }
+    ewt::print(portalFile, "{}\n", prtfile.portals.size());
+
+    for (auto &p : prtfile.portals) {
+        ewt::print(portalFile, "{} {} {} ", p.winding.size(), p.leafnums[0], p.leafnums[1]);
+
+        for (size_t i = 0; i < p.winding.size(); i++) {
+            ewt::print(portalFile, "(");
+            WritePrtFloat(portalFile, p.winding.at(i)[0]);
+            WritePrtFloat(portalFile, p.winding.at(i)[1]);
+            WritePrtFloat(portalFile, p.winding.at(i)[2]);
+            ewt::print(portalFile, ") ");
+        }
+        ewt::print(portalFile, "\n");
+    }
+
+    if (!prtfile.has_cluster_map) {
+        return;
+    }
+
+    // cluster map: the leafs of each cluster, terminated by -1
+    std::vector<std::vector<int>> cluster_leafs(prtfile.portalleafs);
+
+    for (int i = 0; i < prtfile.portalleafs_real && i + 1 < prtfile.dleafinfos.size(); i++) {
+        cluster_leafs[prtfile.dleafinfos[i + 1].cluster].push_back(i);
+    }
+
+    for (auto &leafs : cluster_leafs) {
+        for (int leafnum : leafs) {
+            ewt::print(portalFile, "{} ", leafnum);
+        }
+        ewt::print(portalFile, "-1\n");
+    }
+}
+
 static void WriteDebugPortal(const polylib::winding_t &w, std::ofstream &portalFile)
 {
     ewt::print(portalFile, "{} {} {} ", w.size(), 0, 0);
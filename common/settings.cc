@@ -20,6 +20,7 @@
 #include "common/settings.hh"
 #include "common/threads.hh"
 #include "common/fs.hh"
+#include "common/imglib.hh"
 #include <common/log.hh>
 
 namespace settings
@@ -729,6 +730,10 @@ common_settings::common_settings()
       nocolor{this, "nocolor", false, &logging_group, "don't output color codes (for TB, etc)"},
       quiet{this, {"quiet", "noverbose"}, {&nopercent, &nostat, &noprogress}, &logging_group,
           "suppress non-important messages (equivalent to -nopercent -nostat -noprogress)"},
+      trace{this, "trace", "", &logging_group,
+          "write timed zones for each phase to a Chrome trace-event JSON file, viewable in Perfetto or chrome://tracing"},
+      statsjson{this, "statsjson", "", &logging_group,
+          "write statistics, phase times, peak memory use and input sizes to a JSON file"},
       gamedir{this, "gamedir", "", &game_group,
           "override the default mod base directory. if this is not set, or if it is relative, it will be derived from the input file or the basedir if specified."},
       basedir{this, "basedir", "", &game_group,
@@ -740,7 +745,11 @@ common_settings::common_settings()
           "additional paths or archives to add to the search path, mostly for loose files"},
       q2rtx{this, "q2rtx", false, &game_group, "adjust settings to best support Q2RTX"},
       defaultpaths{this, "defaultpaths", true, &game_group,
-          "whether the compiler should attempt to automatically derive game/base paths for games that support it"}
+          "whether the compiler should attempt to automatically derive game/base paths for games that support it"},
+      texturecache{this, "texturecache", "", &performance_group,
+          "directory to cache decoded .png/.jpg/.tga textures in, shared between runs; disabled if not set"},
+      cleartexturecache{this, "cleartexturecache", false, &performance_group,
+          "delete the entries in the -texturecache directory before starting"}
 {
 }
 
@@ -786,6 +795,11 @@ void common_settings::postinitialize(int argc, const char **argv)
     if (nocolor.value()) {
         logging::enable_color_codes = false;
     }
+
+    if (cleartexturecache.value() && !texturecache.value().empty()) {
+        const size_t removed = img::clear_texture_cache(texturecache.value());
+        logging::print("cleared texture cache {} ({} entries)\n", texturecache.value(), removed);
+    }
 }
 
 void common_settings::run(int argc, const char **argv)
@@ -0,0 +1,207 @@
+/*  Copyright (C) 1996-1997  Id Software, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+    See file, 'COPYING', for details.
+*/
+
+#include <compile/compile.hh>
+
+#include <common/bspfile.hh>
+#include <common/cmdlib.hh>
+#include <common/log.hh>
+#include <common/prtfile.hh>
+#include <light/light.hh>
+#include <qbsp/map.hh>
+#include <qbsp/qbsp.hh>
+#include <vis/vis.hh>
+
+#include <cstring>
+
+#include <fmt/chrono.h>
+
+static std::vector<std::string> StageArgs(const std::vector<std::string> &extra_args, const fs::path &path)
+{
+    std::vector<std::string> args{
+        "", // the exe path, which the tools ignore
+    };
+    for (auto &arg : extra_args) {
+        args.push_back(arg);
+    }
+    args.push_back(path.string());
+
+    return args;
+}
+
+bspdata_t CompileMap(const fs::path &map_path, const compile_options_t &options)
+{
+    auto enter_stage = [&](compile_stage_t stage) {
+        if (options.stage_callback) {
+            options.stage_callback(stage);
+        }
+    };
+
+    // qbsp
+    enter_stage(compile_stage_t::qbsp);
+
+    std::vector<std::string> qbsp_args = StageArgs(options.qbsp_args, map_path);
+    if (!options.output_path.empty()) {
+        qbsp_args.push_back(options.output_path.string());
+    }
+
+    InitQBSP(qbsp_args);
+
+    map.keep_output = true;
+
+    auto start = I_FloatTime();
+    ProcessFile();
+    logging::print("\n{:.3} seconds elapsed\n", (I_FloatTime() - start));
+
+    logging::close();
+
+    // -convert only rewrites the .map
+    if (qbsp_options.convertmapformat.value() != conversion_t::none) {
+        enter_stage(compile_stage_t::done);
+        return {};
+    }
+
+    fs::path bsp_path = qbsp_options.bsp_path;
+    bsp_path.replace_extension("bsp");
+
+    bspdata_t bspdata;
+    std::optional<prtfile_t> prtfile = std::move(map.output_prt);
+
+    if (map.output_bsp) {
+        bspdata = std::move(*map.output_bsp);
+    } else {
+        // e.g. -onlyents, which updates the .bsp on disk
+        LoadBSPFile(bsp_path, &bspdata);
+    }
+
+    // the format everything gets converted back to for writing
+    bspdata.loadversion = bspdata.version;
+
+    // done with qbsp's brushes, planes etc.
+    map.reset();
+
+    if (options.write_intermediate) {
+        WriteBSPFile(bsp_path, &bspdata);
+        if (prtfile) {
+            WritePrtFile(fs::path(bsp_path).replace_extension("prt"), *prtfile);
+        }
+    }
+
+    // vis
+    if (options.run_vis) {
+        if (!prtfile) {
+            logging::print("WARNING: qbsp didn't produce any portals (did the map leak?), skipping vis\n");
+        } else {
+            enter_stage(compile_stage_t::vis);
+
+            vis_main(StageArgs(options.vis_args, bsp_path), bspdata, *prtfile);
+            prtfile.reset();
+
+            if (options.write_intermediate) {
+                ConvertBSPFormat(&bspdata, bspdata.loadversion);
+                WriteBSPFile(bsp_path, &bspdata);
+            }
+        }
+    }
+
+    // light
+    bool write_bsp = options.write_bsp;
+
+    if (options.run_light) {
+        enter_stage(compile_stage_t::light);
+
+        write_bsp &= light_main(StageArgs(options.light_args, bsp_path), bspdata);
+    }
+
+    if (write_bsp) {
+        ConvertBSPFormat(&bspdata, bspdata.loadversion);
+        WriteBSPFile(bsp_path, &bspdata);
+        logging::print("Wrote {}\n", bsp_path);
+    }
+
+    ConvertBSPFormat(&bspdata, &bspver_generic);
+
+    enter_stage(compile_stage_t::done);
+
+    return bspdata;
+}
+
+static void PrintUsage()
+{
+    fmt::print("usage: ericw-compile [-novis] [-nolight] [-writeintermediate] [-output bspname.bsp]\n"
+               "                     [-qbsp <qbsp options>...] [-vis <vis options>...] [-light <light options>...]\n"
+               "                     mapname.map\n");
+}
+
+int compile_main(int argc, const char **argv)
+{
+    fmt::print("---- ericw-compile / ericw-tools {} ----\n", ERICWTOOLS_VERSION);
+
+    if (argc < 2) {
+        PrintUsage();
+        return 1;
+    }
+
+    compile_options_t options;
+
+    // the tool whose options we're collecting, or null for ericw-compile's own
+    std::vector<std::string> *stage_args = nullptr;
+
+    for (int i = 1; i < argc - 1; i++) {
+        if (!strcmp(argv[i], "-qbsp")) {
+            stage_args = &options.qbsp_args;
+        } else if (!strcmp(argv[i], "-vis")) {
+            stage_args = &options.vis_args;
+        } else if (!strcmp(argv[i], "-light")) {
+            stage_args = &options.light_args;
+        } else if (stage_args) {
+            // ericw-compile's own options would otherwise be silently handed to the tool
+            if (!strcmp(argv[i], "-novis") || !strcmp(argv[i], "-nolight") || !strcmp(argv[i], "-writeintermediate") ||
+                !strcmp(argv[i], "-output")) {
+                PrintUsage();
+                FError("\"{}\" must come before -qbsp, -vis and -light", argv[i]);
+            }
+
+            stage_args->push_back(argv[i]);
+        } else if (!strcmp(argv[i], "-novis")) {
+            options.run_vis = false;
+        } else if (!strcmp(argv[i], "-nolight")) {
+            options.run_light = false;
+        } else if (!strcmp(argv[i], "-writeintermediate")) {
+            options.write_intermediate = true;
+        } else if (!strcmp(argv[i], "-output")) {
+            if (i + 1 >= argc - 1) {
+                PrintUsage();
+                FError("-output needs a file name");
+            }
+            options.output_path = argv[++i];
+        } else {
+            PrintUsage();
+            FError("unknown option \"{}\"", argv[i]);
+        }
+    }
+
+    auto start = I_FloatTime();
+    CompileMap(argv[argc - 1], options);
+    auto end = I_FloatTime();
+
+    logging::print("{:.3} elapsed in total\n", (end - start));
+
+    return 0;
+}
@@ -58,6 +58,7 @@ int Face_ContentsOrSurfaceFlags(
 const dmodelh2_t *BSP_DModelForModelString(const mbsp_t *bsp, const std::string &submodel_str);
 bool Light_PointInSolid(const mbsp_t *bsp, const dmodelh2_t *model, const qvec3d &point);
 bool Light_PointInWorld(const mbsp_t *bsp, const qvec3d &point);
+bool Light_BoxInWorld(const mbsp_t *bsp, const aabb3d &box);
 
 std::vector<const mface_t *> BSP_FindFacesAtPoint(
     const mbsp_t *bsp, const dmodelh2_t *model, const qvec3d &point, const qvec3d &wantedNormal = qvec3d(0, 0, 0));
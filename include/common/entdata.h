@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <initializer_list>
 #include <string>
 #include <utility>
@@ -33,9 +34,15 @@ struct parser_base_t;
 using keyvalue_t = std::pair<std::string, std::string>;
 using keyvalues_t = std::vector<keyvalue_t>;
 
+// keys are interned into a process-wide table (see entdata.cc), so find()
+// hashes the query once and then compares integers
+using entdict_key_t = uint32_t;
+
 class entdict_t
 {
     keyvalues_t keyvalues;
+    // the interned keyvalues[i].first, kept in step with keyvalues
+    std::vector<entdict_key_t> keys;
 
 public:
     entdict_t(std::initializer_list<keyvalue_t> l);
@@ -59,6 +66,7 @@ public:
     inline keyvalues_t::const_iterator begin() const { return keyvalues.begin(); }
     inline keyvalues_t::const_iterator end() const { return keyvalues.end(); }
 
+    // values can be changed through these, but not keys
     inline keyvalues_t::iterator begin() { return keyvalues.begin(); }
     inline keyvalues_t::iterator end() { return keyvalues.end(); }
 
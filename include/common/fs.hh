@@ -68,7 +68,9 @@ struct resolve_result
     inline explicit operator bool() const { return (bool)archive; }
 };
 
-// attempt to resolve the specified file.
+// attempt to resolve the specified file. safe to call from multiple threads.
+// directories are indexed (case-insensitively) the first time they're
+// searched; files added to them afterwards aren't found until clear().
 // this will attempt resolves in the following order
 // given the path "maps/start.map":
 // - absolute path match (ie, "maps/start.map")
@@ -80,7 +82,8 @@ struct resolve_result
 // the filename is only different from p if p is an archive path.
 resolve_result where(const path &p, bool prefer_loose = false);
 
-// attempt to load the specified resolve result.
+// attempt to load the specified resolve result. archives are memory-mapped,
+// so this is safe to call from multiple threads.
 data load(const resolve_result &pos);
 
 // attempt to load the specified file from the specified path.
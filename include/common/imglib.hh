@@ -113,9 +113,17 @@ constexpr struct
     {".wal", ext::WAL, load_wal}, {".mip", ext::MIP, load_mip}, {"", ext::MIP, load_mip}};
 
 // Attempt to load a texture from the specified name.
+// .png/.jpg/.tga files go through the -texturecache directory, if set.
 std::tuple<std::optional<texture>, fs::resolve_result, fs::data> load_texture(const std::string_view &name,
     bool meta_only, const gamedef_t *game, const settings::common_settings &options, bool no_prefix = false);
 
+// prints and resets the -texturecache hit/miss counts, if it was used
+void print_texture_cache_stats();
+
+// deletes the cache entries (and leftover temporary files) in a -texturecache directory,
+// leaving anything else in it alone. returns the number of files removed.
+size_t clear_texture_cache(const fs::path &dir);
+
 enum class meta_ext
 {
     WAL,
@@ -67,9 +67,14 @@ void preinitialize();
 // initialize logging subsystem
 void init(const fs::path &filename, const settings::common_settings &settings);
 
-// shutdown logging subsystem
+// shutdown logging subsystem; writes out any queued messages
+// and the -trace / -statsjson files first
 void close();
 
+// blocks until every message printed so far has been written out.
+// between init() and close(), print() only queues messages for a writer thread.
+void flush();
+
 // print to respective targets based on log flag
 void print(flag logflag, const char *str);
 
@@ -106,13 +111,51 @@ void set_print_callback(print_callback_t cb);
 
 void header(const char *name);
 
+// RAII marker for -trace; records the time between construction and
+// destruction as a zone on the current thread. `name` must outlive the
+// trace (string literals / __func__). Does nothing if tracing is off.
+// `phase` zones (the ones funcheader() opens) are also written to -statsjson
+// with their wall and CPU time, and stat_tracker_t counts are attributed to the
+// innermost one open on their thread.
+struct trace_zone
+{
+    const char *name;
+    bool phase;
+    int64_t start_ns = -1;
+    double start_cpu = 0;
+    bool stats = false;
+
+    explicit trace_zone(const char *name, bool phase = false);
+    ~trace_zone();
+
+    trace_zone(const trace_zone &) = delete;
+    trace_zone &operator=(const trace_zone &) = delete;
+};
+
+// start recording trace zones; they're written to `filename` as a
+// Chrome trace-event JSON file (viewable in Perfetto) by close()
+void trace_begin(const fs::path &filename);
+
+// start collecting stat_tracker_t counts, phase times and input sizes;
+// they're written to `filename` as JSON by close() along with total
+// wall/CPU time, peak memory use and thread count
+void stats_begin(const fs::path &filename);
+
+// records an input file's size for -statsjson
+void stats_input(const fs::path &filename, size_t size);
+
 // TODO: C++20 source_location
+// funcheader() also opens a trace zone lasting until the end of the calling scope
 #ifdef _MSC_VER
 #define funcprint(fmt, ...) print("{}: " fmt, __FUNCTION__, ##__VA_ARGS__)
-#define funcheader() header(__FUNCTION__)
+#define funcheader() \
+    header(__FUNCTION__); \
+    logging::trace_zone funcheader_trace_zone_(__FUNCTION__, true)
 #else
 #define funcprint(fmt, ...) print("{}: " fmt, __func__, ##__VA_ARGS__)
-#define funcheader() header(__func__)
+#define funcheader() \
+    header(__func__); \
+    logging::trace_zone funcheader_trace_zone_(__func__, true)
 #endif
 
 void assert_(bool success, const char *expr, const char *file, int line);
@@ -168,6 +168,23 @@ struct parser_t : parser_base_t
 private:
     std::vector<untied_t<state_type>> _states;
 
+    // where the current token starts in the source
+    const char *_token_start = nullptr;
+
+    // the result of the last PARSE_PEEK, reused by the next parse_token with the
+    // same flags from the same position
+    struct lookahead_t
+    {
+        const char *from = nullptr;
+        parseflags flags = PARSE_NORMAL;
+        bool result = false;
+        bool was_quoted = false;
+        const char *token_start = nullptr;
+        size_t token_length = 0;
+        const char *pos = nullptr;
+        std::optional<size_t> line_number;
+    } _lookahead;
+
 public:
     void push_state() override;
     void pop_state() override;
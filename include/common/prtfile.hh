@@ -46,8 +46,11 @@ struct prtfile_t
 
     std::vector<prtfile_portal_t> portals;
     std::vector<prtfile_dleafinfo_t> dleafinfos; // not used for Q2
+    bool has_cluster_map = false; // PRT2 / PRT1-AM: leafs were grouped into clusters by detail
 };
 
 struct bspversion_t;
 prtfile_t LoadPrtFile(const fs::path &name, const bspversion_t *loadversion);
+// writes a PRT2 if `prtfile` has a cluster map, otherwise a PRT1
+void WritePrtFile(const fs::path &name, const prtfile_t &prtfile);
 void WriteDebugPortals(const std::vector<polylib::winding_t> &portals, fs::path name);
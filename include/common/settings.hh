@@ -595,12 +595,16 @@ public:
     setting_bool noprogress;
     setting_bool nocolor;
     setting_redirect quiet;
+    setting_path trace;
+    setting_path statsjson;
     setting_path gamedir;
     setting_path basedir;
     setting_enum<search_priority_t> filepriority;
     setting_set paths;
     setting_bool q2rtx;
     setting_invertible_bool defaultpaths;
+    setting_path texturecache;
+    setting_bool cleartexturecache;
 
     common_settings();
 
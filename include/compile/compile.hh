@@ -0,0 +1,69 @@
+/*  Copyright (C) 1996-1997  Id Software, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+    See file, 'COPYING', for details.
+*/
+
+#pragma once
+
+#include <common/bspfile.hh>
+#include <common/fs.hh>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+enum class compile_stage_t
+{
+    qbsp,
+    vis,
+    light,
+    done
+};
+
+/**
+ * Options for CompileMap, which runs qbsp, vis and light in one process. The BSP
+ * (bspdata_t) and the vis portals (prtfile_t) are handed from one stage to the next
+ * in memory rather than written to <mapname>.bsp / .prt and parsed again by the next
+ * tool.
+ */
+struct compile_options_t
+{
+    // extra arguments for each tool; the map/bsp name is appended by CompileMap
+    std::vector<std::string> qbsp_args;
+    std::vector<std::string> vis_args;
+    std::vector<std::string> light_args;
+
+    // where the .bsp (and the .prt, .lit, .log etc. next to it) go, like qbsp's destfile.bsp;
+    // next to the .map if empty
+    fs::path output_path;
+
+    bool run_vis = true;
+    bool run_light = true;
+
+    // write the finished .bsp
+    bool write_bsp = true;
+    // also write the .bsp after qbsp and vis, and the .prt, like the separate tools would
+    bool write_intermediate = false;
+
+    // called before each tool runs, and with `done` at the end
+    std::function<void(compile_stage_t)> stage_callback;
+};
+
+// compiles `map_path`; returns the finished bsp in the generic format
+bspdata_t CompileMap(const fs::path &map_path, const compile_options_t &options);
+
+int compile_main(int argc, const char **argv);
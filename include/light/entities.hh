@@ -140,6 +140,7 @@ std::string TargetnameForLightStyle(int style);
 std::vector<std::unique_ptr<light_t>> &GetLights();
 const std::vector<entdict_t> &GetEntdicts();
 std::vector<sun_t> &GetSuns();
+std::vector<skydome_t> &GetSkyDomes();
 std::vector<entdict_t> &GetRadLights();
 
 const std::vector<std::unique_ptr<light_t>> &GetSurfaceLightTemplates();
@@ -154,6 +155,8 @@ void SetupLights(const settings::worldspawn_keys &cfg, const mbsp_t *bsp);
 bool ParseLightsFile(const fs::path &fname);
 void WriteEntitiesToString(const settings::worldspawn_keys &cfg, mbsp_t *bsp);
 aabb3d EstimateVisibleBoundsAtPoint(const qvec3d &point);
+// union of EstimateVisibleBoundsAtPoint for each point, traced in large batches
+aabb3d EstimateVisibleBoundsAtPoints(const std::vector<qvec3d> &points);
 
 bool EntDict_CheckNoEmptyValues(const mbsp_t *bsp, const entdict_t &entdict);
 
@@ -24,6 +24,9 @@
 
 #include <common/qvec.hh>
 
+#include <map>
+#include <tuple>
+
 namespace img
 {
 struct texture;
@@ -41,7 +44,7 @@ constexpr vec_t MAX_SKY_DIST = 1000000;
 struct lightsample_t
 {
     qvec3f color;
-    qvec3d direction;
+    qvec3f direction;
 };
 
 // CHECK: isn't average a bad algorithm for color brightness?
@@ -67,6 +70,30 @@ public:
     const img::texture *suntexture_value;
 };
 
+/**
+ * A hemisphere of sky light (_sunlight2 / _sunlight3).
+ *
+ * Rather than being expanded into one sun_t per direction, the whole
+ * dome is integrated at once per sample point. `directions` point
+ * towards the sky; each one carries `sunlight / directions.size()`.
+ * `probes` is a stratified subset of `directions` which, with
+ * -skydomeprobes, is traced first to guess which points see all or none
+ * of the dome (an approximation; empty by default).
+ */
+class skydome_t
+{
+public:
+    std::vector<qvec3d> directions;
+    std::vector<size_t> probes;
+    vec_t sunlight;
+    qvec3d sunlight_color;
+    bool dirt;
+    float anglescale;
+    int style;
+    std::string suntexture;
+    const img::texture *suntexture_value;
+};
+
 class modelinfo_t;
 namespace settings
 {
@@ -86,6 +113,23 @@ struct surfacelight_t;
 class raystream_occlusion_t;
 class raystream_intersection_t;
 
+/**
+ * Results of the shadow rays from each sample point of a light surface
+ * towards one light origin (or sun direction), so that lights sharing it
+ * (switchable pairs, negative lights on top of positive ones, ...)
+ * don't trace them again.
+ *
+ * A sample is in neither set if it wasn't traced yet, or if its ray
+ * passed through glass or a dynamic shadow caster.
+ */
+struct light_visibility_t
+{
+    std::vector<bool> visible, blocked;
+};
+
+// (is sun, light origin or sun direction, shadow channel mask, sun texture)
+using light_visibility_key_t = std::tuple<bool, qvec3d, int32_t, const img::texture *>;
+
 struct lightsurf_t
 {
     const settings::worldspawn_keys *cfg;
@@ -111,18 +155,21 @@ struct lightsurf_t
 
     faceextents_t extents, vanilla_extents;
 
-    // width * height sample points in world space
+    // width * height sample points in world space.
+    // single precision and ordered to pack tightly; with -extra4 there are a lot of these
     struct sample_data_t
     {
-        qvec3d point;
-        qvec3d normal;
-        bool occluded;
-        int32_t realfacenum;
+        qvec3f point;
+        qvec3f normal;
         /*
         raw ambient occlusion amount per sample point, 0-1, where 1 is
         fully occluded. dirtgain/dirtscale are not applied yet
         */
         float occlusion;
+        int32_t realfacenum;
+        // number of dirt rays the occlusion was estimated from
+        int32_t dirt_rays;
+        bool occluded;
     };
 
     std::vector<sample_data_t> samples;
@@ -144,6 +191,10 @@ struct lightsurf_t
 
     lightmapdict_t lightmapsByStyle;
 
+    // shadow ray results for light origins shared by several lights (see SetupLightVisibilityCache);
+    // only the ones a negative light still needs are kept after DirectLightFace
+    std::map<light_visibility_key_t, light_visibility_t> visibility_cache;
+
     // surface light stuff
     std::unique_ptr<surfacelight_t> vpl;
 };
@@ -240,6 +291,21 @@ enum class visapprox_t
     RAYS
 };
 
+enum class bvhquality_t
+{
+    LOW,
+    MEDIUM,
+    HIGH,
+    REFIT
+};
+
+enum class raypackets_t
+{
+    NONE,
+    PACKET8,
+    PACKET16
+};
+
 enum class emissivequality_t
 {
     LOW,
@@ -293,6 +359,7 @@ public:
     setting_scalar dirtscale;
     setting_scalar dirtgain;
     setting_scalar dirtangle;
+    setting_scalar dirtthreshold;
     setting_bool minlight_dirt;
 
     /* phong */
@@ -305,6 +372,8 @@ public:
     setting_scalar bouncescale;
     setting_scalar bouncecolorscale;
     setting_scalar bouncelightsubdivision;
+    setting_int32 bounceiterations;
+    setting_scalar bounceconvergence;
 
     /* Q2 surface lights (mxd) */
     setting_scalar surflightscale;
@@ -374,6 +443,8 @@ public:
     setting_bool novanilla;
     setting_scalar gate;
     setting_int32 sunsamples;
+    setting_int32 skydomeprobes;
+    setting_bool visibilitycache;
     setting_bool arghradcompat;
     setting_bool nolighting;
     setting_vec3 debugface;
@@ -385,6 +456,12 @@ public:
     setting_extra extra;
     setting_enum<emissivequality_t> emissivequality;
     setting_enum<visapprox_t> visapprox;
+    setting_enum<raypackets_t> raypackets;
+    setting_enum<bvhquality_t> bvhquality;
+    setting_bool bvhcompact;
+    setting_bool bvhrobust;
+    setting_bool bvhinstancing;
+    setting_bool samplecache;
     setting_func lit;
     setting_func lit2;
     setting_func bspxlit;
@@ -401,6 +478,7 @@ public:
     setting_bool lightgrid;
     setting_vec3 lightgrid_dist;
     setting_enum<lightgrid_format_t> lightgrid_format;
+    setting_scalar lightgrid_adaptive;
 
     setting_func dirtdebug;
     setting_func bouncedebug;
@@ -456,3 +534,7 @@ const qvec3d &Face_LookupTextureBounceColor(const mbsp_t *bsp, const mface_t *fa
 void light_reset();
 int light_main(int argc, const char **argv);
 int light_main(const std::vector<std::string> &args);
+// lights `bspdata` in place instead of loading and writing <mapname>.bsp; the other outputs
+// (.lit, .lux, ...) are still written next to the map. `bspdata` is left in the generic format.
+// Returns false if the options don't produce a .bsp (-litonly, -lit2, phong_obj debug mode).
+bool light_main(const std::vector<std::string> &args, bspdata_t &bspdata);
@@ -25,3 +25,6 @@ struct bspdata_t;
 
 std::tuple<lightgrid_samples_t, bool> FixPointAndCalcLightgrid(const mbsp_t *bsp, qvec3d world_point);
 void LightGrid(bspdata_t *bspdata);
+
+// number of grid points LightGrid actually traced on its last run (less than the grid size with -lightgrid_adaptive)
+extern size_t lightgrid_evaluated_points;
@@ -38,6 +38,10 @@ class light_t;
 struct facesup_t;
 
 extern std::atomic<uint32_t> total_light_rays, total_light_ray_hits, total_samplepoints;
+extern std::atomic<uint32_t> total_skydome_rays_skipped;
+extern std::atomic<uint32_t> total_light_rays_cached;
+extern std::atomic<uint32_t> total_dirt_rays;
+extern std::atomic<uint32_t> total_samplecache_faces;
 extern std::atomic<uint32_t> total_bounce_rays, total_bounce_ray_hits;
 extern std::atomic<uint32_t> total_surflight_rays, total_surflight_ray_hits; // mxd
 extern std::atomic<uint32_t> fully_transparent_lightmaps;
@@ -50,6 +54,7 @@ std::unique_ptr<lightsurf_t> CreateLightmapSurface(const mbsp_t *bsp, const mfac
     const bspx_decoupled_lm_perface *facesup_decoupled, const settings::worldspawn_keys &cfg);
 bool Face_IsLightmapped(const mbsp_t *bsp, const mface_t *face);
 bool Face_IsEmissive(const mbsp_t *bsp, const mface_t *face);
+void SetupLightVisibilityCache();
 void DirectLightFace(const mbsp_t *bsp, lightsurf_t &lightsurf, const settings::worldspawn_keys &cfg);
 void IndirectLightFace(const mbsp_t *bsp, lightsurf_t &lightsurf, const settings::worldspawn_keys &cfg);
 void PostProcessLightFace(const mbsp_t *bsp, lightsurf_t &lightsurf, const settings::worldspawn_keys &cfg);
@@ -0,0 +1,69 @@
+/*  Copyright (C) 1996-1997  Id Software, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+    See file, 'COPYING', for details.
+*/
+
+#pragma once
+
+#include <common/fs.hh>
+#include <common/qvec.hh>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct mbsp_t;
+struct facesup_t;
+struct lightsurf_t;
+
+/**
+ * The sample points CalcPoints() computed for one face. These only depend
+ * on the geometry and the lightmap resolution settings, so they're saved
+ * to <mapname>.lightpoints and reused by the next light run.
+ */
+struct cached_sample_points_t
+{
+    struct sample_t
+    {
+        qvec3f point;
+        qvec3f normal;
+        bool occluded;
+        int32_t realfacenum;
+    };
+
+    // lightsurf_t::width / height
+    int32_t width = 0;
+    int32_t height = 0;
+    std::vector<sample_t> samples;
+};
+
+/**
+ * Hashes everything the sample points depend on: the geometry lumps,
+ * bmodel offsets/lightmap scales/shadow casting, phong settings and
+ * -extra / -world_units_per_luxel. Must be called after
+ * CalculateVertexNormals, which resolves the entity phong keys.
+ */
+uint64_t SampleCache_Key(const mbsp_t *bsp, const std::vector<facesup_t> &facesup);
+
+// loads the cache; returns false if it's missing or `key` doesn't match
+bool SampleCache_Load(const fs::path &filename, uint64_t key, const mbsp_t *bsp);
+void SampleCache_Save(
+    const fs::path &filename, uint64_t key, const std::vector<std::unique_ptr<lightsurf_t>> &surfaces);
+
+// the loaded points for the given face, or nullptr
+const cached_sample_points_t *SampleCache_ForFace(size_t facenum);
+void SampleCache_Clear();
@@ -26,6 +26,7 @@ See file, 'COPYING', for details.
 
 #include <common/qvec.hh>
 #include <common/aabb.hh>
+#include <common/polylib.hh>
 
 struct mleaf_t;
 struct mface_t;
@@ -70,9 +71,30 @@ struct surfacelight_t
     std::vector<per_style_t> styles;
 };
 
+/**
+ * Face geometry shared by everything that emits light from a surface
+ * (surface lights and bounce lights). Computed once per face and cached
+ * until ResetSurflight().
+ */
+struct face_emitter_t
+{
+    // world space (bmodel offset applied), colinear points removed
+    polylib::winding_t winding;
+    // area before removing colinear points
+    float area = 0;
+    qvec3d normal;
+    // winding center, lifted 1 unit off the face
+    qvec3d midpoint;
+};
+
 class light_t;
 
 void ResetSurflight();
+// must be called before FaceEmitter() is used from several threads
+void SetupFaceEmitters(const mbsp_t *bsp);
+const face_emitter_t &FaceEmitter(const mbsp_t *bsp, const mface_t *face);
+// fills in l.bounds or l.leaves from l.pos and l.points, according to -visapprox
+void EstimateSurfaceLightVisibility(const mbsp_t *bsp, surfacelight_t &l);
 size_t GetSurflightPoints();
 std::optional<std::tuple<int32_t, int32_t, qvec3d, light_t *>> IsSurfaceLitFace(const mbsp_t *bsp, const mface_t *face);
 const std::vector<int> &SurfaceLightsForFaceNum(int facenum);
@@ -72,6 +72,8 @@ public:
 
     constexpr size_t numPushedRays() { return _numrays; }
 
+    constexpr size_t maxPushedRays() { return _maxrays; }
+
     inline int &getPushedRayPointIndex(size_t j) { return _point_indices[j]; }
 
     inline qvec3f getPushedRayColor(size_t j)
@@ -95,6 +97,8 @@ public:
 
     inline qvec3d &getPushedRayNormalContrib(size_t j) { return _ray_normalcontribs[j]; }
 
+    inline bool getPushedRayHitGlass(size_t j) { return _ray_hit_glass[j]; }
+
     inline int &getPushedRayDynamicStyle(size_t j) { return _ray_dynamic_styles[j]; }
 
     inline void clearPushedRays() { _numrays = 0; }
@@ -148,6 +152,10 @@ struct ray_source_info : public RTCIntersectContext
     ray_source_info(raystream_embree_common_t *raystream_, const modelinfo_t *self_, int shadowmask_);
 };
 
+// trace a stream of rays, either as single rays or as packets (see -raypackets)
+void Embree_IntersectStream(ray_source_info *ctx, RTCRayHit *rays, size_t count);
+void Embree_OccludedStream(ray_source_info *ctx, RTCRay *rays, size_t count);
+
 struct triinfo
 {
     const modelinfo_t *modelinfo;
@@ -238,7 +246,7 @@ public:
             return;
 
         ray_source_info ctx2(this, self, shadowmask);
-        rtcIntersect1M(scene, &ctx2, _rays.data(), _numrays, sizeof(_rays[0]));
+        Embree_IntersectStream(&ctx2, _rays.data(), _numrays);
     }
 
     inline qvec3d getPushedRayDir(size_t j) { return {_rays[j].ray.dir_x, _rays[j].ray.dir_y, _rays[j].ray.dir_z}; }
@@ -250,6 +258,9 @@ public:
         const unsigned id = _rays[j].hit.geomID;
         if (id == RTC_INVALID_GEOMETRY_ID) {
             return hittype_t::NONE;
+        } else if (_rays[j].hit.instID[0] != RTC_INVALID_GEOMETRY_ID) {
+            // instanced bmodels are always solid
+            return hittype_t::SOLID;
         } else if (id == skygeom.geomID) {
             return hittype_t::SKY;
         } else {
@@ -261,7 +272,8 @@ public:
     {
         const RTCRayHit &ray = _rays[j];
 
-        if (ray.hit.geomID == RTC_INVALID_GEOMETRY_ID) {
+        // instanced bmodels don't have triangle info
+        if (ray.hit.geomID == RTC_INVALID_GEOMETRY_ID || ray.hit.instID[0] != RTC_INVALID_GEOMETRY_ID) {
             return nullptr;
         }
 
@@ -312,7 +324,7 @@ public:
             return;
 
         ray_source_info ctx2(this, self, shadowmask);
-        rtcOccluded1M(scene, &ctx2, _rays.data(), _numrays, sizeof(_rays[0]));
+        Embree_OccludedStream(&ctx2, _rays.data(), _numrays);
     }
 
     inline bool getPushedRayOccluded(size_t j) { return (_rays[j].tfar < 0.0f); }
@@ -26,6 +26,7 @@
 
 #include <common/bspfile.hh>
 #include <common/parser.hh>
+#include <common/prtfile.hh>
 #include "common/cmdlib.hh"
 
 #include <optional>
@@ -173,6 +174,7 @@ struct mapplane_t : qbsp_plane_t
 
 struct planehash_t;
 struct vertexhash_t;
+struct edgehash_t;
 
 struct hashedge_t
 {
@@ -231,16 +233,23 @@ struct mapdata_t
     std::unique_ptr<vertexhash_t> hashverts;
 
     // find output index for specified already-output vector.
-    std::optional<size_t> find_emitted_hash_vector(const qvec3d &vert);
+    std::optional<size_t> find_emitted_hash_vector(const qvec3d &vert) const;
 
     // add vector to hash
     void add_hash_vector(const qvec3d &point, const size_t &num);
 
     // hashed edges; generated by EmitEdges
-    std::map<std::pair<size_t, size_t>, hashedge_t> hashedges;
+    std::unique_ptr<edgehash_t> hashedges;
+
+    // find the already-output edge going from v1 to v2, if any
+    const hashedge_t *find_hash_edge(size_t v1, size_t v2) const;
 
     void add_hash_edge(size_t v1, size_t v2, int64_t edge_index, const face_t *face);
 
+    bool hash_edges_empty() const;
+
+    void clear_hash_edges();
+
     /* Misc other global state for the compile process */
     bool leakfile = false; /* Flag once we've written a leak (.por/.pts) file */
 
@@ -252,6 +261,12 @@ struct mapdata_t
     bool needslmshifts = false;
     std::vector<uint8_t> exported_bspxbrushes;
 
+    // set by the in-process compile pipeline (see include/compile/compile.hh); instead of being
+    // written to disk, the finished .bsp and the world's vis portals are left here for the caller
+    bool keep_output = false;
+    std::optional<bspdata_t> output_bsp;
+    std::optional<prtfile_t> output_prt;
+
     // Q2 stuff
     int32_t c_areas = 0;
     int32_t numareaportals = 0;
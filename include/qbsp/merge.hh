@@ -28,6 +28,5 @@
 struct face_t;
 struct node_t;
 
-void MergeFaceToList(face_t *face, std::list<face_t *> &list);
 std::list<std::unique_ptr<face_t>> MergeFaceList(
     std::list<std::unique_ptr<face_t>> input, logging::stat_tracker_t::stat &num_merged);
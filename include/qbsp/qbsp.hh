@@ -209,6 +209,7 @@ public:
     setting_int32 leakdist;
     setting_bool forceprt1;
     setting_tjunc tjunc;
+    setting_int32 mwtmaxverts;
     setting_bool objexport;
     setting_bool noextendedsurfflags;
     setting_bool wrbrushes;
@@ -267,3 +267,6 @@ extern settings::vis_settings vis_options;
 
 int vis_main(int argc, const char **argv);
 int vis_main(const std::vector<std::string> &args);
+// runs vis on `bspdata` in place, using the portals qbsp handed over instead of loading
+// <mapname>.bsp and <mapname>.prt. Nothing is written; `bspdata` is left in the generic format.
+int vis_main(const std::vector<std::string> &args, bspdata_t &bspdata, const prtfile_t &prtfile);
@@ -24,10 +24,10 @@
 #include <atomic>
 
 #include <light/light.hh>
-#include <light/entities.hh> // for EstimateVisibleBoundsAtPoint
 #include <light/ltface.hh>
 #include <light/surflight.hh>
 #include <light/trace.hh> // for Light_PointInLeaf
+#include <light/trace_embree.hh>
 
 #include <common/polylib.hh>
 #include <common/bsputils.hh>
@@ -35,6 +35,9 @@
 #include <vector>
 #include <unordered_map>
 #include <mutex>
+#include <set>
+
+#include <fmt/chrono.h>
 
 #include <common/qvec.hh>
 #include <common/parallel.hh>
@@ -89,8 +92,8 @@ static bool Face_ShouldBounce(const mbsp_t *bsp, const mface_t *face)
 }
 
 static void MakeBounceLight(const mbsp_t *bsp, const settings::worldspawn_keys &cfg, lightsurf_t &surf,
-    qvec3d texture_color, int32_t style, const std::vector<qvec3f> &points, const winding_t &winding, const vec_t &area,
-    const qvec3d &facenormal, const qvec3d &facemidpoint)
+    qvec3d texture_color, int32_t style, const std::vector<qvec3f> &points, const vec_t &area, const qvec3d &facenormal,
+    const qvec3d &facemidpoint)
 {
     if (!Face_IsEmissive(bsp, surf.face)) {
         return;
@@ -121,21 +124,10 @@ static void MakeBounceLight(const mbsp_t *bsp, const settings::worldspawn_keys &
         // Add surfacelight...
         l->surfnormal = facenormal;
         l->points = points;
+        l->pos = facemidpoint;
 
         // Init bbox...
-        if (light_options.visapprox.value() == visapprox_t::RAYS) {
-            l->bounds = EstimateVisibleBoundsAtPoint(facemidpoint);
-        }
-
-        for (auto &pt : l->points) {
-            if (light_options.visapprox.value() == visapprox_t::VIS) {
-                l->leaves.push_back(Light_PointInLeaf(bsp, pt));
-            } else if (light_options.visapprox.value() == visapprox_t::RAYS) {
-                l->bounds += EstimateVisibleBoundsAtPoint(pt);
-            }
-        }
-
-        l->pos = facemidpoint;
+        EstimateSurfaceLightVisibility(bsp, *l);
     }
 
     // Store surfacelight settings...
@@ -150,9 +142,26 @@ static void MakeBounceLight(const mbsp_t *bsp, const settings::worldspawn_keys &
     }
 }
 
-static void MakeBounceLightsThread(const settings::worldspawn_keys &cfg, const mbsp_t *bsp, const mface_t &face)
+/**
+ * A face that can emit bounced light, with the points it emits from.
+ */
+struct bounce_face_t
 {
-    if (!Face_ShouldBounce(bsp, &face)) {
+    bool valid = false;
+    lightsurf_t *surf = nullptr;
+    vec_t area = 0;
+    qvec3d facenormal, facemidpoint;
+    vector<qvec3f> points;
+    // texture color lerped with gray according to `bouncecolorscale`
+    qvec3d blendedcolor;
+    // color to emit for each style; the first bounce is the average of the direct lightmaps
+    std::unordered_map<int, qvec3d> emitcolors;
+};
+
+static void MakeBounceFace(const settings::worldspawn_keys &cfg, const mbsp_t *bsp, const mface_t &face,
+    bounce_face_t &out)
+{
+    if (!Face_ShouldBounce(bsp, &face) || !Face_IsEmissive(bsp, &face)) {
         return;
     }
 
@@ -164,20 +173,52 @@ static void MakeBounceLightsThread(const settings::worldspawn_keys &cfg, const m
 
     auto &surf = *surf_ptr.get();
 
-    // no lights
-    if (!surf.lightmapsByStyle.size()) {
+    // shared with surface lights, computed once per face
+    const face_emitter_t &emitter = FaceEmitter(bsp, &face);
+
+    if (emitter.area < 1.f) {
         return;
     }
 
-    winding_t winding = winding_t::from_face(bsp, &face);
-    vec_t area = winding.area();
-
-    if (area < 1.f) {
+    // with a single bounce, faces without direct light have nothing to emit
+    if (!surf.lightmapsByStyle.size() && cfg.bounceiterations.value() <= 1) {
         return;
     }
 
-    // Create winding...
-    winding.remove_colinear();
+    out.valid = true;
+    out.surf = &surf;
+    out.area = emitter.area;
+
+    // Get face normal and midpoint...
+    out.facenormal = emitter.normal;
+    out.facemidpoint = emitter.midpoint;
+
+    // lerp between gray and the texture color according to `bouncecolorscale` (0 = use gray, 1 = use texture color)
+    out.blendedcolor = Face_LookupTextureBounceColor(bsp, &face);
+
+    auto &points = out.points;
+
+    if (light_options.emissivequality.value() == emissivequality_t::LOW ||
+        light_options.emissivequality.value() == emissivequality_t::MEDIUM) {
+        points = {out.facemidpoint};
+
+        if (light_options.emissivequality.value() == emissivequality_t::MEDIUM) {
+
+            for (auto &pt : emitter.winding) {
+                points.push_back(pt + emitter.normal);
+            }
+        }
+    } else {
+        // dice() consumes the winding
+        winding_t winding = emitter.winding.clone();
+        winding.dice(cfg.bouncelightsubdivision.value(),
+            [&points, &emitter](winding_t &w) { points.push_back(w.center() + emitter.normal); });
+    }
+
+    // no lights
+    if (!surf.lightmapsByStyle.size()) {
+        return;
+    }
 
     // grab the average color across the whole set of lightmaps for this face.
     // this doesn't change regardless of the above settings.
@@ -209,41 +250,211 @@ static void MakeBounceLightsThread(const settings::worldspawn_keys &cfg, const m
         return;
     }
 
-    // lerp between gray and the texture color according to `bouncecolorscale` (0 = use gray, 1 = use texture color)
-    const qvec3d &blendedcolor = Face_LookupTextureBounceColor(bsp, &face);
-
     // final colors to emit
-    std::unordered_map<int, qvec3d> emitcolors;
-
     for (const auto &styleColor : sum) {
-        emitcolors[styleColor.first] = styleColor.second * blendedcolor;
+        out.emitcolors[styleColor.first] = styleColor.second * out.blendedcolor;
     }
+}
 
-    qplane3d faceplane = winding.plane();
+/**
+ * Solves the further bounces between the bounce faces, then replaces each
+ * face's emitcolors with the sum over all bounces, so the single luxel
+ * gather in IndirectLightFace picks all of them up.
+ *
+ * The transfer between faces is computed once, between the emission
+ * points of each face (a much coarser sampling than the luxels), using the
+ * same falloff as GetSurfaceLighting. Each iteration after that only
+ * multiplies the previous bounce's colors through the cached coefficients.
+ */
+static void IterateBounceLights(const settings::worldspawn_keys &cfg, std::vector<bounce_face_t> &faces)
+{
+    std::vector<size_t> indices;
+    vec_t max_emit = 0;
 
-    // Get face normal and midpoint...
-    qvec3d facenormal = faceplane.normal;
-    qvec3d facemidpoint = winding.center() + facenormal; // Lift 1 unit
+    for (size_t i = 0; i < faces.size(); i++) {
+        if (!faces[i].valid) {
+            continue;
+        }
 
-    vector<qvec3f> points;
+        indices.push_back(i);
 
-    if (light_options.emissivequality.value() == emissivequality_t::LOW ||
-        light_options.emissivequality.value() == emissivequality_t::MEDIUM) {
-        points = {facemidpoint};
+        for (auto &[style, color] : faces[i].emitcolors) {
+            max_emit = max(max_emit, qv::max(color));
+        }
+    }
 
-        if (light_options.emissivequality.value() == emissivequality_t::MEDIUM) {
+    if (indices.empty() || max_emit <= 0) {
+        return;
+    }
+
+    // same as IndirectLightFace / LightFace_SurfaceLight
+    const float standard_scale = cfg.bouncescale.value() * 0.5;
+    const float hotspot_clamp = 128.0f;
+    const float bouncelight_gate = 0.01f;
+
+    // bounding spheres, for culling whole faces
+    std::vector<qvec3d> centers(indices.size());
+    std::vector<vec_t> radii(indices.size());
+
+    for (size_t i = 0; i < indices.size(); i++) {
+        const bounce_face_t &face = faces[indices[i]];
+
+        centers[i] = face.facemidpoint;
+        for (auto &pt : face.points) {
+            radii[i] = max(radii[i], qv::distance(qvec3d(pt), centers[i]));
+        }
+    }
+
+    // for each receiver, the faces it receives from and how much of their color arrives (averaged over the
+    // receiver's points)
+    std::vector<std::vector<std::pair<size_t, float>>> transfer(indices.size());
+    std::atomic_size_t transfer_rays = 0;
+
+    auto start = I_FloatTime();
 
-            for (auto &pt : winding) {
-                points.push_back(pt + faceplane.normal);
+    logging::parallel_for(static_cast<size_t>(0), indices.size(), [&](size_t ri) {
+        const bounce_face_t &r = faces[indices[ri]];
+
+        thread_local raystream_occlusion_t rs;
+        if (rs.maxPushedRays() < r.points.size()) {
+            rs.resize(r.points.size());
+        }
+
+        for (size_t ei = 0; ei < indices.size(); ei++) {
+            if (ei == ri) {
+                continue;
+            }
+
+            const bounce_face_t &e = faces[indices[ei]];
+            const float point_weight = e.area / e.points.size();
+
+            // skip faces that can't contribute above the gate even at their closest
+            const vec_t closest = max(
+                qv::distance(centers[ri], centers[ei]) - radii[ri] - radii[ei], static_cast<vec_t>(hotspot_clamp));
+            if (standard_scale * point_weight * max_emit / (closest * closest) <= bouncelight_gate) {
+                continue;
+            }
+
+            float sum = 0;
+
+            for (const qvec3f &pos : e.points) {
+                rs.clearPushedRays();
+
+                for (const qvec3f &point : r.points) {
+                    qvec3f dir = point - pos; // vpl -> receiver
+                    const float dist = qv::length(dir);
+
+                    if (dist == 0.0f) {
+                        continue;
+                    }
+
+                    dir /= dist;
+
+                    const float dp1 = qv::dot(qvec3f(e.facenormal), dir);
+                    const float dp2 = -qv::dot(qvec3f(r.facenormal), dir);
+
+                    if (dp1 < -LIGHT_ANGLE_EPSILON || dp2 < -LIGHT_ANGLE_EPSILON) {
+                        continue;
+                    }
+
+                    const float d = max(dist, hotspot_clamp);
+                    const float weight = standard_scale * point_weight * max(0.0f, dp1 * dp2) / (d * d);
+
+                    if (weight * max_emit <= bouncelight_gate) {
+                        continue;
+                    }
+
+                    const qvec3f weight_color{weight};
+                    rs.pushRay(0, pos, dir, dist, &weight_color);
+                }
+
+                if (!rs.numPushedRays()) {
+                    continue;
+                }
+
+                transfer_rays += rs.numPushedRays();
+                rs.tracePushedRaysOcclusion(r.surf->modelinfo, CHANNEL_MASK_DEFAULT);
+
+                for (int j = 0; j < rs.numPushedRays(); j++) {
+                    if (!rs.getPushedRayOccluded(j)) {
+                        sum += rs.getPushedRayColor(j)[0];
+                    }
+                }
+            }
+
+            if (sum > 0) {
+                transfer[ri].emplace_back(ei, sum / r.points.size());
             }
         }
-    } else {
-        winding.dice(cfg.bouncelightsubdivision.value(),
-            [&points, &faceplane](winding_t &w) { points.push_back(w.center() + faceplane.normal); });
+    });
+
+    size_t num_transfers = 0;
+    for (auto &list : transfer) {
+        num_transfers += list.size();
     }
 
-    for (auto &style : emitcolors) {
-        MakeBounceLight(bsp, cfg, surf, style.second, style.first, points, winding, area, facenormal, facemidpoint);
+    logging::print("\t{} bounce faces, {} transfers, {} rays ({:.3} seconds)\n", indices.size(), num_transfers,
+        transfer_rays.load(), I_FloatTime() - start);
+
+    // total power emitted by one bounce, for checking convergence
+    auto energy = [&](const std::vector<std::unordered_map<int, qvec3d>> &colors) {
+        vec_t result = 0;
+        for (size_t i = 0; i < indices.size(); i++) {
+            for (auto &[style, color] : colors[i]) {
+                result += LightSample_Brightness(color) * faces[indices[i]].area;
+            }
+        }
+        return result;
+    };
+
+    std::vector<std::unordered_map<int, qvec3d>> current(indices.size());
+    for (size_t i = 0; i < indices.size(); i++) {
+        current[i] = faces[indices[i]].emitcolors;
+    }
+    std::vector<std::unordered_map<int, qvec3d>> total = current;
+
+    const vec_t first_energy = energy(current);
+    logging::print("\tbounce 1: energy {:.1f}\n", first_energy);
+
+    for (int32_t iteration = 2; iteration <= cfg.bounceiterations.value(); iteration++) {
+        auto iteration_start = I_FloatTime();
+
+        std::vector<std::unordered_map<int, qvec3d>> next(indices.size());
+
+        logging::parallel_for(static_cast<size_t>(0), indices.size(), [&](size_t ri) {
+            auto &received = next[ri];
+
+            for (auto &[ei, coefficient] : transfer[ri]) {
+                for (auto &[style, color] : current[ei]) {
+                    received[style] += color * coefficient;
+                }
+            }
+
+            for (auto &[style, color] : received) {
+                color *= faces[indices[ri]].blendedcolor;
+            }
+        });
+
+        for (size_t i = 0; i < indices.size(); i++) {
+            for (auto &[style, color] : next[i]) {
+                total[i][style] += color;
+            }
+        }
+
+        current = std::move(next);
+
+        const vec_t iteration_energy = energy(current);
+        logging::print("\tbounce {}: energy {:.1f} ({:.3} seconds)\n", iteration, iteration_energy,
+            I_FloatTime() - iteration_start);
+
+        if (iteration_energy <= first_energy * cfg.bounceconvergence.value()) {
+            logging::print("\tconverged after {} bounces\n", iteration);
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < indices.size(); i++) {
+        faces[indices[i]].emitcolors = std::move(total[i]);
     }
 }
 
@@ -251,7 +462,25 @@ void MakeBounceLights(const settings::worldspawn_keys &cfg, const mbsp_t *bsp)
 {
     logging::funcheader();
 
-    logging::parallel_for_each(bsp->dfaces, [&](const mface_t &face) { MakeBounceLightsThread(cfg, bsp, face); });
+    std::vector<bounce_face_t> faces(bsp->dfaces.size());
+
+    SetupFaceEmitters(bsp);
+
+    logging::parallel_for(static_cast<size_t>(0), bsp->dfaces.size(),
+        [&](size_t i) { MakeBounceFace(cfg, bsp, bsp->dfaces[i], faces[i]); });
+
+    if (cfg.bounceiterations.value() > 1) {
+        IterateBounceLights(cfg, faces);
+    }
+
+    logging::parallel_for(static_cast<size_t>(0), faces.size(), [&](size_t i) {
+        auto &face = faces[i];
+
+        for (auto &style : face.emitcolors) {
+            MakeBounceLight(bsp, cfg, *face.surf, style.second, style.first, face.points, face.area, face.facenormal,
+                face.facemidpoint);
+        }
+    });
 
     // logging::print("{} bounce lights created, with {} points\n", bouncelights.size(), bouncelightpoints);
 }
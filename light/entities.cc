@@ -22,6 +22,8 @@
 #include <algorithm>
 #include <cstring>
 #include <fstream>
+#include <mutex>
+#include <unordered_map>
 #include <common/imglib.hh> // for img::find
 #include <common/log.hh>
 #include <common/cmdlib.hh>
@@ -36,9 +38,17 @@
 
 static std::vector<std::unique_ptr<light_t>> all_lights;
 static std::vector<sun_t> all_suns;
+static std::vector<skydome_t> all_skydomes;
 static std::vector<entdict_t> entdicts;
 static std::vector<entdict_t> radlights;
 static std::vector<std::pair<std::string, int>> lightstyleForTargetname;
+static std::unordered_map<std::string, int> lightstyleIndexForTargetname;
+static std::mutex lightstyles_lock;
+// case-insensitive targetname -> first entdict with that targetname; built by MatchTargets
+static std::unordered_map<std::string, const entdict_t *, case_insensitive_hash, case_insensitive_equal>
+    entdicts_by_targetname;
+// key -> (value -> first entdict with that key/value); built on demand by FindEntDictWithKeyPair
+static std::unordered_map<std::string, std::unordered_map<std::string, const entdict_t *>> entdicts_by_keypair;
 static std::vector<std::unique_ptr<light_t>> surfacelight_templates;
 static std::ofstream surflights_dump_file;
 static fs::path surflights_dump_filename;
@@ -50,10 +60,14 @@ void ResetLightEntities()
 {
     all_lights.clear();
     all_suns.clear();
+    all_skydomes.clear();
     entdicts.clear();
+    entdicts_by_targetname.clear();
+    entdicts_by_keypair.clear();
     radlights.clear();
 
     lightstyleForTargetname.clear();
+    lightstyleIndexForTargetname.clear();
 
     surfacelight_templates.clear();
     surflights_dump_file = {};
@@ -75,6 +89,11 @@ std::vector<sun_t> &GetSuns()
     return all_suns;
 }
 
+std::vector<skydome_t> &GetSkyDomes()
+{
+    return all_skydomes;
+}
+
 std::vector<entdict_t> &GetRadLights()
 {
     return radlights;
@@ -167,10 +186,13 @@ entdict_t &WorldEnt()
  */
 int LightStyleForTargetname(const settings::worldspawn_keys &cfg, const std::string &targetname)
 {
+    // surface lights are set up in parallel
+    std::unique_lock lock(lightstyles_lock);
+
     // check if already assigned
-    for (const auto &pr : lightstyleForTargetname) {
-        if (pr.first == targetname && targetname.size() > 0) {
-            return pr.second;
+    if (targetname.size() > 0) {
+        if (auto it = lightstyleIndexForTargetname.find(targetname); it != lightstyleIndexForTargetname.end()) {
+            return lightstyleForTargetname[it->second].second;
         }
     }
 
@@ -182,6 +204,9 @@ int LightStyleForTargetname(const settings::worldspawn_keys &cfg, const std::str
         FError("Too many unique light targetnames (max={})\n", cfg.compilerstyle_max.value());
     }
 
+    if (targetname.size() > 0) {
+        lightstyleIndexForTargetname.emplace(targetname, lightstyleForTargetname.size());
+    }
     lightstyleForTargetname.emplace_back(targetname, newStylenum);
 
     logging::print(logging::flag::VERBOSE, "Allocated lightstyle {} for targetname '{}'\n", newStylenum, targetname);
@@ -210,17 +235,25 @@ std::string TargetnameForLightStyle(int style)
  */
 static void MatchTargets(void)
 {
+    entdicts_by_targetname.clear();
+
+    // first entity with a given targetname wins, same as a linear search would
+    for (const entdict_t &target : entdicts) {
+        const std::string &targetname = target.get("targetname");
+
+        if (!targetname.empty()) {
+            entdicts_by_targetname.try_emplace(targetname, &target);
+        }
+    }
+
     for (auto &entity : all_lights) {
         const std::string &targetstr = entity->epairs->get("target");
         if (targetstr.empty()) {
             continue;
         }
 
-        for (const entdict_t &target : entdicts) {
-            if (string_iequals(targetstr, target.get("targetname"))) {
-                entity->targetent = &target;
-                break;
-            }
+        if (auto it = entdicts_by_targetname.find(targetstr); it != entdicts_by_targetname.end()) {
+            entity->targetent = it->second;
         }
     }
 }
@@ -501,24 +534,49 @@ static void SetupSuns(const settings::worldspawn_keys &cfg)
  * =============
  * SetupSkyDome
  *
- * Setup a dome of suns for the "_sunlight2" worldspawn key.
- *
- * From q3map2
+ * Setup a dome of sky light for the "_sunlight2" worldspawn key.
  *
- * FIXME: this is becoming a mess
+ * The directions are the ones q3map2 uses for its dome of suns.
  * =============
  */
+static void AddSkyDome(const settings::worldspawn_keys &cfg, std::vector<qvec3d> directions, vec_t light,
+    const qvec3d &color, const int dirtInt, const vec_t anglescale, const int style, const std::string &suntexture)
+{
+    if (light == 0.0f)
+        return;
+
+    skydome_t &dome = all_skydomes.emplace_back();
+    dome.directions = std::move(directions);
+    dome.sunlight = light;
+    dome.sunlight_color = color;
+    dome.anglescale = anglescale;
+    dome.dirt = Dirt_ResolveFlag(cfg, dirtInt);
+    dome.style = style;
+    dome.suntexture = suntexture;
+    dome.suntexture_value = img::find(suntexture);
+
+    // stratified subset; the directions are ordered by elevation and then angle
+    const size_t num_probes = light_options.skydomeprobes.value();
+
+    if (num_probes && num_probes < dome.directions.size()) {
+        for (size_t i = 0; i < num_probes; i++) {
+            dome.probes.push_back((i * dome.directions.size()) / num_probes);
+        }
+    }
+}
+
 static void SetupSkyDome(const settings::worldspawn_keys &cfg, vec_t upperLight, const qvec3d &upperColor,
     const int upperDirt, const vec_t upperAnglescale, const int upperStyle, const std::string &upperSuntexture,
     vec_t lowerLight, const qvec3d &lowerColor, const int lowerDirt, const vec_t lowerAnglescale, const int lowerStyle,
     const std::string &lowerSuntexture)
 {
-    int i, j, numSuns;
+    int i, j;
     int angleSteps, elevationSteps;
     int iterations;
     vec_t angle, elevation;
     vec_t angleStep, elevationStep;
     qvec3d direction;
+    std::vector<qvec3d> upperDirections, lowerDirections;
 
     /* pick a value for 'iterations' so that 'numSuns' will be close to 'sunsamples' */
     iterations = rint(sqrt((light_options.sunsamples.value() - 1) / 4)) + 1;
@@ -536,12 +594,6 @@ static void SetupSkyDome(const settings::worldspawn_keys &cfg, vec_t upperLight,
     elevationStep = DEG2RAD(90.0f / (elevationSteps + 1)); /* skip elevation 0 */
     angleStep = DEG2RAD(360.0f / angleSteps);
 
-    /* calc individual sun brightness */
-    numSuns = angleSteps * elevationSteps + 1;
-
-    const vec_t sunlight2value = upperLight / numSuns;
-    const vec_t sunlight3value = lowerLight / numSuns;
-
     /* iterate elevation */
     elevation = elevationStep * 0.5f;
     angle = 0.0f;
@@ -553,19 +605,13 @@ static void SetupSkyDome(const settings::worldspawn_keys &cfg, vec_t upperLight,
             direction[1] = sin(angle) * cos(elevation);
             direction[2] = -sin(elevation);
 
-            /* insert top hemisphere light */
-            if (sunlight2value > 0) {
-                AddSun(cfg, direction, sunlight2value, upperColor, upperDirt, upperAnglescale, upperStyle,
-                    upperSuntexture);
-            }
+            /* top hemisphere; these point towards the sky, the opposite of a sun_t's sunvec */
+            upperDirections.push_back(-direction);
 
             direction[2] = -direction[2];
 
-            /* insert bottom hemisphere light */
-            if (sunlight3value > 0) {
-                AddSun(cfg, direction, sunlight3value, lowerColor, lowerDirt, lowerAnglescale, lowerStyle,
-                    lowerSuntexture);
-            }
+            /* bottom hemisphere */
+            lowerDirections.push_back(-direction);
 
             /* move */
             angle += angleStep;
@@ -576,15 +622,18 @@ static void SetupSkyDome(const settings::worldspawn_keys &cfg, vec_t upperLight,
         angle += angleStep / elevationSteps;
     }
 
-    /* create vertical sun */
-    if (sunlight2value > 0) {
-        AddSun(
-            cfg, {0.0, 0.0, -1.0}, sunlight2value, upperColor, upperDirt, upperAnglescale, upperStyle, upperSuntexture);
+    /* vertical direction */
+    upperDirections.push_back({0.0, 0.0, 1.0});
+    lowerDirections.push_back({0.0, 0.0, -1.0});
+
+    if (upperLight > 0) {
+        AddSkyDome(cfg, std::move(upperDirections), upperLight, upperColor, upperDirt, upperAnglescale, upperStyle,
+            upperSuntexture);
     }
 
-    if (sunlight3value > 0) {
-        AddSun(
-            cfg, {0.0, 0.0, 1.0}, sunlight3value, lowerColor, lowerDirt, lowerAnglescale, lowerStyle, lowerSuntexture);
+    if (lowerLight > 0) {
+        AddSkyDome(cfg, std::move(lowerDirections), lowerLight, lowerColor, lowerDirt, lowerAnglescale, lowerStyle,
+            lowerSuntexture);
     }
 }
 
@@ -889,6 +938,8 @@ void LoadEntities(const settings::worldspawn_keys &cfg, const mbsp_t *bsp)
     logging::funcheader();
 
     entdicts = EntData_Parse(*bsp);
+    entdicts_by_targetname.clear();
+    entdicts_by_keypair.clear();
 
     // Make warnings
     for (auto &entdict : entdicts) {
@@ -1111,51 +1162,77 @@ inline qvec3d UniformPointOnSphere(vec_t u1, vec_t u2)
     return dir;
 }
 
-aabb3d EstimateVisibleBoundsAtPoint(const qvec3d &point)
+// the rays cast from each point by EstimateVisibleBoundsAtPoints
+static const std::vector<qvec3d> &VisibleBoundsDirections()
 {
     constexpr size_t N = 32;
-    constexpr size_t N2 = N * N;
 
-    raystream_intersection_t rs{N2};
+    static const std::vector<qvec3d> dirs = [] {
+        std::vector<qvec3d> result;
+        result.reserve(N * N);
 
-    aabb3d bounds = point;
+        for (size_t x = 0; x < N; x++) {
+            for (size_t y = 0; y < N; y++) {
+                const vec_t u1 = static_cast<vec_t>(x) / static_cast<vec_t>(N - 1);
+                const vec_t u2 = static_cast<vec_t>(y) / static_cast<vec_t>(N - 1);
 
-    for (size_t x = 0; x < N; x++) {
-        for (size_t y = 0; y < N; y++) {
-            const vec_t u1 = static_cast<vec_t>(x) / static_cast<vec_t>(N - 1);
-            const vec_t u2 = static_cast<vec_t>(y) / static_cast<vec_t>(N - 1);
-
-            rs.pushRay(0, point, UniformPointOnSphere(u1, u2), 65536.0);
+                result.push_back(UniformPointOnSphere(u1, u2));
+            }
         }
+
+        return result;
+    }();
+
+    return dirs;
+}
+
+aabb3d EstimateVisibleBoundsAtPoints(const std::vector<qvec3d> &points)
+{
+    // how many points' rays are traced together
+    constexpr size_t BATCH_POINTS = 16;
+
+    const std::vector<qvec3d> &dirs = VisibleBoundsDirections();
+
+    thread_local raystream_intersection_t rs;
+    if (rs.maxPushedRays() < dirs.size() * BATCH_POINTS) {
+        rs.resize(dirs.size() * BATCH_POINTS);
     }
 
-    rs.tracePushedRaysIntersection(nullptr, CHANNEL_MASK_DEFAULT);
+    aabb3d result;
+
+    for (size_t first = 0; first < points.size(); first += BATCH_POINTS) {
+        const size_t last = std::min(points.size(), first + BATCH_POINTS);
+
+        rs.clearPushedRays();
 
-    for (int i = 0; i < N2; i++) {
-        const vec_t &dist = rs.getPushedRayHitDist(i);
-        const qvec3d &dir = rs.getPushedRayDir(i);
+        for (size_t i = first; i < last; i++) {
+            for (auto &dir : dirs) {
+                rs.pushRay(0, points[i], dir, 65536.0);
+            }
+        }
 
-        // get the intersection point
-        qvec3d stop = point + (dir * dist);
+        rs.tracePushedRaysIntersection(nullptr, CHANNEL_MASK_DEFAULT);
 
-        bounds += stop;
+        for (size_t i = first; i < last; i++) {
+            const qvec3d &point = points[i];
+            aabb3d bounds = point;
+
+            for (size_t j = (i - first) * dirs.size(); j < (i - first + 1) * dirs.size(); j++) {
+                // get the intersection point
+                bounds += point + (rs.getPushedRayDir(j) * rs.getPushedRayHitDist(j));
+            }
+
+            // grow it by 25% in each direction
+            result += bounds.grow(bounds.size() * 0.25);
+        }
     }
 
-    // grow it by 25% in each direction
-    return bounds.grow(bounds.size() * 0.25);
-
-    /*
-    logging::print("light at {} {} {} has mins {} {} {} maxs {} {} {}\n",
-           point[0],
-           point[1],
-           point[2],
-           mins[0],
-           mins[1],
-           mins[2],
-           maxs[0],
-           maxs[1],
-           maxs[2]);
-    */
+    return result;
+}
+
+aabb3d EstimateVisibleBoundsAtPoint(const qvec3d &point)
+{
+    return EstimateVisibleBoundsAtPoints({point});
 }
 
 inline void EstimateLightAABB(const std::unique_ptr<light_t> &light)
@@ -1196,18 +1273,27 @@ void SetupLights(const settings::worldspawn_keys &cfg, const mbsp_t *bsp)
         SetupLightLeafnums(bsp);
     }
 
-    logging::print("Final count: {} lights, {} suns in use.\n", all_lights.size(), all_suns.size());
+    logging::print("Final count: {} lights, {} suns, {} sky domes in use.\n", all_lights.size(), all_suns.size(),
+        all_skydomes.size());
 
     Q_assert(final_lightcount == all_lights.size());
 }
 
 const entdict_t *FindEntDictWithKeyPair(const std::string &key, const std::string &value)
 {
-    for (const auto &entdict : entdicts) {
-        if (entdict.get(key) == value) {
-            return &entdict;
+    // this gets called once per bmodel, so index every entity by `key` the first time it's asked for
+    auto [index_it, inserted] = entdicts_by_keypair.try_emplace(key);
+    auto &index = index_it->second;
+
+    if (inserted) {
+        for (const auto &entdict : entdicts) {
+            index.try_emplace(entdict.get(key), &entdict);
         }
     }
+
+    if (auto it = index.find(value); it != index.end()) {
+        return it->second;
+    }
     return nullptr;
 }
 
@@ -30,6 +30,7 @@
 #include <light/entities.hh>
 #include <light/ltface.hh>
 #include <light/litfile.hh> // for facesup_t
+#include <light/samplecache.hh>
 #include <light/trace_embree.hh>
 
 #include <common/log.hh>
@@ -183,6 +184,8 @@ worldspawn_keys::worldspawn_keys()
       dirtscale{this, "dirtscale", 1.0, 0.0, 100.0, &worldspawn_group},
       dirtgain{this, "dirtgain", 1.0, 0.0, 100.0, &worldspawn_group},
       dirtangle{this, "dirtangle", 88.0, 1.0, 90.0, &worldspawn_group},
+      dirtthreshold{this, "dirtthreshold", 0.0, 0.0, 1.0, &worldspawn_group,
+          "stop tracing dirt rays once the standard error of the occlusion is below this; 0 traces every ray"},
       minlight_dirt{this, "minlight_dirt", false, &worldspawn_group},
       phongallowed{this, "phong", true, &worldspawn_group},
       phongangle{this, "phong_angle", 0, &worldspawn_group},
@@ -191,6 +194,8 @@ worldspawn_keys::worldspawn_keys()
       bouncescale{this, "bouncescale", 1.0, 0.0, 100.0, &worldspawn_group},
       bouncecolorscale{this, "bouncecolorscale", 0.0, 0.0, 1.0, &worldspawn_group},
       bouncelightsubdivision{this, "bouncelightsubdivision", 64.0, 1.0, 8192.0, &worldspawn_group},
+      bounceiterations{this, "bounceiterations", 1, 1, 64, &worldspawn_group},
+      bounceconvergence{this, "bounceconvergence", 0.01, 0.0, 1.0, &worldspawn_group},
       surflightscale{this, "surflightscale", 1.0, &worldspawn_group},
       surflightskyscale{this, "surflightskyscale", 1.0, &worldspawn_group},
       surflightsubdivision{this, {"surflightsubdivision", "choplight"}, 16.0, 1.0, 8192.0, &worldspawn_group},
@@ -289,6 +294,11 @@ light_settings::light_settings()
       novanilla{this, "novanilla", false, &experimental_group, "implies -bspxlit; don't write vanilla lighting"},
       gate{this, "gate", LIGHT_EQUAL_EPSILON, &performance_group, "cutoff lights at this brightness level"},
       sunsamples{this, "sunsamples", 64, 8, 2048, &performance_group, "set samples for _sunlight2, default 64"},
+      skydomeprobes{this, "skydomeprobes", 0, 0, 2048, &performance_group,
+          "approximation: number of _sunlight2/3 directions traced first to guess which points see all or none "
+          "of the sky dome; 0 (default) traces every direction"},
+      visibilitycache{this, "visibilitycache", true, &performance_group,
+          "reuse shadow rays between lights that share an origin or sun direction"},
       arghradcompat{this, "arghradcompat", false, &output_group, "enable compatibility for Arghrad-specific keys"},
       nolighting{this, "nolighting", false, &output_group, "don't output main world lighting (Q2RTX)"},
       debugface{this, "debugface", std::numeric_limits<vec_t>::quiet_NaN(), std::numeric_limits<vec_t>::quiet_NaN(),
@@ -313,6 +323,26 @@ light_settings::light_settings()
               {"rays", visapprox_t::RAYS}},
           &debug_group,
           "change approximate visibility algorithm. auto = choose default based on format. vis = use BSP vis data (slow but precise). rays = use sphere culling with fired rays (fast but may miss faces)"},
+      raypackets{this, "raypackets", raypackets_t::NONE,
+          {{"none", raypackets_t::NONE}, {"8", raypackets_t::PACKET8}, {"16", raypackets_t::PACKET16}},
+          &performance_group,
+          "trace ray streams as coherent 8 or 16-wide packets, sorted by direction and origin, instead of as single rays"},
+      bvhquality{this, "bvhquality", bvhquality_t::HIGH,
+          {{"low", bvhquality_t::LOW}, {"medium", bvhquality_t::MEDIUM}, {"high", bvhquality_t::HIGH},
+              {"refit", bvhquality_t::REFIT}},
+          &performance_group,
+          "Embree BVH build quality; lower qualities build faster but trace slower. refit is the fastest build, "
+          "meant for geometry that is rebuilt often"},
+      bvhcompact{this, "bvhcompact", false, &performance_group,
+          "use a more compact BVH layout, for memory-constrained runs; traces slightly slower"},
+      bvhrobust{this, "bvhrobust", false, &performance_group,
+          "use robust (watertight) ray/triangle tests; traces slightly slower"},
+      bvhinstancing{this, "bvhinstancing", false, &performance_group,
+          "put the solid faces of each shadow casting bmodel in its own Embree scene, placed with an instance and "
+          "shared between bmodels with identical geometry"},
+      samplecache{this, "samplecache", false, &performance_group,
+          "save the sample points of each face to a .lightpoints file and reuse them on the next run if the "
+          "geometry and lightmap resolution settings haven't changed"},
       lit{this, "lit", [&](source) { write_litfile |= lightfile::external; }, &output_group, "write .lit file"},
       lit2{this, "lit2", [&](source) { write_litfile = lightfile::lit2; }, &experimental_group, "write .lit2 file"},
       bspxlit{this, "bspxlit", [&](source) { write_litfile |= lightfile::bspx; }, &experimental_group,
@@ -346,6 +376,8 @@ light_settings::light_settings()
           "distance between lightgrid sample points, in world units. controls lightgrid size."},
       lightgrid_format{this, "lightgrid_format", lightgrid_format_t::OCTREE, {{"octree", lightgrid_format_t::OCTREE}},
           &experimental_group, "lightgrid BSPX lump to use"},
+      lightgrid_adaptive{this, "lightgrid_adaptive", 0.0, 0.0, 255.0, &experimental_group,
+          "if nonzero, only refine the lightgrid where samples differ by more than this (0..255); interpolate elsewhere"},
 
       dirtdebug{this, {"dirtdebug", "debugdirt"},
           [&](source) {
@@ -678,6 +710,18 @@ static void CreateLightmapSurfaces(mbsp_t *bsp)
 {
     light_surfaces.resize(bsp->dfaces.size());
     logging::funcheader();
+
+    // sample points from the last run, see samplecache.hh
+    fs::path samplecache_path;
+    uint64_t samplecache_key = 0;
+    bool samplecache_loaded = false;
+
+    if (light_options.samplecache.value()) {
+        samplecache_path = fs::path(light_options.sourceMap).replace_extension("lightpoints");
+        samplecache_key = SampleCache_Key(bsp, faces_sup);
+        samplecache_loaded = SampleCache_Load(samplecache_path, samplecache_key, bsp);
+    }
+
     logging::parallel_for(static_cast<size_t>(0), bsp->dfaces.size(), [&bsp](size_t i) {
         auto facesup = faces_sup.empty() ? nullptr : &faces_sup[i];
         auto facesup_decoupled = facesup_decoupled_global.empty() ? nullptr : &facesup_decoupled_global[i];
@@ -707,6 +751,23 @@ static void CreateLightmapSurfaces(mbsp_t *bsp)
 
         light_surfaces[i] = CreateLightmapSurface(bsp, face, facesup, facesup_decoupled, light_options);
     });
+
+    size_t num_samples = 0;
+    for (auto &surf : light_surfaces) {
+        if (surf) {
+            num_samples += surf->samples.size();
+        }
+    }
+    logging::print("\t{} sample points ({:.1f} MiB, plus {:.1f} MiB per lightmap style)\n", num_samples,
+        (num_samples * sizeof(lightsurf_t::sample_data_t)) / (1024.0 * 1024.0),
+        (num_samples * sizeof(lightsample_t)) / (1024.0 * 1024.0));
+
+    if (light_options.samplecache.value()) {
+        if (!samplecache_loaded) {
+            SampleCache_Save(samplecache_path, samplecache_key, light_surfaces);
+        }
+        SampleCache_Clear();
+    }
 }
 
 static void SaveLightmapSurfaces(mbsp_t *bsp)
@@ -922,6 +983,8 @@ static void LightWorld(bspdata_t *bspdata, bool forcedscale)
 
     MakeRadiositySurfaceLights(light_options, &bsp);
 
+    SetupLightVisibilityCache();
+
     logging::header("Direct Lighting"); // mxd
     logging::parallel_for(static_cast<size_t>(0), bsp.dfaces.size(), [&bsp](size_t i) {
         if (light_surfaces[i] && Face_IsLightmapped(&bsp, &bsp.dfaces[i])) {
@@ -1482,11 +1545,12 @@ void light_reset()
  * light modelfile
  * ==================
  */
-int light_main(int argc, const char **argv)
+static bool LightBSP(int argc, const char **argv, bspdata_t *in_memory_bspdata)
 {
     light_reset();
 
-    bspdata_t bspdata;
+    bspdata_t loaded_bspdata;
+    bspdata_t &bspdata = in_memory_bspdata ? *in_memory_bspdata : loaded_bspdata;
 
     light_options.preinitialize(argc, argv);
     light_options.initialize(argc, argv);
@@ -1509,12 +1573,15 @@ int light_main(int argc, const char **argv)
     ParseLightsFile(source); // map-specific file name
 
     source.replace_extension("bsp");
-    LoadBSPFile(source, &bspdata);
-
-    bspdata.version->game->init_filesystem(source, light_options);
+    if (!in_memory_bspdata) {
+        LoadBSPFile(source, &bspdata);
+    }
 
+    // an in-memory bsp handed over by vis is already in the generic format
     ConvertBSPFormat(&bspdata, &bspver_generic);
 
+    bspdata.loadversion->game->init_filesystem(source, light_options);
+
     mbsp_t &bsp = std::get<mbsp_t>(bspdata.bsp);
 
     // mxd. Use 1.0 rangescale as a default to better match with qrad3/arghrad
@@ -1577,7 +1644,7 @@ int light_main(int argc, const char **argv)
         ExportObj(source, &bsp);
 
         logging::close();
-        return 0;
+        return false;
     }
 
     SetupLights(light_options, &bsp);
@@ -1610,7 +1677,7 @@ int light_main(int argc, const char **argv)
 
         if (light_options.write_litfile == lightfile::lit2) {
             WriteLitFile(&bsp, faces_sup, source, 2);
-            return 0; // run away before any files are written
+            return false; // run away before any files are written
         }
 
         /*fixme: add a new per-surface offset+lmscale lump for compat/versitility?*/
@@ -1640,11 +1707,15 @@ int light_main(int argc, const char **argv)
     }
 
     WriteEntitiesToString(light_options, &bsp);
-    /* Convert data format back if necessary */
-    ConvertBSPFormat(&bspdata, bspdata.loadversion);
 
-    if (!light_options.litonly.value()) {
-        WriteBSPFile(source, &bspdata);
+    // the caller writes (or keeps) an in-memory bsp
+    if (!in_memory_bspdata) {
+        /* Convert data format back if necessary */
+        ConvertBSPFormat(&bspdata, bspdata.loadversion);
+
+        if (!light_options.litonly.value()) {
+            WriteBSPFile(source, &bspdata);
+        }
     }
 
     auto end = I_FloatTime();
@@ -1657,12 +1728,27 @@ int light_main(int argc, const char **argv)
     logging::print("{} surface lights tested, {} hits per sample point\n",
         static_cast<double>(total_surflight_rays) / static_cast<double>(total_samplepoints),
         static_cast<double>(total_surflight_ray_hits) / static_cast<double>(total_samplepoints)); // mxd
+    logging::print("{} light rays reused from the visibility cache per sample point\n",
+        static_cast<double>(total_light_rays_cached) / static_cast<double>(total_samplepoints));
+    logging::print("{} dirt rays per sample point\n",
+        static_cast<double>(total_dirt_rays) / static_cast<double>(total_samplepoints));
+    logging::print("{} sky dome rays skipped per sample point\n",
+        static_cast<double>(total_skydome_rays_skipped) / static_cast<double>(total_samplepoints));
     logging::print("{} bounce lights tested, {} hits per sample point\n",
         static_cast<double>(total_bounce_rays) / static_cast<double>(total_samplepoints),
         static_cast<double>(total_bounce_ray_hits) / static_cast<double>(total_samplepoints));
+    logging::print("{} faces reused sample points from the .lightpoints cache\n",
+        static_cast<int>(total_samplecache_faces));
     logging::print("{} empty lightmaps\n", static_cast<int>(fully_transparent_lightmaps));
     logging::close();
 
+    return !light_options.litonly.value();
+}
+
+int light_main(int argc, const char **argv)
+{
+    LightBSP(argc, argv, nullptr);
+
     return 0;
 }
 
@@ -1675,3 +1761,13 @@ int light_main(const std::vector<std::string> &args)
 
     return light_main(argPtrs.size(), argPtrs.data());
 }
+
+bool light_main(const std::vector<std::string> &args, bspdata_t &bspdata)
+{
+    std::vector<const char *> argPtrs;
+    for (const std::string &arg : args) {
+        argPtrs.push_back(arg.data());
+    }
+
+    return LightBSP(argPtrs.size(), argPtrs.data(), &bspdata);
+}
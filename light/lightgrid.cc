@@ -24,6 +24,7 @@
 #include <fstream>
 #include <vector>
 #include <algorithm>
+#include <atomic>
 #include <string>
 #include <utility>
 
@@ -386,6 +387,8 @@ static qvec3i MakePOT(const qvec3i &input)
     return qvec3i(static_cast<int>(x));
 }
 
+size_t lightgrid_evaluated_points = 0;
+
 std::tuple<lightgrid_samples_t, bool> FixPointAndCalcLightgrid(const mbsp_t *bsp, qvec3d world_point)
 {
     bool occluded = Light_PointInWorld(bsp, world_point);
@@ -406,6 +409,231 @@ std::tuple<lightgrid_samples_t, bool> FixPointAndCalcLightgrid(const mbsp_t *bsp
     return {samples, occluded};
 }
 
+static void CalcLightgridPoint(const mbsp_t &bsp, lightgrid_raw_data &data, int sample_index)
+{
+    const int z = (sample_index / (data.grid_size[0] * data.grid_size[1]));
+    const int y = (sample_index / data.grid_size[0]) % data.grid_size[1];
+    const int x = sample_index % data.grid_size[0];
+
+    qvec3d world_point = data.grid_mins + (qvec3d{x, y, z} * data.grid_dist);
+
+    bool occluded;
+    lightgrid_samples_t samples;
+
+    std::tie(samples, occluded) = FixPointAndCalcLightgrid(&bsp, world_point);
+
+    data.grid_result[sample_index] = samples;
+    data.occlusion[sample_index] = occluded;
+}
+
+/**
+ * Fills in `data` coarse-to-fine instead of evaluating every grid point.
+ *
+ * The corners of ADAPTIVE_CELL_SIZE^3 cells are evaluated first. A cell is split in
+ * half along each axis if it touches solid anywhere, or its corners disagree on
+ * occlusion, styles or by more than `threshold` (0..255 color scale) on any channel.
+ * Cells whose corners agree get their remaining points by trilinear interpolation,
+ * so lighting detail that falls between the corners (shadows of a grate) is lost.
+ *
+ * Returns the number of points that were actually evaluated.
+ */
+static size_t CalcLightgridAdaptive(const mbsp_t &bsp, lightgrid_raw_data &data, float threshold)
+{
+    constexpr int ADAPTIVE_CELL_SIZE = 8;
+
+    // mins/maxs are both inclusive grid indices; a cell of size 1 is just its corners
+    struct cell_t
+    {
+        qvec3i mins, maxs;
+
+        qvec3i corner(int i) const
+        {
+            return {(i & 4) ? maxs[0] : mins[0], (i & 2) ? maxs[1] : mins[1], (i & 1) ? maxs[2] : mins[2]};
+        }
+    };
+
+    std::vector<uint8_t> evaluated(data.occlusion.size());
+    size_t num_evaluated = 0;
+
+    // the coarse cells
+    std::vector<cell_t> cells;
+    {
+        std::array<std::vector<std::pair<int, int>>, 3> ranges;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            const int last = data.grid_size[axis] - 1;
+
+            for (int i = 0; i < last; i += ADAPTIVE_CELL_SIZE) {
+                ranges[axis].emplace_back(i, min(i + ADAPTIVE_CELL_SIZE, last));
+            }
+            if (ranges[axis].empty()) {
+                ranges[axis].emplace_back(0, 0);
+            }
+        }
+
+        for (auto &z : ranges[2]) {
+            for (auto &y : ranges[1]) {
+                for (auto &x : ranges[0]) {
+                    cells.push_back({{x.first, y.first, z.first}, {x.second, y.second, z.second}});
+                }
+            }
+        }
+    }
+
+    auto cell_is_uniform = [&](const cell_t &cell) -> bool {
+        const lightgrid_samples_t &first = data.grid_result[data.get_grid_index(
+            cell.mins[0], cell.mins[1], cell.mins[2])];
+
+        for (int i = 0; i < 8; ++i) {
+            const qvec3i c = cell.corner(i);
+            const int sample_index = data.get_grid_index(c[0], c[1], c[2]);
+
+            if (data.occlusion[sample_index]) {
+                return false;
+            }
+
+            const lightgrid_samples_t &samples = data.grid_result[sample_index];
+
+            if (samples.used_styles() != first.used_styles()) {
+                return false;
+            }
+
+            for (int j = 0; j < first.used_styles(); ++j) {
+                if (samples.samples_by_style[j].style != first.samples_by_style[j].style) {
+                    return false;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    if (std::abs(samples.samples_by_style[j].color[k] - first.samples_by_style[j].color[k]) >
+                        threshold) {
+                        return false;
+                    }
+                }
+            }
+        }
+
+        // interpolating across a wall would leak light, even a thin one that falls between
+        // grid points, so the cell must not touch any solid at all
+        const aabb3d bounds(data.grid_index_to_world(cell.mins), data.grid_index_to_world(cell.maxs));
+
+        return !Light_BoxInWorld(&bsp, bounds);
+    };
+
+    std::vector<cell_t> uniform_cells;
+
+    while (!cells.empty()) {
+        // evaluate the corners of this level's cells; neighbouring cells share corners
+        std::vector<int> pending;
+
+        for (auto &cell : cells) {
+            for (int i = 0; i < 8; ++i) {
+                const qvec3i c = cell.corner(i);
+                const int sample_index = data.get_grid_index(c[0], c[1], c[2]);
+
+                if (!evaluated[sample_index]) {
+                    evaluated[sample_index] = 1;
+                    pending.push_back(sample_index);
+                }
+            }
+        }
+
+        logging::parallel_for(static_cast<size_t>(0), pending.size(),
+            [&](size_t i) { CalcLightgridPoint(bsp, data, pending[i]); });
+        num_evaluated += pending.size();
+
+        std::vector<uint8_t> uniform(cells.size());
+
+        logging::parallel_for(static_cast<size_t>(0), cells.size(), [&](size_t i) {
+            const qvec3i size = cells[i].maxs - cells[i].mins;
+
+            // cells with no interior points are done
+            uniform[i] = (size[0] <= 1 && size[1] <= 1 && size[2] <= 1) || cell_is_uniform(cells[i]);
+        });
+
+        std::vector<cell_t> next_cells;
+
+        for (size_t i = 0; i < cells.size(); ++i) {
+            const cell_t &cell = cells[i];
+
+            if (uniform[i]) {
+                uniform_cells.push_back(cell);
+                continue;
+            }
+
+            // split in half along each axis that still has interior points
+            std::array<std::vector<std::pair<int, int>>, 3> ranges;
+
+            for (int axis = 0; axis < 3; ++axis) {
+                if (cell.maxs[axis] - cell.mins[axis] > 1) {
+                    const int mid = (cell.mins[axis] + cell.maxs[axis]) / 2;
+                    ranges[axis] = {{cell.mins[axis], mid}, {mid, cell.maxs[axis]}};
+                } else {
+                    ranges[axis] = {{cell.mins[axis], cell.maxs[axis]}};
+                }
+            }
+
+            for (auto &z : ranges[2]) {
+                for (auto &y : ranges[1]) {
+                    for (auto &x : ranges[0]) {
+                        next_cells.push_back({{x.first, y.first, z.first}, {x.second, y.second, z.second}});
+                    }
+                }
+            }
+        }
+
+        cells = std::move(next_cells);
+    }
+
+    // fill in the points that weren't evaluated. points on a face shared by two
+    // uniform cells are claimed by whichever cell gets to them first.
+    logging::parallel_for(static_cast<size_t>(0), uniform_cells.size(), [&](size_t cell_index) {
+        const cell_t &cell = uniform_cells[cell_index];
+        const qvec3i size = cell.maxs - cell.mins;
+
+        std::array<const lightgrid_samples_t *, 8> corners;
+        for (int i = 0; i < 8; ++i) {
+            const qvec3i c = cell.corner(i);
+            corners[i] = &data.grid_result[data.get_grid_index(c[0], c[1], c[2])];
+        }
+
+        for (int z = cell.mins[2]; z <= cell.maxs[2]; ++z) {
+            for (int y = cell.mins[1]; y <= cell.maxs[1]; ++y) {
+                for (int x = cell.mins[0]; x <= cell.maxs[0]; ++x) {
+                    const int sample_index = data.get_grid_index(x, y, z);
+
+                    if (std::atomic_ref<uint8_t>(evaluated[sample_index]).exchange(1)) {
+                        continue;
+                    }
+
+                    const qvec3i p{x, y, z};
+                    qvec3d t;
+                    for (int axis = 0; axis < 3; ++axis) {
+                        t[axis] = size[axis] ? static_cast<double>(p[axis] - cell.mins[axis]) / size[axis] : 0.0;
+                    }
+
+                    lightgrid_samples_t samples = *corners[0];
+
+                    for (int j = 0; j < samples.used_styles(); ++j) {
+                        qvec3d color{};
+
+                        for (int i = 0; i < 8; ++i) {
+                            const double weight = ((i & 4) ? t[0] : 1.0 - t[0]) * ((i & 2) ? t[1] : 1.0 - t[1]) *
+                                                  ((i & 1) ? t[2] : 1.0 - t[2]);
+                            color += corners[i]->samples_by_style[j].color * weight;
+                        }
+
+                        samples.samples_by_style[j].color = color;
+                    }
+
+                    data.grid_result[sample_index] = samples;
+                    data.occlusion[sample_index] = false;
+                }
+            }
+        }
+    });
+
+    return num_evaluated;
+}
+
 void LightGrid(bspdata_t *bspdata)
 {
     if (!light_options.lightgrid.value())
@@ -432,21 +660,19 @@ void LightGrid(bspdata_t *bspdata)
 
     data.occlusion.resize(data.grid_size[0] * data.grid_size[1] * data.grid_size[2]);
 
-    logging::parallel_for(0, data.grid_size[0] * data.grid_size[1] * data.grid_size[2], [&](int sample_index) {
-        const int z = (sample_index / (data.grid_size[0] * data.grid_size[1]));
-        const int y = (sample_index / data.grid_size[0]) % data.grid_size[1];
-        const int x = sample_index % data.grid_size[0];
+    const size_t total_points = data.occlusion.size();
 
-        qvec3d world_point = data.grid_mins + (qvec3d{x, y, z} * data.grid_dist);
+    if (light_options.lightgrid_adaptive.value() > 0 && total_points) {
+        lightgrid_evaluated_points = CalcLightgridAdaptive(bsp, data, light_options.lightgrid_adaptive.value());
 
-        bool occluded;
-        lightgrid_samples_t samples;
+        logging::print("     {} of {} grid points evaluated ({:.1f} percent saved)\n", lightgrid_evaluated_points,
+            total_points, 100.0 * (total_points - lightgrid_evaluated_points) / total_points);
+    } else {
+        logging::parallel_for(static_cast<size_t>(0), total_points,
+            [&](size_t sample_index) { CalcLightgridPoint(bsp, data, static_cast<int>(sample_index)); });
 
-        std::tie(samples, occluded) = FixPointAndCalcLightgrid(&bsp, world_point);
-
-        data.grid_result[sample_index] = samples;
-        data.occlusion[sample_index] = occluded;
-    });
+        lightgrid_evaluated_points = total_points;
+    }
 
     // the maximum used styles across the map.
     data.num_styles = [&]() {
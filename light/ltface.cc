@@ -27,6 +27,7 @@
 #include <light/lightgrid.hh>
 #include <light/trace.hh>
 #include <light/litfile.hh> // for facesup_t
+#include <light/samplecache.hh>
 
 #include <common/imglib.hh>
 #include <common/log.hh>
@@ -39,10 +40,15 @@
 #include <cmath>
 #include <algorithm>
 #include <fstream>
+#include <set>
 
 using namespace std;
 
 std::atomic<uint32_t> total_light_rays, total_light_ray_hits, total_samplepoints;
+std::atomic<uint32_t> total_skydome_rays_skipped;
+std::atomic<uint32_t> total_light_rays_cached;
+std::atomic<uint32_t> total_dirt_rays;
+std::atomic<uint32_t> total_samplecache_faces;
 std::atomic<uint32_t> total_bounce_rays, total_bounce_ray_hits;
 std::atomic<uint32_t> total_surflight_rays, total_surflight_ray_hits; // mxd
 std::atomic<uint32_t> fully_transparent_lightmaps;
@@ -429,6 +435,27 @@ static void CalcPoints(
     size_t num_points = surf->width * surf->height;
     surf->samples.resize(num_points);
 
+    /* Reuse the points from the last run if they're in the .lightpoints cache */
+    if (const auto *cached = SampleCache_ForFace(Face_GetNum(bsp, face));
+        cached && cached->width == surf->width && cached->height == surf->height) {
+        for (size_t i = 0; i < num_points; i++) {
+            auto &sample = surf->samples[i];
+            const auto &cached_sample = cached->samples[i];
+
+            sample.point = cached_sample.point;
+            sample.normal = cached_sample.normal;
+            sample.occluded = cached_sample.occluded;
+            sample.realfacenum = cached_sample.realfacenum;
+        }
+
+        total_samplecache_faces++;
+
+        if (dump_facenum == Face_GetNum(bsp, face)) {
+            CalcPoints_Debug(surf, bsp);
+        }
+        return;
+    }
+
     const auto points = Face_Points(bsp, face);
     const auto edgeplanes = MakeInwardFacingEdgePlanes(points);
 
@@ -1184,6 +1211,97 @@ static bool VisCullEntity(const mbsp_t *bsp, const std::vector<uint8_t> &pvs, co
     return !Pvs_LeafVisible(bsp, pvs, entleaf);
 }
 
+// visibility cache keys used by more than one light, and the subset of those used by a negative light
+static std::set<light_visibility_key_t> shared_visibility_keys;
+static std::set<light_visibility_key_t> negative_visibility_keys;
+
+static light_visibility_key_t LightVisibilityKey(const light_t *entity)
+{
+    return {false, entity->origin.value(), entity->shadow_channel_mask.value(), nullptr};
+}
+
+static light_visibility_key_t LightVisibilityKey(const sun_t *sun)
+{
+    return {true, qv::normalize(sun->sunvec), CHANNEL_MASK_DEFAULT, sun->suntexture_value};
+}
+
+/*
+ * =============
+ * SetupLightVisibilityCache
+ *
+ * Finds the light origins / sun directions that more than one light
+ * uses; only those get a visibility cache on each face
+ * =============
+ */
+void SetupLightVisibilityCache()
+{
+    shared_visibility_keys.clear();
+    negative_visibility_keys.clear();
+
+    if (!light_options.visibilitycache.value()) {
+        return;
+    }
+
+    // (positive users, negative users)
+    std::map<light_visibility_key_t, std::pair<int, int>> users;
+
+    for (const auto &entity : GetLights()) {
+        if (entity->getFormula() == LF_LOCALMIN)
+            continue;
+        if (entity->nostaticlight.value())
+            continue;
+
+        auto &count = users[LightVisibilityKey(entity.get())];
+
+        if (entity->light.value() > 0)
+            count.first++;
+        else if (entity->light.value() < 0)
+            count.second++;
+    }
+    for (const sun_t &sun : GetSuns()) {
+        auto &count = users[LightVisibilityKey(&sun)];
+
+        if (sun.sunlight > 0)
+            count.first++;
+        else if (sun.sunlight < 0)
+            count.second++;
+    }
+
+    for (auto &[key, count] : users) {
+        if (count.first + count.second < 2)
+            continue;
+
+        shared_visibility_keys.insert(key);
+
+        if (count.second)
+            negative_visibility_keys.insert(key);
+    }
+}
+
+/*
+ * =============
+ * LightVisibility
+ *
+ * Returns the cached shadow ray results for the given key, or nullptr if
+ * no other light uses it
+ * =============
+ */
+static light_visibility_t *LightVisibility(lightsurf_t *lightsurf, const light_visibility_key_t &key)
+{
+    if (!shared_visibility_keys.count(key)) {
+        return nullptr;
+    }
+
+    light_visibility_t &vis = lightsurf->visibility_cache[key];
+
+    if (vis.visible.empty()) {
+        vis.visible.resize(lightsurf->samples.size());
+        vis.blocked.resize(lightsurf->samples.size());
+    }
+
+    return &vis;
+}
+
 /*
  * ================
  * LightFace_Entity
@@ -1233,6 +1351,12 @@ static void LightFace_Entity(
     raystream_occlusion_t &rs = *lightsurf->occlusion_stream;
     rs.clearPushedRays();
 
+    light_visibility_t *vis = LightVisibility(lightsurf, LightVisibilityKey(entity));
+
+    // samples whose visibility is already known
+    thread_local static std::vector<std::tuple<int, qvec3f, qvec3d>> cached_hits;
+    cached_hits.clear();
+
     for (int i = 0; i < lightsurf->samples.size(); i++) {
         const auto &sample = lightsurf->samples[i];
 
@@ -1258,6 +1382,15 @@ static void LightFace_Entity(
             continue;
         }
 
+        if (vis && vis->blocked[i]) {
+            total_light_rays_cached++;
+            continue;
+        } else if (vis && vis->visible[i]) {
+            total_light_rays_cached++;
+            cached_hits.emplace_back(i, color, normalcontrib);
+            continue;
+        }
+
         rs.pushRay(i, surfpoint, surfpointToLightDir, surfpointToLightDist, &color, &normalcontrib);
     }
 
@@ -1268,16 +1401,33 @@ static void LightFace_Entity(
     int cached_style = entity->style.value();
     lightmap_t *cached_lightmap = Lightmap_ForStyle(lightmaps, cached_style, lightsurf);
 
+    // cached hits didn't pass through glass or dynamic shadow casters
+    for (auto &[i, color, normalcontrib] : cached_hits) {
+        total_light_ray_hits++;
+
+        lightsample_t &sample = cached_lightmap->samples[i];
+
+        sample.color += color;
+        sample.direction += normalcontrib;
+
+        Lightmap_Save(bsp, lightmaps, lightsurf, cached_lightmap, cached_style);
+    }
+
     const int N = rs.numPushedRays();
     for (int j = 0; j < N; j++) {
+        int i = rs.getPushedRayPointIndex(j);
+
         if (rs.getPushedRayOccluded(j)) {
+            if (vis)
+                vis->blocked[i] = true;
             continue;
+        } else if (!rs.getPushedRayHitGlass(j) && !rs.getPushedRayDynamicStyle(j)) {
+            if (vis)
+                vis->visible[i] = true;
         }
 
         total_light_ray_hits++;
 
-        int i = rs.getPushedRayPointIndex(j);
-
         // check if we hit a dynamic shadow caster (only applies to style 0 lights)
         //
         // note, this still works even though we're doing an occlusion trace - closest
@@ -1397,6 +1547,12 @@ static void LightFace_Sky(const mbsp_t *bsp, const sun_t *sun, lightsurf_t *ligh
     raystream_intersection_t &rs = *lightsurf->intersection_stream;
     rs.clearPushedRays();
 
+    light_visibility_t *vis = LightVisibility(lightsurf, LightVisibilityKey(sun));
+
+    // samples whose visibility is already known
+    thread_local static std::vector<std::tuple<int, qvec3f, qvec3d>> cached_hits;
+    cached_hits.clear();
+
     for (int i = 0; i < lightsurf->samples.size(); i++) {
         const auto &sample = lightsurf->samples[i];
 
@@ -1431,6 +1587,15 @@ static void LightFace_Sky(const mbsp_t *bsp, const sun_t *sun, lightsurf_t *ligh
 
         qvec3d normalcontrib = incoming * value;
 
+        if (vis && vis->blocked[i]) {
+            total_light_rays_cached++;
+            continue;
+        } else if (vis && vis->visible[i]) {
+            total_light_rays_cached++;
+            cached_hits.emplace_back(i, color, normalcontrib);
+            continue;
+        }
+
         rs.pushRay(i, surfpoint, incoming, MAX_SKY_DIST, &color, &normalcontrib);
     }
 
@@ -1442,11 +1607,27 @@ static void LightFace_Sky(const mbsp_t *bsp, const sun_t *sun, lightsurf_t *ligh
     int cached_style = sun->style;
     lightmap_t *cached_lightmap = Lightmap_ForStyle(lightmaps, cached_style, lightsurf);
 
+    // cached hits didn't pass through glass or dynamic shadow casters
+    for (auto &[i, color, normalcontrib] : cached_hits) {
+        total_light_ray_hits++;
+
+        lightsample_t &sample = cached_lightmap->samples[i];
+
+        sample.color += color;
+        sample.direction += normalcontrib;
+
+        Lightmap_Save(bsp, lightmaps, lightsurf, cached_lightmap, cached_style);
+    }
+
     const int N = rs.numPushedRays();
     total_light_rays += N;
 
     for (int j = 0; j < N; j++) {
+        const int i = rs.getPushedRayPointIndex(j);
+
         if (rs.getPushedRayHitType(j) != hittype_t::SKY) {
+            if (vis)
+                vis->blocked[i] = true;
             continue;
         }
 
@@ -1454,11 +1635,16 @@ static void LightFace_Sky(const mbsp_t *bsp, const sun_t *sun, lightsurf_t *ligh
         if (sun->suntexture_value) {
             const triinfo *face = rs.getPushedRayHitFaceInfo(j);
             if (sun->suntexture_value != face->texture) {
+                if (vis)
+                    vis->blocked[i] = true;
                 continue;
             }
         }
 
-        const int i = rs.getPushedRayPointIndex(j);
+        if (!rs.getPushedRayHitGlass(j) && !rs.getPushedRayDynamicStyle(j)) {
+            if (vis)
+                vis->visible[i] = true;
+        }
 
         // check if we hit a dynamic shadow caster
         int desired_style = sun->style;
@@ -1482,6 +1668,260 @@ static void LightFace_Sky(const mbsp_t *bsp, const sun_t *sun, lightsurf_t *ligh
     }
 }
 
+/*
+ * =============
+ * LightFace_SkyDome
+ *
+ * Integrates a whole _sunlight2/_sunlight3 dome per sample point with one
+ * ray stream. If the dome has probes, those are traced first; points where
+ * every probe reached the sky get the unshadowed dome added without tracing
+ * the rest, points where none did get nothing, and only the remaining
+ * points trace every direction (which gives the same result as one sun
+ * per direction).
+ * =============
+ */
+static void LightFace_SkyDome(
+    const mbsp_t *bsp, const skydome_t *dome, lightsurf_t *lightsurf, lightmapdict_t *lightmaps)
+{
+    const settings::worldspawn_keys &cfg = *lightsurf->cfg;
+    const modelinfo_t *modelinfo = lightsurf->modelinfo;
+    const qplane3d *plane = &lightsurf->plane;
+
+    // check lighting channels (currently sunlight is always on CHANNEL_MASK_DEFAULT)
+    if (!(lightsurf->object_channel_mask & CHANNEL_MASK_DEFAULT)) {
+        return;
+    }
+
+    /* Don't bother with directions the surface faces away from */
+    std::vector<bool> active(dome->directions.size());
+    size_t num_active = 0;
+
+    for (size_t d = 0; d < dome->directions.size(); d++) {
+        const vec_t dp = qv::dot(dome->directions[d], plane->normal);
+        active[d] = !(dp < -LIGHT_ANGLE_EPSILON && !lightsurf->curved && !lightsurf->twosided);
+        num_active += active[d];
+    }
+
+    if (!num_active) {
+        return;
+    }
+
+    const vec_t light_per_direction = dome->sunlight / dome->directions.size();
+
+    auto direction_color = [&](const lightsurf_t::sample_data_t &sample, const qvec3d &incoming, qvec3f &color,
+                               qvec3d &normalcontrib) {
+        vec_t angle = qv::dot(incoming, sample.normal);
+        if (lightsurf->twosided) {
+            if (angle < 0) {
+                angle = -angle;
+            }
+        }
+
+        angle = max(0.0, angle);
+
+        angle = (1.0 - dome->anglescale) + dome->anglescale * angle;
+        vec_t value = angle * light_per_direction;
+
+        if (dome->dirt) {
+            value *= Dirt_GetScaleFactor(cfg, sample.occlusion, NULL, 0.0, lightsurf);
+        }
+
+        color = dome->sunlight_color * (value / 255.0);
+        normalcontrib = incoming * value;
+
+        /* Quick distance check first */
+        return fabs(LightSample_Brightness(color)) > light_options.gate.value();
+    };
+
+    raystream_intersection_t &rs = *lightsurf->intersection_stream;
+
+    int cached_style = dome->style;
+    lightmap_t *cached_lightmap = Lightmap_ForStyle(lightmaps, cached_style, lightsurf);
+
+    auto add_light = [&](int i, int style, const qvec3f &color, const qvec3d &normalcontrib) {
+        // if necessary, switch which lightmap we are writing to.
+        if (style != cached_style) {
+            cached_style = style;
+            cached_lightmap = Lightmap_ForStyle(lightmaps, cached_style, lightsurf);
+        }
+
+        lightsample_t &sample = cached_lightmap->samples[i];
+
+        sample.color += color;
+        sample.direction += normalcontrib;
+
+        Lightmap_Save(bsp, lightmaps, lightsurf, cached_lightmap, cached_style);
+    };
+
+    auto hit_dome = [&](size_t j) {
+        // We need to check if the first hit face is a sky face, so we need
+        // to test intersection (not occlusion)
+        if (rs.getPushedRayHitType(j) != hittype_t::SKY) {
+            return false;
+        }
+
+        // check if we hit the wrong texture
+        if (dome->suntexture_value) {
+            const triinfo *face = rs.getPushedRayHitFaceInfo(j);
+            if (dome->suntexture_value != face->texture) {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    enum class dome_visibility_t : uint8_t
+    {
+        UNKNOWN,
+        ALL,
+        NONE
+    };
+
+    std::vector<dome_visibility_t> visibility(lightsurf->samples.size(), dome_visibility_t::UNKNOWN);
+
+    /* Trace the probes */
+    size_t num_active_probes = 0;
+
+    for (size_t d : dome->probes) {
+        num_active_probes += active[d];
+    }
+
+    if (num_active_probes && num_active_probes < num_active) {
+        // counts of probes that reached the sky unhindered / didn't reach it
+        std::vector<uint16_t> clear(lightsurf->samples.size()), blocked(lightsurf->samples.size());
+
+        auto trace_probes = [&]() {
+            rs.tracePushedRaysIntersection(modelinfo, CHANNEL_MASK_DEFAULT);
+
+            const int N = rs.numPushedRays();
+            total_light_rays += N;
+
+            for (int j = 0; j < N; j++) {
+                const int i = rs.getPushedRayPointIndex(j);
+
+                if (!hit_dome(j)) {
+                    blocked[i]++;
+                } else if (!rs.getPushedRayHitGlass(j) && !rs.getPushedRayDynamicStyle(j)) {
+                    clear[i]++;
+                }
+            }
+
+            rs.clearPushedRays();
+        };
+
+        rs.clearPushedRays();
+
+        for (int i = 0; i < lightsurf->samples.size(); i++) {
+            const auto &sample = lightsurf->samples[i];
+
+            if (sample.occluded)
+                continue;
+
+            for (size_t d : dome->probes) {
+                if (!active[d])
+                    continue;
+
+                rs.pushRay(i, sample.point, dome->directions[d], MAX_SKY_DIST);
+
+                if (rs.numPushedRays() == rs.maxPushedRays()) {
+                    trace_probes();
+                }
+            }
+        }
+
+        trace_probes();
+
+        for (int i = 0; i < lightsurf->samples.size(); i++) {
+            const auto &sample = lightsurf->samples[i];
+
+            if (sample.occluded)
+                continue;
+
+            if (clear[i] == num_active_probes) {
+                visibility[i] = dome_visibility_t::ALL;
+            } else if (blocked[i] == num_active_probes) {
+                visibility[i] = dome_visibility_t::NONE;
+            } else {
+                continue;
+            }
+
+            total_skydome_rays_skipped += num_active - num_active_probes;
+
+            if (visibility[i] == dome_visibility_t::NONE)
+                continue;
+
+            // the whole dome is visible, so add it without tracing
+            for (size_t d = 0; d < dome->directions.size(); d++) {
+                if (!active[d])
+                    continue;
+
+                qvec3f color;
+                qvec3d normalcontrib;
+
+                if (direction_color(sample, dome->directions[d], color, normalcontrib)) {
+                    add_light(i, dome->style, color, normalcontrib);
+                }
+            }
+        }
+    }
+
+    /* Trace every direction for the remaining points */
+    auto trace_directions = [&]() {
+        rs.tracePushedRaysIntersection(modelinfo, CHANNEL_MASK_DEFAULT);
+
+        const int N = rs.numPushedRays();
+        total_light_rays += N;
+
+        for (int j = 0; j < N; j++) {
+            if (!hit_dome(j)) {
+                continue;
+            }
+
+            // check if we hit a dynamic shadow caster
+            int desired_style = dome->style;
+            if (desired_style == 0) {
+                desired_style = rs.getPushedRayDynamicStyle(j);
+            }
+
+            add_light(rs.getPushedRayPointIndex(j), desired_style, rs.getPushedRayColor(j),
+                rs.getPushedRayNormalContrib(j));
+            total_light_ray_hits++;
+        }
+
+        rs.clearPushedRays();
+    };
+
+    rs.clearPushedRays();
+
+    for (int i = 0; i < lightsurf->samples.size(); i++) {
+        const auto &sample = lightsurf->samples[i];
+
+        if (sample.occluded || visibility[i] != dome_visibility_t::UNKNOWN)
+            continue;
+
+        for (size_t d = 0; d < dome->directions.size(); d++) {
+            if (!active[d])
+                continue;
+
+            qvec3f color;
+            qvec3d normalcontrib;
+
+            if (!direction_color(sample, dome->directions[d], color, normalcontrib)) {
+                continue;
+            }
+
+            rs.pushRay(i, sample.point, dome->directions[d], MAX_SKY_DIST, &color, &normalcontrib);
+
+            if (rs.numPushedRays() == rs.maxPushedRays()) {
+                trace_directions();
+            }
+        }
+    }
+
+    trace_directions();
+}
+
 static void LightPoint_Sky(const mbsp_t *bsp, raystream_intersection_t &rs, const sun_t *sun, const qvec3d &surfpoint,
     lightgrid_samples_t &result)
 {
@@ -1546,6 +1986,66 @@ static void LightPoint_Sky(const mbsp_t *bsp, raystream_intersection_t &rs, cons
     }
 }
 
+static void LightPoint_SkyDome(const mbsp_t *bsp, raystream_intersection_t &rs, const skydome_t *dome,
+    const qvec3d &surfpoint, lightgrid_samples_t &result)
+{
+    const vec_t light_per_direction = dome->sunlight / dome->directions.size();
+
+    for (const qvec3d &incoming : dome->directions) {
+        rs.clearPushedRays();
+
+        qvec3f color{};
+
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int sign = -1; sign <= +1; sign += 2) {
+
+                qvec3f cube_color;
+
+                qvec3f cube_normal{};
+                cube_normal[axis] = sign;
+
+                vec_t angle = qv::dot(incoming, cube_normal);
+                angle = max(0.0, angle);
+                angle = (1.0 - dome->anglescale) + dome->anglescale * angle;
+
+                float value = angle * light_per_direction;
+                cube_color = dome->sunlight_color * (value / 255.0);
+
+#ifdef LIGHTPOINT_TAKE_MAX
+                if (qv::length2(cube_color) > qv::length2(color)) {
+                    color = cube_color;
+                }
+#else
+                color += cube_color / 6;
+#endif
+            }
+        }
+
+        /* Quick distance check first */
+        if (fabs(LightSample_Brightness(color)) <= light_options.gate.value()) {
+            continue;
+        }
+
+        qvec3d normalcontrib{}; // unused
+
+        rs.pushRay(0, surfpoint, incoming, MAX_SKY_DIST, &color, &normalcontrib);
+        rs.tracePushedRaysIntersection(nullptr, CHANNEL_MASK_DEFAULT);
+
+        if (rs.getPushedRayHitType(0) != hittype_t::SKY) {
+            continue;
+        }
+
+        if (dome->suntexture_value) {
+            const triinfo *face = rs.getPushedRayHitFaceInfo(0);
+            if (dome->suntexture_value != face->texture) {
+                continue;
+            }
+        }
+
+        result.add(rs.getPushedRayColor(0), dome->style);
+    }
+}
+
 // Mottle
 
 static int mod_round_to_neg_inf(int x, int y)
@@ -1855,6 +2355,12 @@ static void LightFace_DirtDebug(const mbsp_t *bsp, const lightsurf_t *lightsurf,
         lightsample_t &sample = lightmap->samples[i];
         const float light = 255 * Dirt_GetScaleFactor(cfg, lightsurf->samples[i].occlusion, nullptr, 0.0, lightsurf);
         sample.color = {light};
+
+        /* with adaptive dirt, tint from blue (fewest rays) to red (all rays) */
+        if (cfg.dirtthreshold.value() > 0) {
+            const float fraction = min(1.0f, lightsurf->samples[i].dirt_rays / (float)numDirtVectors);
+            sample.color *= mix(qvec3f{0.25f, 0.5f, 1.0f}, qvec3f{1.0f, 0.25f, 0.25f}, fraction);
+        }
     }
 
     Lightmap_Save(bsp, lightmaps, lightsurf, lightmap, 0);
@@ -2286,17 +2792,41 @@ void SetupDirt(settings::worldspawn_keys &cfg)
     constexpr float angleStep = (float)DEG2RAD(360.0f / DIRT_NUM_ANGLE_STEPS);
     const float elevationStep = (float)DEG2RAD(cfg.dirtangle.value() / DIRT_NUM_ELEVATION_STEPS);
 
-    /* iterate angle */
-    float angle = 0.0f;
-    numDirtVectors = 0;
-    for (int i = 0; i < DIRT_NUM_ANGLE_STEPS; i++, angle += angleStep) {
-        /* iterate elevation */
-        float elevation = elevationStep * 0.5f;
-        for (int j = 0; j < DIRT_NUM_ELEVATION_STEPS; j++, elevation += elevationStep) {
-            dirtVectors[numDirtVectors][0] = sin(elevation) * cos(angle);
-            dirtVectors[numDirtVectors][1] = sin(elevation) * sin(angle);
-            dirtVectors[numDirtVectors][2] = cos(elevation);
-            numDirtVectors++;
+    if (cfg.dirtthreshold.value() > 0) {
+        /* stratified order, so that any run of vectors is spread over the hemisphere:
+           angles in bit-reversed order, and each pass over the angles uses the next elevation */
+        static_assert((DIRT_NUM_ANGLE_STEPS & (DIRT_NUM_ANGLE_STEPS - 1)) == 0);
+
+        numDirtVectors = 0;
+        for (int pass = 0; pass < DIRT_NUM_ELEVATION_STEPS; pass++) {
+            for (int k = 0; k < DIRT_NUM_ANGLE_STEPS; k++) {
+                int i = 0;
+                for (int bit = 1; bit < DIRT_NUM_ANGLE_STEPS; bit <<= 1) {
+                    i = (i << 1) | ((k & bit) ? 1 : 0);
+                }
+                const int j = (pass + k) % DIRT_NUM_ELEVATION_STEPS;
+
+                const float angle = angleStep * i;
+                const float elevation = elevationStep * (0.5f + j);
+                dirtVectors[numDirtVectors][0] = sin(elevation) * cos(angle);
+                dirtVectors[numDirtVectors][1] = sin(elevation) * sin(angle);
+                dirtVectors[numDirtVectors][2] = cos(elevation);
+                numDirtVectors++;
+            }
+        }
+    } else {
+        /* iterate angle */
+        float angle = 0.0f;
+        numDirtVectors = 0;
+        for (int i = 0; i < DIRT_NUM_ANGLE_STEPS; i++, angle += angleStep) {
+            /* iterate elevation */
+            float elevation = elevationStep * 0.5f;
+            for (int j = 0; j < DIRT_NUM_ELEVATION_STEPS; j++, elevation += elevationStep) {
+                dirtVectors[numDirtVectors][0] = sin(elevation) * cos(angle);
+                dirtVectors[numDirtVectors][1] = sin(elevation) * sin(angle);
+                dirtVectors[numDirtVectors][2] = cos(elevation);
+                numDirtVectors++;
+            }
         }
     }
 
@@ -2329,11 +2859,21 @@ inline qvec3d GetDirtVector(const settings::worldspawn_keys &cfg, int i)
 /*
  * ============
  * LightFace_CalculateDirt
+ *
+ * With _dirtthreshold, rays are traced in batches in a stratified order,
+ * and each sample stops once the standard error of its occlusion is below
+ * the threshold. The -extra supersamples of a luxel pool their rays
+ * (taking turns to trace them) and share the result.
  * ============
  */
+constexpr size_t DIRT_ADAPTIVE_BATCH = 8;
+
 static void LightFace_CalculateDirt(lightsurf_t *lightsurf)
 {
     const settings::worldspawn_keys &cfg = *lightsurf->cfg;
+    const vec_t dirtdepth = cfg.dirtdepth.value();
+    const vec_t threshold = cfg.dirtthreshold.value();
+    const bool adaptive = threshold > 0;
 
     Q_assert(dirt_in_use);
 
@@ -2344,11 +2884,6 @@ static void LightFace_CalculateDirt(lightsurf_t *lightsurf)
     myUps.resize(lightsurf->samples.size());
     myRts.resize(lightsurf->samples.size());
 
-    // init
-    for (int i = 0; i < lightsurf->samples.size(); i++) {
-        lightsurf->samples[i].occlusion = 0;
-    }
-
     // this stuff is just per-point
     for (int i = 0; i < lightsurf->samples.size(); i++) {
         const auto [tangent, bitangent] = qv::MakeTangentAndBitangentUnnormalized(lightsurf->samples[i].normal);
@@ -2357,46 +2892,144 @@ static void LightFace_CalculateDirt(lightsurf_t *lightsurf)
         myRts[i] = qv::normalize(bitangent);
     }
 
-    for (int j = 0; j < numDirtVectors; j++) {
-        raystream_intersection_t &rs = *lightsurf->intersection_stream;
-        rs.clearPushedRays();
+    // a group is one sample, or all of the unoccluded supersamples of a luxel
+    struct dirt_group_t
+    {
+        std::vector<int> members;
+        float hitdist = 0, hitdist_sq = 0;
+        int rays = 0;
+        bool active = true;
+    };
 
-        // fill in input buffers
+    thread_local static std::vector<dirt_group_t> groups;
+    thread_local static std::vector<int> group_of_sample;
 
-        for (int i = 0; i < lightsurf->samples.size(); i++) {
-            const auto &sample = lightsurf->samples[i];
+    groups.clear();
+    group_of_sample.assign(lightsurf->samples.size(), -1);
 
-            if (sample.occluded)
+    const int extra = adaptive ? light_options.extra.value() : 1;
+
+    for (int t = 0; t < lightsurf->height; t++) {
+        for (int s = 0; s < lightsurf->width; s++) {
+            const int i = t * lightsurf->width + s;
+
+            if (lightsurf->samples[i].occluded)
                 continue;
 
-            qvec3d dirtvec = GetDirtVector(cfg, j);
-            qvec3d dir = TransformToTangentSpace(sample.normal, myUps[i], myRts[i], dirtvec);
+            // first supersample of the luxel starts the group
+            const int first = (t - t % extra) * lightsurf->width + (s - s % extra);
+            int &group = group_of_sample[first];
+
+            if (group == -1) {
+                group = groups.size();
+                groups.emplace_back();
+            }
 
-            rs.pushRay(i, sample.point, dir, cfg.dirtdepth.value());
+            group_of_sample[i] = group;
+            groups[group].members.push_back(i);
         }
+    }
+
+    const int batch = adaptive ? DIRT_ADAPTIVE_BATCH : numDirtVectors;
+    const vec_t threshold_sq = (threshold * dirtdepth) * (threshold * dirtdepth);
+
+    raystream_intersection_t &rs = *lightsurf->intersection_stream;
 
+    auto trace = [&]() {
         // trace the batch. need closest hit for dirt, so intersection.
         //
         // use the model's own channel mask as the shadow mask, e.g. so a model in channel 2's AO rays will only hit
         // other things in channel 2
         rs.tracePushedRaysIntersection(lightsurf->modelinfo, lightsurf->object_channel_mask);
+        total_dirt_rays += rs.numPushedRays();
 
         // accumulate hitdists
         for (int k = 0; k < rs.numPushedRays(); k++) {
-            const int i = rs.getPushedRayPointIndex(k);
+            dirt_group_t &group = groups[group_of_sample[rs.getPushedRayPointIndex(k)]];
+            vec_t dist = dirtdepth;
+
             if (rs.getPushedRayHitType(k) == hittype_t::SOLID) {
-                vec_t dist = rs.getPushedRayHitDist(k);
-                lightsurf->samples[i].occlusion += min(cfg.dirtdepth.value(), dist);
+                dist = min(dirtdepth, (vec_t)rs.getPushedRayHitDist(k));
+            }
+
+            group.hitdist += dist;
+            group.hitdist_sq += dist * dist;
+            group.rays++;
+        }
+
+        rs.clearPushedRays();
+    };
+
+    for (int first_vector = 0; first_vector < numDirtVectors; first_vector += batch) {
+        const int last_vector = min(first_vector + batch, numDirtVectors);
+
+        rs.clearPushedRays();
+
+        // fill in input buffers
+
+        for (auto &group : groups) {
+            if (!group.active)
+                continue;
+
+            for (int j = first_vector; j < last_vector; j++) {
+                // supersamples take turns
+                const int i = group.members[j % group.members.size()];
+                const auto &sample = lightsurf->samples[i];
+
+                qvec3d dirtvec = GetDirtVector(cfg, j);
+                qvec3d dir = TransformToTangentSpace(sample.normal, myUps[i], myRts[i], dirtvec);
+
+                rs.pushRay(i, sample.point, dir, dirtdepth);
+
+                if (rs.numPushedRays() == rs.maxPushedRays()) {
+                    trace();
+                }
+            }
+        }
+
+        trace();
+
+        if (!adaptive)
+            continue;
+
+        // stop the groups that have converged
+        bool any_active = false;
+
+        for (auto &group : groups) {
+            if (!group.active)
+                continue;
+
+            const vec_t mean = group.hitdist / group.rays;
+            const vec_t variance = max(0.0, group.hitdist_sq / group.rays - mean * mean);
+
+            // squared standard error of the mean, scaled like the threshold by dirtdepth
+            if (variance / group.rays <= threshold_sq) {
+                group.active = false;
             } else {
-                lightsurf->samples[i].occlusion += cfg.dirtdepth.value();
+                any_active = true;
             }
         }
+
+        if (!any_active)
+            break;
     }
 
     // process the results.
     for (int i = 0; i < lightsurf->samples.size(); i++) {
-        vec_t avgHitdist = lightsurf->samples[i].occlusion / (float)numDirtVectors;
-        lightsurf->samples[i].occlusion = 1.0 - (avgHitdist / cfg.dirtdepth.value());
+        auto &sample = lightsurf->samples[i];
+
+        if (group_of_sample[i] == -1) {
+            // no rays traced, i.e. an average hit distance of 0
+            sample.occlusion = 1.0;
+            sample.dirt_rays = 0;
+            continue;
+        }
+
+        const dirt_group_t &group = groups[group_of_sample[i]];
+
+        vec_t avgHitdist = group.hitdist / (float)group.rays;
+        sample.occlusion = 1.0 - (avgHitdist / dirtdepth);
+        sample.dirt_rays = group.rays;
     }
 }
 
@@ -2609,7 +3242,7 @@ static std::vector<qvec4f> LightmapNormalsToGLMVector(const lightsurf_t *lightsu
 {
     std::vector<qvec4f> res;
     for (int i = 0; i < lightsurf->samples.size(); i++) {
-        const qvec3d &color = lm->samples[i].direction;
+        const qvec3f &color = lm->samples[i].direction;
         const float alpha = lightsurf->samples[i].occluded ? 0.0f : 1.0f;
         res.emplace_back(color[0], color[1], color[2], alpha);
     }
@@ -3318,6 +3951,8 @@ std::unique_ptr<lightsurf_t> CreateLightmapSurface(const mbsp_t *bsp, const mfac
  */
 void DirectLightFace(const mbsp_t *bsp, lightsurf_t &lightsurf, const settings::worldspawn_keys &cfg)
 {
+    logging::trace_zone zone(__func__);
+
     auto face = lightsurf.face;
     const modelinfo_t *modelinfo = ModelInfoForFace(bsp, Face_GetNum(bsp, face));
 
@@ -3352,6 +3987,9 @@ void DirectLightFace(const mbsp_t *bsp, lightsurf_t &lightsurf, const settings::
             for (const sun_t &sun : GetSuns())
                 if (sun.sunlight > 0)
                     LightFace_Sky(bsp, &sun, &lightsurf, lightmaps);
+            for (const skydome_t &dome : GetSkyDomes())
+                if (dome.sunlight > 0)
+                    LightFace_SkyDome(bsp, &dome, &lightsurf, lightmaps);
 
             // mxd. Add surface lights...
             // FIXME: negative surface lights
@@ -3374,6 +4012,11 @@ void DirectLightFace(const mbsp_t *bsp, lightsurf_t &lightsurf, const settings::
 
     if (light_options.debugmode == debugmodes::debugneighbours)
         LightFace_DebugNeighbours(bsp, &lightsurf, lightmaps);
+
+    // only the negative lights in PostProcessLightFace can still reuse shadow rays
+    std::erase_if(lightsurf.visibility_cache, [](const auto &entry) {
+        return !negative_visibility_keys.count(entry.first);
+    });
 }
 
 /*
@@ -3383,6 +4026,8 @@ void DirectLightFace(const mbsp_t *bsp, lightsurf_t &lightsurf, const settings::
  */
 void IndirectLightFace(const mbsp_t *bsp, lightsurf_t &lightsurf, const settings::worldspawn_keys &cfg)
 {
+    logging::trace_zone zone(__func__);
+
     auto face = lightsurf.face;
     const modelinfo_t *modelinfo = ModelInfoForFace(bsp, Face_GetNum(bsp, face));
     lightmapdict_t *lightmaps = &lightsurf.lightmapsByStyle;
@@ -3467,11 +4112,17 @@ void PostProcessLightFace(const mbsp_t *bsp, lightsurf_t &lightsurf, const setti
             for (const sun_t &sun : GetSuns())
                 if (sun.sunlight < 0)
                     LightFace_Sky(bsp, &sun, &lightsurf, lightmaps);
+            for (const skydome_t &dome : GetSkyDomes())
+                if (dome.sunlight < 0)
+                    LightFace_SkyDome(bsp, &dome, &lightsurf, lightmaps);
         }
     }
 
     if (light_options.debugmode == debugmodes::mottle)
         LightFace_DebugMottle(bsp, &lightsurf, lightmaps);
+
+    // all lights that could reuse shadow rays are done
+    lightsurf.visibility_cache.clear();
 }
 // lightgrid
 
@@ -3602,6 +4253,9 @@ lightgrid_samples_t CalcLightgridAtPoint(const mbsp_t *bsp, const qvec3d &world_
     for (const sun_t &sun : GetSuns())
         if (sun.sunlight > 0)
             LightPoint_Sky(bsp, rsi, &sun, world_point, result);
+    for (const skydome_t &dome : GetSkyDomes())
+        if (dome.sunlight > 0)
+            LightPoint_SkyDome(bsp, rsi, &dome, world_point, result);
 
     // mxd. Add surface lights...
     // FIXME: negative surface lights
@@ -3632,6 +4286,9 @@ lightgrid_samples_t CalcLightgridAtPoint(const mbsp_t *bsp, const qvec3d &world_
     for (const sun_t &sun : GetSuns())
         if (sun.sunlight < 0)
             LightPoint_Sky(bsp, rsi, &sun, world_point, result);
+    for (const skydome_t &dome : GetSkyDomes())
+        if (dome.sunlight < 0)
+            LightPoint_SkyDome(bsp, rsi, &dome, world_point, result);
 
     // from IndirectLightFace
 
@@ -3650,6 +4307,13 @@ void ResetLtFace()
     total_light_rays = 0;
     total_light_ray_hits = 0;
     total_samplepoints = 0;
+    total_skydome_rays_skipped = 0;
+    total_light_rays_cached = 0;
+    total_dirt_rays = 0;
+    total_samplecache_faces = 0;
+
+    shared_visibility_keys.clear();
+    negative_visibility_keys.clear();
 
     total_bounce_rays = 0;
     total_bounce_ray_hits = 0;
@@ -0,0 +1,236 @@
+/*  Copyright (C) 1996-1997  Id Software, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+    See file, 'COPYING', for details.
+*/
+
+#include <light/samplecache.hh>
+
+#include <fstream>
+#include <sstream>
+
+#include <light/light.hh>
+#include <light/litfile.hh> // for facesup_t
+
+#include <common/bspfile.hh>
+#include <common/cmdlib.hh>
+#include <common/fs.hh>
+#include <common/log.hh>
+
+constexpr std::array<char, 4> SAMPLECACHE_IDENT = {'L', 'P', 'T', 'S'};
+// bump when CalcPoints changes in a way that alters its output
+constexpr int32_t SAMPLECACHE_VERSION = 2;
+
+static std::vector<cached_sample_points_t> sample_cache;
+
+// 64-bit FNV-1a
+static uint64_t HashBytes(const std::string &bytes)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (unsigned char c : bytes) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+uint64_t SampleCache_Key(const mbsp_t *bsp, const std::vector<facesup_t> &facesup)
+{
+    std::ostringstream s(std::ios_base::out | std::ios_base::binary);
+
+    s <= SAMPLECACHE_VERSION;
+    s <= static_cast<int32_t>(bsp->loadversion->game->id);
+
+    // geometry; leave out the lighting info (face styles/lightofs) which light itself rewrites
+    for (auto &plane : bsp->dplanes) {
+        s <= plane;
+    }
+    for (auto &vert : bsp->dvertexes) {
+        s <= vert;
+    }
+    for (auto &edge : bsp->dedges) {
+        s <= edge;
+    }
+    for (auto &surfedge : bsp->dsurfedges) {
+        s <= surfedge;
+    }
+    for (auto &face : bsp->dfaces) {
+        s <= std::tie(face.planenum, face.side, face.firstedge, face.numedges, face.texinfo);
+    }
+    for (auto &texinfo : bsp->texinfo) {
+        s <= texinfo.vecs;
+        s <= std::tie(texinfo.flags.native, texinfo.value);
+    }
+    for (auto &node : bsp->dnodes) {
+        s <= node;
+    }
+    for (auto &leaf : bsp->dleafs) {
+        s <= leaf.contents;
+    }
+    for (auto &model : bsp->dmodels) {
+        s <= model;
+    }
+
+    // extended flags, including the entity phong keys applied by CalculateVertexNormals
+    for (auto &flags : extended_texinfo_flags) {
+        s <= std::tie(flags.phong_angle, flags.phong_angle_concave, flags.phong_group);
+        s <= static_cast<uint8_t>(flags.no_phong);
+        s <= flags.world_units_per_luxel.value_or(0.f);
+    }
+
+    // bmodel placement, lightmap scale and the shadow casters tested by Light_PointInAnySolid
+    for (size_t i = 0; i < bsp->dmodels.size(); i++) {
+        const modelinfo_t *info = ModelInfoForModel(bsp, i);
+
+        s <= info->offset;
+        s <= info->lightmapscale;
+        s <= info->object_channel_mask.value();
+        s <= static_cast<uint8_t>(info->alpha.value() == 1.0f);
+    }
+    for (const modelinfo_t *info : tracelist) {
+        s <= static_cast<int32_t>(info->model - bsp->dmodels.data());
+    }
+
+    for (auto &sup : facesup) {
+        s <= sup.lmscale;
+    }
+
+    s <= light_options.extra.value();
+    s <= light_options.world_units_per_luxel.value();
+    s <= static_cast<uint8_t>(light_options.world_units_per_luxel.is_changed());
+    s <= static_cast<uint8_t>(light_options.phongallowed.value());
+
+    return HashBytes(s.str());
+}
+
+bool SampleCache_Load(const fs::path &filename, uint64_t key, const mbsp_t *bsp)
+{
+    sample_cache.clear();
+
+    std::ifstream file(filename, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+
+    if (!file) {
+        return false;
+    }
+
+    // read the whole file in one go, then parse it from memory
+    std::vector<uint8_t> data(file.tellg());
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(data.data()), data.size());
+
+    if (!file) {
+        return false;
+    }
+
+    imemstream stream(data.data(), data.size());
+    stream >> endianness<std::endian::little>;
+
+    std::array<char, 4> ident;
+    int32_t version;
+    uint64_t file_key;
+    uint32_t numfaces;
+
+    stream >= std::tie(ident, version, file_key, numfaces);
+
+    if (!stream || ident != SAMPLECACHE_IDENT || version != SAMPLECACHE_VERSION || file_key != key ||
+        numfaces != bsp->dfaces.size()) {
+        logging::print("{} is out of date, recomputing sample points\n", filename);
+        return false;
+    }
+
+    std::vector<cached_sample_points_t> faces(numfaces);
+
+    for (auto &face : faces) {
+        uint32_t numsamples;
+        stream >= std::tie(face.width, face.height, numsamples);
+
+        if (!stream || numsamples != static_cast<uint32_t>(face.width * face.height)) {
+            logging::print("WARNING: {} is corrupt, ignoring\n", filename);
+            return false;
+        }
+
+        face.samples.resize(numsamples);
+
+        for (auto &sample : face.samples) {
+            uint8_t occluded;
+            stream >= std::tie(sample.point, sample.normal, occluded, sample.realfacenum);
+            sample.occluded = occluded;
+        }
+    }
+
+    if (!stream) {
+        logging::print("WARNING: {} is corrupt, ignoring\n", filename);
+        return false;
+    }
+
+    sample_cache = std::move(faces);
+
+    logging::print("Loaded sample points from {}\n", filename);
+    return true;
+}
+
+void SampleCache_Save(
+    const fs::path &filename, uint64_t key, const std::vector<std::unique_ptr<lightsurf_t>> &surfaces)
+{
+    std::ofstream file(filename, std::ios_base::out | std::ios_base::binary);
+
+    if (!file) {
+        logging::print("WARNING: couldn't write {}\n", filename);
+        return;
+    }
+
+    file << endianness<std::endian::little>;
+
+    file <= std::tie(SAMPLECACHE_IDENT, SAMPLECACHE_VERSION, key);
+    file <= static_cast<uint32_t>(surfaces.size());
+
+    for (auto &surf : surfaces) {
+        // faces without a lightsurf or without samples are stored as empty
+        if (!surf || surf->samples.empty()) {
+            file <= static_cast<int32_t>(0);
+            file <= static_cast<int32_t>(0);
+            file <= static_cast<uint32_t>(0);
+            continue;
+        }
+
+        file <= std::tie(surf->width, surf->height);
+        file <= static_cast<uint32_t>(surf->samples.size());
+
+        for (auto &sample : surf->samples) {
+            file <= std::tie(sample.point, sample.normal);
+            file <= static_cast<uint8_t>(sample.occluded);
+            file <= sample.realfacenum;
+        }
+    }
+
+    logging::print("Wrote sample points to {}\n", filename);
+}
+
+const cached_sample_points_t *SampleCache_ForFace(size_t facenum)
+{
+    if (facenum >= sample_cache.size()) {
+        return nullptr;
+    }
+
+    return &sample_cache[facenum];
+}
+
+void SampleCache_Clear()
+{
+    sample_cache.clear();
+}
@@ -33,6 +33,7 @@ See file, 'COPYING', for details.
 
 #include <vector>
 #include <map>
+#include <memory>
 #include <mutex>
 
 #include <common/qvec.hh>
@@ -42,9 +43,74 @@ using namespace polylib;
 
 static std::atomic_size_t total_surflight_points;
 
+struct face_emitter_cache_t
+{
+    std::once_flag once;
+    face_emitter_t emitter;
+};
+
+static std::unique_ptr<face_emitter_cache_t[]> face_emitters;
+static size_t num_face_emitters;
+
 void ResetSurflight()
 {
     total_surflight_points = {};
+    face_emitters.reset();
+    num_face_emitters = 0;
+}
+
+void SetupFaceEmitters(const mbsp_t *bsp)
+{
+    if (num_face_emitters == bsp->dfaces.size()) {
+        return;
+    }
+
+    face_emitters = std::make_unique<face_emitter_cache_t[]>(bsp->dfaces.size());
+    num_face_emitters = bsp->dfaces.size();
+}
+
+const face_emitter_t &FaceEmitter(const mbsp_t *bsp, const mface_t *face)
+{
+    const size_t facenum = face - bsp->dfaces.data();
+    Q_assert(facenum < num_face_emitters);
+
+    face_emitter_cache_t &cache = face_emitters[facenum];
+
+    std::call_once(cache.once, [&]() {
+        face_emitter_t &e = cache.emitter;
+
+        e.winding = winding_t::from_face(bsp, face);
+        e.area = e.winding.area();
+
+        const modelinfo_t *face_modelinfo = ModelInfoForFace(bsp, facenum);
+        for (auto &pt : e.winding) {
+            pt += face_modelinfo->offset;
+        }
+
+        e.winding.remove_colinear();
+
+        e.normal = Face_Normal(bsp, face);
+        e.midpoint = e.winding.center() + e.normal; // Lift 1 unit
+    });
+
+    return cache.emitter;
+}
+
+void EstimateSurfaceLightVisibility(const mbsp_t *bsp, surfacelight_t &l)
+{
+    if (light_options.visapprox.value() == visapprox_t::VIS) {
+        for (auto &pt : l.points) {
+            l.leaves.push_back(Light_PointInLeaf(bsp, pt));
+        }
+    } else if (light_options.visapprox.value() == visapprox_t::RAYS) {
+        // trace all of the points together rather than one raystream per point
+        std::vector<qvec3d> points;
+        points.reserve(l.points.size() + 1);
+        points.push_back(l.pos);
+        points.insert(points.end(), l.points.begin(), l.points.end());
+
+        l.bounds = EstimateVisibleBoundsAtPoints(points);
+    }
 }
 
 size_t GetSurflightPoints()
@@ -65,9 +131,8 @@ static void MakeSurfaceLight(const mbsp_t *bsp, const settings::worldspawn_keys
 
     auto &surf = *surf_ptr.get();
 
-    // Create face points...
-    auto poly = Face_Points(bsp, face);
-    const float facearea = qv::PolyArea(poly.begin(), poly.end());
+    const face_emitter_t &emitter = FaceEmitter(bsp, face);
+    const float facearea = emitter.area;
 
     const surfflags_t &extended_flags = extended_texinfo_flags[face->texinfo];
 
@@ -109,19 +174,12 @@ static void MakeSurfaceLight(const mbsp_t *bsp, const settings::worldspawn_keys
     if (!surf.vpl) {
         auto &l = surf.vpl = std::make_unique<surfacelight_t>();
 
-        // Create winding...
-        winding_t winding = winding_t::from_winding_points(poly);
-        auto face_modelinfo = ModelInfoForFace(bsp, face - bsp->dfaces.data());
-
-        for (auto &pt : winding) {
-            pt += face_modelinfo->offset;
-        }
-
-        winding.remove_colinear();
+        // dice() consumes the winding
+        winding_t winding = emitter.winding.clone();
 
         // Get face normal and midpoint...
-        l->surfnormal = Face_Normal(bsp, face);
-        l->pos = winding.center() + l->surfnormal; // Lift 1 unit
+        l->surfnormal = emitter.normal;
+        l->pos = emitter.midpoint;
 
         // Dice winding...
         l->points_before_culling = 0;
@@ -173,17 +231,7 @@ static void MakeSurfaceLight(const mbsp_t *bsp, const settings::worldspawn_keys
         l->minlight_scale = extended_flags.surflight_minlight_scale;
 
         // Init bbox...
-        if (light_options.visapprox.value() == visapprox_t::RAYS) {
-            l->bounds = EstimateVisibleBoundsAtPoint(l->pos);
-        }
-
-        for (auto &pt : l->points) {
-            if (light_options.visapprox.value() == visapprox_t::VIS) {
-                l->leaves.push_back(Light_PointInLeaf(bsp, pt));
-            } else if (light_options.visapprox.value() == visapprox_t::RAYS) {
-                l->bounds += EstimateVisibleBoundsAtPoint(pt);
-            }
-        }
+        EstimateSurfaceLightVisibility(bsp, *l);
     }
 
     auto &l = surf.vpl;
@@ -282,6 +330,8 @@ MakeRadiositySurfaceLights(const settings::worldspawn_keys &cfg, const mbsp_t *b
 {
     logging::funcheader();
 
+    SetupFaceEmitters(bsp);
+
     logging::parallel_for(
         static_cast<size_t>(0), bsp->dfaces.size(), [&](size_t i) { MakeSurfaceLightsThread(bsp, cfg, i); });
 
@@ -26,6 +26,9 @@
 #include <common/polylib.hh>
 #include <vector>
 #include <climits>
+#include <algorithm>
+#include <map>
+#include <fmt/chrono.h>
 
 using namespace std;
 using namespace polylib;
@@ -91,6 +94,50 @@ static float Face_Alpha(const mbsp_t *bsp, const modelinfo_t *modelinfo, const m
     return 1.0f;
 }
 
+static RTCBuildQuality Embree_GeometryBuildQuality()
+{
+    switch (light_options.bvhquality.value()) {
+        case bvhquality_t::LOW: return RTC_BUILD_QUALITY_LOW;
+        case bvhquality_t::REFIT: return RTC_BUILD_QUALITY_REFIT;
+        default: return RTC_BUILD_QUALITY_MEDIUM;
+    }
+}
+
+static RTCBuildQuality Embree_SceneBuildQuality()
+{
+    // scenes only take low/medium/high
+    switch (light_options.bvhquality.value()) {
+        case bvhquality_t::LOW:
+        case bvhquality_t::REFIT: return RTC_BUILD_QUALITY_LOW;
+        case bvhquality_t::MEDIUM: return RTC_BUILD_QUALITY_MEDIUM;
+        default: return RTC_BUILD_QUALITY_HIGH;
+    }
+}
+
+static RTCScene Embree_NewScene(RTCDevice g_device)
+{
+    RTCScene new_scene = rtcNewScene(g_device);
+
+    // we're using RTCIntersectContext::filter so it's required that we set
+    // RTC_SCENE_FLAG_CONTEXT_FILTER_FUNCTION
+    RTCSceneFlags flags = RTC_SCENE_FLAG_CONTEXT_FILTER_FUNCTION;
+
+    if (light_options.bvhcompact.value()) {
+        flags = flags | RTC_SCENE_FLAG_COMPACT;
+    }
+    if (light_options.bvhrobust.value()) {
+        flags = flags | RTC_SCENE_FLAG_ROBUST;
+    }
+    if (light_options.bvhquality.value() == bvhquality_t::REFIT) {
+        flags = flags | RTC_SCENE_FLAG_DYNAMIC;
+    }
+
+    rtcSetSceneFlags(new_scene, flags);
+    rtcSetSceneBuildQuality(new_scene, Embree_SceneBuildQuality());
+
+    return new_scene;
+}
+
 sceneinfo CreateGeometry(
     const mbsp_t *bsp, RTCDevice g_device, RTCScene scene, const std::vector<const mface_t *> &faces)
 {
@@ -99,7 +146,7 @@ sceneinfo CreateGeometry(
     // we're not using masks, but they need to be set to something or else all rays miss
     // if embree is compiled with them
     rtcSetGeometryMask(geom_0, 1);
-    rtcSetGeometryBuildQuality(geom_0, RTC_BUILD_QUALITY_MEDIUM);
+    rtcSetGeometryBuildQuality(geom_0, Embree_GeometryBuildQuality());
     rtcSetGeometryTimeStepCount(geom_0, 1);
     geomID = rtcAttachGeometry(scene, geom_0);
     rtcReleaseGeometry(geom_0);
@@ -222,7 +269,7 @@ static void CreateGeometryFromWindings(RTCDevice g_device, RTCScene scene, const
     }
 
     RTCGeometry geom_1 = rtcNewGeometry(g_device, RTC_GEOMETRY_TYPE_TRIANGLE);
-    rtcSetGeometryBuildQuality(geom_1, RTC_BUILD_QUALITY_MEDIUM);
+    rtcSetGeometryBuildQuality(geom_1, Embree_GeometryBuildQuality());
     rtcSetGeometryMask(geom_1, 1);
     rtcSetGeometryTimeStepCount(geom_1, 1);
     rtcAttachGeometry(scene, geom_1);
@@ -445,9 +492,12 @@ static void PerRay_FilterFuncN(const struct RTCFilterFunctionNArguments *args)
         // unpack ray index
         const unsigned rayIndex = rayID;
 
-        const triinfo &hit_triinfo = Embree_LookupTriangleInfo(geomID, primID);
+        // instanced bmodels only contain faces with the default channel mask
+        const int channelmask = (RTCHitN_instID(potentialHit, N, i, 0) != RTC_INVALID_GEOMETRY_ID)
+                                    ? CHANNEL_MASK_DEFAULT
+                                    : Embree_LookupTriangleInfo(geomID, primID).channelmask;
 
-        if (!(hit_triinfo.channelmask & rsi->shadowmask)) {
+        if (!(channelmask & rsi->shadowmask)) {
             // reject hit
             valid[i] = INVALID;
             continue;
@@ -539,6 +589,110 @@ static void MakeFaces(
     Q_assert(planes.empty());
 }
 
+/**
+ * Adds the solid faces of bmodels as instances of per-model scenes.
+ * bmodels whose faces are identical up to a translation (e.g. copies of
+ * the same func_door) share one scene.
+ *
+ * Instanced triangles have no triinfo; they're only used for faces that
+ * always occlude, with the default channel mask.
+ *
+ * Returns the number of unique scenes.
+ */
+static size_t CreateInstancedModels(const mbsp_t *bsp, RTCDevice g_device, RTCScene scene,
+    const std::vector<std::pair<const modelinfo_t *, std::vector<const mface_t *>>> &models)
+{
+    struct Vertex
+    {
+        float point[4];
+    }; // 4th element is padding
+
+    // triangle vertices relative to the model's mins -> scene
+    std::map<std::vector<float>, RTCScene> unique_scenes;
+
+    for (auto &[modelinfo, faces] : models) {
+        std::vector<qvec3f> positions;
+
+        for (const mface_t *face : faces) {
+            for (int j = 2; j < face->numedges; j++) {
+                for (int k : {j - 1, j, 0}) {
+                    positions.push_back(Vertex_GetPos(bsp, Face_VertexAtIndex(bsp, face, k)) + modelinfo->offset);
+                }
+            }
+        }
+
+        if (positions.empty()) {
+            continue;
+        }
+
+        qvec3f mins = positions[0];
+        for (auto &pos : positions) {
+            mins = qv::min(mins, pos);
+        }
+
+        std::vector<float> key;
+        key.reserve(positions.size() * 3);
+        for (auto &pos : positions) {
+            for (int k = 0; k < 3; k++) {
+                key.push_back(pos[k] - mins[k]);
+            }
+        }
+
+        auto it = unique_scenes.find(key);
+
+        if (it == unique_scenes.end()) {
+            RTCScene model_scene = Embree_NewScene(g_device);
+
+            RTCGeometry geom = rtcNewGeometry(g_device, RTC_GEOMETRY_TYPE_TRIANGLE);
+            rtcSetGeometryMask(geom, 1);
+            rtcSetGeometryBuildQuality(geom, Embree_GeometryBuildQuality());
+            rtcSetGeometryTimeStepCount(geom, 1);
+
+            const size_t numverts = positions.size();
+
+            Vertex *vertices = (Vertex *)rtcSetNewGeometryBuffer(
+                geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, 4 * sizeof(float), numverts);
+            for (size_t i = 0; i < numverts; i++) {
+                vertices[i] = {.point{key[i * 3], key[i * 3 + 1], key[i * 3 + 2], 0.0f}};
+            }
+
+            // every triangle has its own 3 vertices
+            unsigned *triangles = (unsigned *)rtcSetNewGeometryBuffer(
+                geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, 3 * sizeof(unsigned), numverts / 3);
+            for (size_t i = 0; i < numverts; i++) {
+                triangles[i] = i;
+            }
+
+            rtcCommitGeometry(geom);
+            rtcAttachGeometry(model_scene, geom);
+            rtcReleaseGeometry(geom);
+
+            rtcCommitScene(model_scene);
+
+            it = unique_scenes.emplace(std::move(key), model_scene).first;
+        }
+
+        // column-major 3x4: identity rotation, then translation
+        const float transform[12] = {1, 0, 0, 0, 1, 0, 0, 0, 1, mins[0], mins[1], mins[2]};
+
+        RTCGeometry instance = rtcNewGeometry(g_device, RTC_GEOMETRY_TYPE_INSTANCE);
+        rtcSetGeometryInstancedScene(instance, it->second);
+        rtcSetGeometryTimeStepCount(instance, 1);
+        rtcSetGeometryMask(instance, 1);
+        rtcSetGeometryTransform(instance, 0, RTC_FORMAT_FLOAT3X4_COLUMN_MAJOR, transform);
+        rtcCommitGeometry(instance);
+        rtcAttachGeometry(scene, instance);
+        rtcReleaseGeometry(instance);
+    }
+
+    // the instances hold references to the scenes
+    for (auto &[key, model_scene] : unique_scenes) {
+        rtcReleaseScene(model_scene);
+    }
+
+    return unique_scenes.size();
+}
+
 void Embree_TraceInit(const mbsp_t *bsp)
 {
     bsp_static = bsp;
@@ -546,6 +700,9 @@ void Embree_TraceInit(const mbsp_t *bsp)
 
     std::vector<const mface_t *> skyfaces, solidfaces, filterfaces;
 
+    // solid faces of bmodels, see CreateInstancedModels
+    std::vector<std::pair<const modelinfo_t *, std::vector<const mface_t *>>> instancedfaces;
+
     // check all modelinfos
     for (size_t mi = 0; mi < bsp->dmodels.size(); mi++) {
         const modelinfo_t *model = ModelInfoForModel(bsp, mi);
@@ -561,6 +718,12 @@ void Embree_TraceInit(const mbsp_t *bsp)
         if (!(isWorld || shadow || shadowself || shadowworldonly || switchableshadow || has_custom_channel_mask))
             continue;
 
+        std::vector<const mface_t *> *model_solidfaces = &solidfaces;
+
+        if (!isWorld && light_options.bvhinstancing.value()) {
+            model_solidfaces = &instancedfaces.emplace_back(model, std::vector<const mface_t *>{}).second;
+        }
+
         for (int i = 0; i < model->model->numfaces; i++) {
             const mface_t *face = BSP_GetFace(bsp, model->model->firstface + i);
 
@@ -627,7 +790,7 @@ void Embree_TraceInit(const mbsp_t *bsp)
             if (/* texname[0] == '*' */ ContentsOrSurfaceFlags_IsTranslucent(bsp, contents_or_surf_flags)) { // mxd
                 if (!isWorld) {
                     // world liquids never cast shadows; shadow casting bmodel liquids do
-                    solidfaces.push_back(face);
+                    model_solidfaces->push_back(face);
                 }
                 continue;
             }
@@ -635,7 +798,7 @@ void Embree_TraceInit(const mbsp_t *bsp)
             // solid faces
 
             if (isWorld || shadow) {
-                solidfaces.push_back(face);
+                model_solidfaces->push_back(face);
             } else {
                 // shadowself or shadowworldonly
                 Q_assert(shadowself || shadowworldonly);
@@ -662,26 +825,35 @@ void Embree_TraceInit(const mbsp_t *bsp)
     const size_t ver_pat = rtcGetDeviceProperty(device, RTC_DEVICE_PROPERTY_VERSION_PATCH);
     logging::funcprint("Embree version: {}.{}.{}\n", ver_maj, ver_min, ver_pat);
 
-    scene = rtcNewScene(device);
-    // we're using RTCIntersectContext::filter so it's required that we set
-    // RTC_SCENE_FLAG_CONTEXT_FILTER_FUNCTION
-    rtcSetSceneFlags(scene, RTC_SCENE_FLAG_CONTEXT_FILTER_FUNCTION);
-    rtcSetSceneBuildQuality(scene, RTC_BUILD_QUALITY_HIGH);
+    auto start = I_FloatTime();
+
+    scene = Embree_NewScene(device);
     skygeom = CreateGeometry(bsp, device, scene, skyfaces);
     solidgeom = CreateGeometry(bsp, device, scene, solidfaces);
     filtergeom = CreateGeometry(bsp, device, scene, filterfaces);
     CreateGeometryFromWindings(device, scene, skipwindings);
+    const size_t unique_instanced_models = CreateInstancedModels(bsp, device, scene, instancedfaces);
 
     rtcSetGeometryIntersectFilterFunction(rtcGetGeometry(scene, filtergeom.geomID), Embree_FilterFuncN);
     rtcSetGeometryOccludedFilterFunction(rtcGetGeometry(scene, filtergeom.geomID), Embree_FilterFuncN);
 
     rtcCommitScene(scene);
 
+    auto end = I_FloatTime();
+
+    size_t num_instanced_faces = 0;
+    for (auto &[modelinfo, faces] : instancedfaces) {
+        num_instanced_faces += faces.size();
+    }
+
     logging::funcprint("\n");
     logging::print("\t{} sky faces\n", skyfaces.size());
     logging::print("\t{} solid faces\n", solidfaces.size());
     logging::print("\t{} filtered faces\n", filterfaces.size());
     logging::print("\t{} shadow-casting skip faces\n", skipwindings.size());
+    logging::print("\t{} instanced bmodel faces ({} bmodels, {} unique)\n", num_instanced_faces,
+        instancedfaces.size(), unique_instanced_models);
+    logging::print("\t{:.3} seconds building BVH\n", end - start);
 }
 
 static void AddGlassToRay(RTCIntersectContext *context, unsigned rayIndex, float opacity, const qvec3d &glasscolor)
@@ -715,6 +887,192 @@ static void AddDynamicOccluderToRay(RTCIntersectContext *context, unsigned rayIn
     }
 }
 
+/*
+ * Packet tracing
+ *
+ * Rays are sorted by direction octant, then by the Morton code of their
+ * origin, so that each packet holds rays that will take similar paths
+ * through the BVH. Packets never mix octants.
+ */
+
+struct packet_order_t
+{
+    std::vector<std::pair<uint64_t, uint32_t>> keys;
+};
+
+static uint64_t Embree_SpreadBits(uint64_t v)
+{
+    // spread the low 21 bits of v out to every third bit
+    v &= 0x1fffff;
+    v = (v | (v << 32)) & 0x1f00000000ffffull;
+    v = (v | (v << 16)) & 0x1f0000ff0000ffull;
+    v = (v | (v << 8)) & 0x100f00f00f00f00full;
+    v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+    v = (v | (v << 2)) & 0x1249249249249249ull;
+    return v;
+}
+
+template<typename GetRay>
+static void Embree_SortRaysForPackets(packet_order_t &order, size_t count, GetRay get_ray)
+{
+    order.keys.resize(count);
+
+    qvec3f mins{std::numeric_limits<float>::max()}, maxs{std::numeric_limits<float>::lowest()};
+
+    for (size_t i = 0; i < count; i++) {
+        const RTCRay &ray = get_ray(i);
+        mins = qv::min(mins, qvec3f{ray.org_x, ray.org_y, ray.org_z});
+        maxs = qv::max(maxs, qvec3f{ray.org_x, ray.org_y, ray.org_z});
+    }
+
+    // 20 bits per axis leaves the top bits for the octant
+    const qvec3f extent = maxs - mins;
+    const float scale = static_cast<float>((1 << 20) - 1) / std::max({extent[0], extent[1], extent[2], 1.0f});
+
+    for (size_t i = 0; i < count; i++) {
+        const RTCRay &ray = get_ray(i);
+        const uint64_t octant = (ray.dir_x < 0 ? 1 : 0) | (ray.dir_y < 0 ? 2 : 0) | (ray.dir_z < 0 ? 4 : 0);
+        const uint64_t morton = Embree_SpreadBits(static_cast<uint64_t>((ray.org_x - mins[0]) * scale)) |
+                                (Embree_SpreadBits(static_cast<uint64_t>((ray.org_y - mins[1]) * scale)) << 1) |
+                                (Embree_SpreadBits(static_cast<uint64_t>((ray.org_z - mins[2]) * scale)) << 2);
+
+        order.keys[i] = {(octant << 60) | morton, static_cast<uint32_t>(i)};
+    }
+
+    std::sort(order.keys.begin(), order.keys.end());
+}
+
+template<typename Packet>
+static void Embree_PackRay(Packet &packet, size_t lane, const RTCRay &ray)
+{
+    packet.org_x[lane] = ray.org_x;
+    packet.org_y[lane] = ray.org_y;
+    packet.org_z[lane] = ray.org_z;
+    packet.tnear[lane] = ray.tnear;
+    packet.dir_x[lane] = ray.dir_x;
+    packet.dir_y[lane] = ray.dir_y;
+    packet.dir_z[lane] = ray.dir_z;
+    packet.time[lane] = ray.time;
+    packet.tfar[lane] = ray.tfar;
+    packet.mask[lane] = ray.mask;
+    // the id is the index into the ray stream, used by the filter functions
+    packet.id[lane] = ray.id;
+    packet.flags[lane] = ray.flags;
+}
+
+template<typename Packet>
+static void Embree_UnpackHit(const Packet &packet, size_t lane, RTCHit &hit)
+{
+    hit.Ng_x = packet.Ng_x[lane];
+    hit.Ng_y = packet.Ng_y[lane];
+    hit.Ng_z = packet.Ng_z[lane];
+    hit.u = packet.u[lane];
+    hit.v = packet.v[lane];
+    hit.primID = packet.primID[lane];
+    hit.geomID = packet.geomID[lane];
+    hit.instID[0] = packet.instID[0][lane];
+}
+
+/*
+ * Calls trace(valid, lanes, n) for each packet of at most `width` rays;
+ * `lanes` holds the indices of the rays in the packet.
+ */
+template<size_t width, typename GetRay, typename Trace>
+static void Embree_TracePackets(size_t count, GetRay get_ray, Trace trace)
+{
+    thread_local packet_order_t order;
+
+    Embree_SortRaysForPackets(order, count, get_ray);
+
+    std::array<uint32_t, width> lanes;
+    alignas(64) std::array<int, width> valid;
+
+    for (size_t i = 0; i < count;) {
+        const uint64_t octant = order.keys[i].first >> 60;
+        size_t n = 0;
+
+        for (; n < width && i < count && (order.keys[i].first >> 60) == octant; n++, i++) {
+            lanes[n] = order.keys[i].second;
+        }
+
+        for (size_t lane = 0; lane < width; lane++) {
+            valid[lane] = lane < n ? -1 : 0;
+        }
+
+        trace(valid.data(), lanes.data(), n);
+    }
+}
+
+template<size_t width, typename RayHitPacket, typename Intersect>
+static void Embree_IntersectPackets(ray_source_info *ctx, RTCRayHit *rays, size_t count, Intersect intersect)
+{
+    Embree_TracePackets<width>(
+        count, [&](size_t i) -> const RTCRay & { return rays[i].ray; },
+        [&](const int *valid, const uint32_t *lanes, size_t n) {
+            RayHitPacket packet;
+
+            for (size_t lane = 0; lane < n; lane++) {
+                Embree_PackRay(packet.ray, lane, rays[lanes[lane]].ray);
+                packet.hit.geomID[lane] = RTC_INVALID_GEOMETRY_ID;
+                packet.hit.primID[lane] = RTC_INVALID_GEOMETRY_ID;
+                packet.hit.instID[0][lane] = RTC_INVALID_GEOMETRY_ID;
+            }
+
+            intersect(valid, scene, ctx, &packet);
+
+            for (size_t lane = 0; lane < n; lane++) {
+                RTCRayHit &ray = rays[lanes[lane]];
+                ray.ray.tfar = packet.ray.tfar[lane];
+                Embree_UnpackHit(packet.hit, lane, ray.hit);
+            }
+        });
+}
+
+template<size_t width, typename RayPacket, typename Occluded>
+static void Embree_OccludedPackets(ray_source_info *ctx, RTCRay *rays, size_t count, Occluded occluded)
+{
+    Embree_TracePackets<width>(
+        count, [&](size_t i) -> const RTCRay & { return rays[i]; },
+        [&](const int *valid, const uint32_t *lanes, size_t n) {
+            RayPacket packet;
+
+            for (size_t lane = 0; lane < n; lane++) {
+                Embree_PackRay(packet, lane, rays[lanes[lane]]);
+            }
+
+            occluded(valid, scene, ctx, &packet);
+
+            // occluded rays get tfar set to -inf
+            for (size_t lane = 0; lane < n; lane++) {
+                rays[lanes[lane]].tfar = packet.tfar[lane];
+            }
+        });
+}
+
+void Embree_IntersectStream(ray_source_info *ctx, RTCRayHit *rays, size_t count)
+{
+    switch (light_options.raypackets.value()) {
+        case raypackets_t::PACKET8:
+            Embree_IntersectPackets<8, RTCRayHit8>(ctx, rays, count, rtcIntersect8);
+            break;
+        case raypackets_t::PACKET16:
+            Embree_IntersectPackets<16, RTCRayHit16>(ctx, rays, count, rtcIntersect16);
+            break;
+        case raypackets_t::NONE:
+        default: rtcIntersect1M(scene, ctx, rays, count, sizeof(rays[0])); break;
+    }
+}
+
+void Embree_OccludedStream(ray_source_info *ctx, RTCRay *rays, size_t count)
+{
+    switch (light_options.raypackets.value()) {
+        case raypackets_t::PACKET8: Embree_OccludedPackets<8, RTCRay8>(ctx, rays, count, rtcOccluded8); break;
+        case raypackets_t::PACKET16: Embree_OccludedPackets<16, RTCRay16>(ctx, rays, count, rtcOccluded16); break;
+        case raypackets_t::NONE:
+        default: rtcOccluded1M(scene, ctx, rays, count, sizeof(rays[0])); break;
+    }
+}
+
 ray_source_info::ray_source_info(raystream_embree_common_t *raystream_, const modelinfo_t *self_, int shadowmask_)
     : raystream(raystream_),
       self(self_),
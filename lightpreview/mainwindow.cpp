@@ -50,6 +50,7 @@ See file, 'COPYING', for details.
 #include <QApplication>
 
 #include <common/bspfile.hh>
+#include <compile/compile.hh>
 #include <qbsp/qbsp.hh>
 #include <vis/vis.hh>
 #include <light/light.hh>
@@ -478,67 +479,29 @@ bspdata_t MainWindow::QbspVisLight_Common(const std::filesystem::path &name, std
                                             ETLogWidget::logTabNames[(int32_t)m_activeLogTab]));
     };
 
-    auto bsp_path = name;
-    bsp_path.replace_extension(".bsp");
+    compile_options_t options;
+    options.qbsp_args = std::move(extra_qbsp_args);
+    options.vis_args = std::move(extra_vis_args);
+    options.light_args = std::move(extra_light_args);
+    options.run_vis = run_vis;
 
-    std::vector<std::string> args{
-        "", // the exe path, which we're ignoring in this case
-    };
-    for (auto &extra : extra_qbsp_args) {
-        args.push_back(extra);
-    }
-    args.push_back(name.string());
-
-    // run qbsp
-    m_activeLogTab = ETLogTab::TAB_BSP;
-
-    InitQBSP(args);
-    ProcessFile();
-
-    resetActiveTabText();
-
-    // run vis
-    if (run_vis) {
-        m_activeLogTab = ETLogTab::TAB_VIS;
-        std::vector<std::string> vis_args{
-            "", // the exe path, which we're ignoring in this case
-        };
-        for (auto &extra : extra_vis_args) {
-            vis_args.push_back(extra);
+    // route each tool's output to its log tab
+    options.stage_callback = [&](compile_stage_t stage) {
+        if (stage != compile_stage_t::qbsp) {
+            resetActiveTabText();
         }
-        vis_args.push_back(name.string());
-        vis_main(vis_args);
-    }
 
-    resetActiveTabText();
-
-    // run light
-    {
-        m_activeLogTab = ETLogTab::TAB_LIGHT;
-        std::vector<std::string> light_args{
-            "", // the exe path, which we're ignoring in this case
-        };
-        for (auto &arg : extra_light_args) {
-            light_args.push_back(arg);
+        switch (stage) {
+            case compile_stage_t::qbsp: m_activeLogTab = ETLogTab::TAB_BSP; break;
+            case compile_stage_t::vis: m_activeLogTab = ETLogTab::TAB_VIS; break;
+            case compile_stage_t::light: m_activeLogTab = ETLogTab::TAB_LIGHT; break;
+            case compile_stage_t::done: m_activeLogTab = ETLogTab::TAB_LIGHTPREVIEW; break;
         }
-        light_args.push_back(name.string());
-
-        light_main(light_args);
-    }
-
-    resetActiveTabText();
-
-    m_activeLogTab = ETLogTab::TAB_LIGHTPREVIEW;
-
-    // serialize obj
-    {
-        bspdata_t bspdata;
-        LoadBSPFile(bsp_path, &bspdata);
-
-        ConvertBSPFormat(&bspdata, &bspver_generic);
+    };
 
-        return bspdata;
-    }
+    // the stages hand the bsp to each other in memory, and we get the lit result
+    // back directly rather than re-loading the .bsp
+    return CompileMap(name, options);
 }
 
 static std::vector<std::string> ParseArgs(const QLineEdit *line_edit)
@@ -1219,7 +1219,7 @@ BrushBSP
 */
 void BrushBSP(tree_t &tree, mapentity_t &entity, const bspbrush_t::container &brushlist, tree_split_t split_type)
 {
-    logging::header(__func__);
+    logging::funcheader();
 
     if (brushlist.empty()) {
         /*
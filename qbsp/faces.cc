@@ -31,6 +31,9 @@
 
 #include <list>
 
+#include <tbb/parallel_for.h>
+#include <tbb/task_group.h>
+
 struct makefaces_stats_t : logging::stat_tracker_t
 {
     stat &c_nodefaces = register_stat("makefaces"); // FIXME: what is "makefaces" exactly
@@ -70,16 +73,24 @@ static void MergeNodeFaces(node_t *node, makefaces_stats_t &stats)
     node->facelist = MergeFaceList(std::move(node->facelist), stats.c_merge);
 }
 
+struct emit_vertices_stats_t : logging::stat_tracker_t
+{
+    stat &unique_vertices = register_stat("vertices");
+    stat &welded_vertices = register_stat("vertices welded");
+    stat &time_emit = register_stat("ms emitting vertices");
+};
+
 /*
 =============
 EmitVertex
 =============
 */
-inline void EmitVertex(const qvec3d &vert, size_t &vert_id)
+inline void EmitVertex(const qvec3d &vert, size_t &vert_id, emit_vertices_stats_t &stats)
 {
     // already added
     if (auto v = map.find_emitted_hash_vector(vert)) {
         vert_id = *v;
+        stats.welded_vertices++;
         return;
     }
 
@@ -87,39 +98,65 @@ inline void EmitVertex(const qvec3d &vert, size_t &vert_id)
     map.add_hash_vector(vert, vert_id = map.bsp.dvertexes.size());
 
     map.bsp.dvertexes.emplace_back(vert);
-}
-
-// output final vertices
-static void EmitFaceVertices(face_t *f)
-{
-    if (ShouldOmitFace(f)) {
-        return;
-    }
 
-    f->original_vertices.resize(f->w.size());
-
-    for (size_t i = 0; i < f->w.size(); i++) {
-        EmitVertex(f->w[i], f->original_vertices[i]);
-    }
+    stats.unique_vertices++;
 }
 
-static void EmitVertices_R(node_t *node)
+static void GatherNodeFaces_R(node_t *node, std::vector<face_t *> &faces)
 {
     if (node->is_leaf) {
         return;
     }
 
     for (auto &f : node->facelist) {
-        EmitFaceVertices(f.get());
+        faces.push_back(f.get());
     }
 
-    EmitVertices_R(node->children[0]);
-    EmitVertices_R(node->children[1]);
+    GatherNodeFaces_R(node->children[0], faces);
+    GatherNodeFaces_R(node->children[1], faces);
 }
 
+/*
+=============
+EmitVertices
+
+Output final vertices. The faces are gathered in tree order and
+checked for omission in parallel; the weld itself is done in that
+same order afterwards, since epsilon welds depend on which vertex
+came first and the numbering has to stay deterministic.
+=============
+*/
 void EmitVertices(node_t *headnode)
 {
-    EmitVertices_R(headnode);
+    logging::funcheader();
+
+    emit_vertices_stats_t stats;
+    auto start = I_FloatTime();
+
+    std::vector<face_t *> faces;
+    GatherNodeFaces_R(headnode, faces);
+
+    std::vector<uint8_t> omitted(faces.size());
+
+    tbb::parallel_for(static_cast<size_t>(0), faces.size(), [&](size_t i) {
+        if (!(omitted[i] = ShouldOmitFace(faces[i]))) {
+            faces[i]->original_vertices.resize(faces[i]->w.size());
+        }
+    });
+
+    for (size_t i = 0; i < faces.size(); i++) {
+        if (omitted[i]) {
+            continue;
+        }
+
+        face_t *f = faces[i];
+
+        for (size_t v = 0; v < f->w.size(); v++) {
+            EmitVertex(f->w[v], f->original_vertices[v], stats);
+        }
+    }
+
+    stats.time_emit += std::chrono::duration_cast<std::chrono::milliseconds>(I_FloatTime() - start).count();
 }
 
 //===========================================================================
@@ -128,6 +165,7 @@ struct emit_faces_stats_t : logging::stat_tracker_t
 {
     stat &unique_edges = register_stat("edges");
     stat &unique_faces = register_stat("faces");
+    stat &time_emit = register_stat("ms emitting edges and faces");
 };
 
 /*
@@ -144,12 +182,11 @@ inline int64_t GetEdge(const size_t &v1, const size_t &v2, const face_t *face, e
 
     if (!qbsp_options.noedgereuse.value()) {
         // search for existing edges
-        if (auto it = map.hashedges.find(std::make_pair(v2, v1)); it != map.hashedges.end()) {
-            const hashedge_t &existing = it->second;
+        if (const hashedge_t *existing = map.find_hash_edge(v2, v1)) {
             // this content check is required for software renderers
             // (see q1_liquid_software test case)
-            if (existing.face->contents.front.equals(qbsp_options.target_game, face->contents.front)) {
-                return -existing.edge_index;
+            if (existing->face->contents.front.equals(qbsp_options.target_game, face->contents.front)) {
+                return -existing->edge_index;
             }
         }
     }
@@ -263,15 +300,18 @@ size_t EmitFaces(node_t *headnode)
 {
     logging::funcheader();
 
-    Q_assert(map.hashedges.empty());
+    Q_assert(map.hash_edges_empty());
 
     emit_faces_stats_t stats;
+    auto start = I_FloatTime();
 
     size_t firstface = map.bsp.dfaces.size();
 
     EmitFaces_R(headnode, stats);
 
-    map.hashedges.clear();
+    map.clear_hash_edges();
+
+    stats.time_emit += std::chrono::duration_cast<std::chrono::milliseconds>(I_FloatTime() - start).count();
 
     return firstface;
 }
@@ -497,7 +537,7 @@ static std::unique_ptr<face_t> FaceFromPortal(portal_t *p, bool pside)
 
 /*
 ===============
-MakeFaces_r
+MakeLeafFaces
 
 If a portal will make a visible face,
 mark the side that originally created it
@@ -506,27 +546,20 @@ mark the side that originally created it
   solid / water : solid
   water / empty : water
   water / water : none
+
+The faces are returned along with the node they belong on, rather
+than added to it directly, since both leafs of a portal can add to
+the same node.
 ===============
 */
-static void MakeFaces_r(node_t *node, makefaces_stats_t &stats)
+static std::vector<std::pair<node_t *, std::unique_ptr<face_t>>> MakeLeafFaces(
+    node_t *node, makefaces_stats_t &stats)
 {
-    // recurse down to leafs
-    if (!node->is_leaf) {
-        MakeFaces_r(node->children[0], stats);
-        MakeFaces_r(node->children[1], stats);
-
-        // merge together all visible faces on the node
-        if (!qbsp_options.nomerge.value())
-            MergeNodeFaces(node, stats);
-        if (qbsp_options.subdivide.boolValue())
-            SubdivideNodeFaces(node, stats);
-
-        return;
-    }
+    std::vector<std::pair<node_t *, std::unique_ptr<face_t>>> result;
 
     // solid leafs never have visible faces
     if (node->contents.is_any_solid(qbsp_options.target_game))
-        return;
+        return result;
 
     // see which portals are valid
 
@@ -541,9 +574,50 @@ static void MakeFaces_r(node_t *node, makefaces_stats_t &stats)
 
         if (f) {
             stats.c_nodefaces++;
-            p->onnode->facelist.push_back(std::move(f));
+            result.emplace_back(p->onnode, std::move(f));
         }
     }
+
+    return result;
+}
+
+static void GatherLeafs_R(node_t *node, std::vector<node_t *> &leafs)
+{
+    if (node->is_leaf) {
+        leafs.push_back(node);
+        return;
+    }
+
+    GatherLeafs_R(node->children[0], leafs);
+    GatherLeafs_R(node->children[1], leafs);
+}
+
+/*
+===============
+MergeAndSubdivide_R
+
+A portal's face only ever lands on a node above both of its leafs,
+so once every leaf is done each node's face list is complete and
+nodes can be processed independently.
+===============
+*/
+static void MergeAndSubdivide_R(node_t *node, makefaces_stats_t &stats)
+{
+    if (node->is_leaf) {
+        return;
+    }
+
+    tbb::task_group g;
+    g.run([&]() { MergeAndSubdivide_R(node->children[0], stats); });
+    g.run([&]() { MergeAndSubdivide_R(node->children[1], stats); });
+
+    // merge together all visible faces on the node
+    if (!qbsp_options.nomerge.value())
+        MergeNodeFaces(node, stats);
+    if (qbsp_options.subdivide.boolValue())
+        SubdivideNodeFaces(node, stats);
+
+    g.wait();
 }
 
 /*
@@ -557,5 +631,21 @@ void MakeFaces(node_t *node)
 
     makefaces_stats_t stats{};
 
-    MakeFaces_r(node, stats);
+    std::vector<node_t *> leafs;
+    GatherLeafs_R(node, leafs);
+
+    std::vector<std::vector<std::pair<node_t *, std::unique_ptr<face_t>>>> leaf_faces(leafs.size());
+
+    tbb::parallel_for(
+        static_cast<size_t>(0), leafs.size(), [&](size_t i) { leaf_faces[i] = MakeLeafFaces(leafs[i], stats); });
+
+    // add them in leaf order, so the face lists come out the
+    // same as a serial walk of the tree
+    for (auto &faces : leaf_faces) {
+        for (auto &[onnode, f] : faces) {
+            onnode->facelist.push_back(std::move(f));
+        }
+    }
+
+    MergeAndSubdivide_R(node, stats);
 }
@@ -44,6 +44,8 @@
 
 #include <pareto/spatial_map.h>
 
+#include <tbb/parallel_for.h>
+
 mapdata_t map;
 
 mapplane_t::mapplane_t(const qbsp_plane_t &copy)
@@ -57,15 +59,196 @@ struct planehash_t
     pareto::spatial_map<vec_t, 4, size_t> hash;
 };
 
+// mixes the bits of a packed key so linear probing doesn't cluster
+static inline uint64_t hash_key(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return key;
+}
+
 struct vertexhash_t
 {
-    // hashed vertices; generated by EmitVertices
-    pareto::spatial_map<vec_t, 3, size_t> hash;
+    // vertices are bucketed on a grid of POINT_EQUAL_EPSILON sized cells,
+    // so anything within HALF_EPSILON of a point is either in its cell or
+    // in the neighbouring cell on the near side of each axis (8 cells total).
+    static constexpr vec_t CELL_SIZE = POINT_EQUAL_EPSILON;
+    static constexpr vec_t HALF_EPSILON = POINT_EQUAL_EPSILON * 0.5;
+    static constexpr size_t EMPTY = std::numeric_limits<size_t>::max();
+
+    struct slot_t
+    {
+        uint64_t key;
+        size_t num = EMPTY;
+        qvec3d point;
+    };
+
+    // open addressing with linear probing; several vertices may share a
+    // cell key, so lookups walk every slot with a matching key until
+    // they hit an empty one. power-of-two sized.
+    std::vector<slot_t> slots = std::vector<slot_t>(1024);
+    size_t count = 0;
+
+    // the packed key wraps around on huge maps; that only causes extra
+    // collisions, since points are always compared exactly.
+    static uint64_t cell_key(int64_t x, int64_t y, int64_t z)
+    {
+        constexpr uint64_t mask = (1 << 21) - 1;
+        return (static_cast<uint64_t>(x) & mask) | ((static_cast<uint64_t>(y) & mask) << 21) |
+               ((static_cast<uint64_t>(z) & mask) << 42);
+    }
+
+    static uint64_t cell_key(const qvec3d &point)
+    {
+        return cell_key(static_cast<int64_t>(floor(point[0] / CELL_SIZE)),
+            static_cast<int64_t>(floor(point[1] / CELL_SIZE)), static_cast<int64_t>(floor(point[2] / CELL_SIZE)));
+    }
+
+    std::optional<size_t> find_in_cell(uint64_t key, const qvec3d &point) const
+    {
+        const size_t mask = slots.size() - 1;
+
+        for (size_t i = hash_key(key) & mask;; i = (i + 1) & mask) {
+            const slot_t &slot = slots[i];
+
+            if (slot.num == EMPTY) {
+                return std::nullopt;
+            } else if (slot.key == key && fabs(slot.point[0] - point[0]) <= HALF_EPSILON &&
+                       fabs(slot.point[1] - point[1]) <= HALF_EPSILON &&
+                       fabs(slot.point[2] - point[2]) <= HALF_EPSILON) {
+                return slot.num;
+            }
+        }
+    }
+
+    std::optional<size_t> find(const qvec3d &point) const
+    {
+        std::array<int64_t, 3> cell, neighbour;
+
+        for (size_t i = 0; i < 3; i++) {
+            vec_t c = point[i] / CELL_SIZE;
+            cell[i] = static_cast<int64_t>(floor(c));
+            // which side of the cell is the point closer to
+            neighbour[i] = (c - cell[i]) < 0.5 ? cell[i] - 1 : cell[i] + 1;
+        }
+
+        for (size_t n = 0; n < 8; n++) {
+            uint64_t key = cell_key((n & 1) ? neighbour[0] : cell[0], (n & 2) ? neighbour[1] : cell[1],
+                (n & 4) ? neighbour[2] : cell[2]);
+
+            if (auto num = find_in_cell(key, point)) {
+                return num;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    void insert(uint64_t key, const qvec3d &point, size_t num)
+    {
+        const size_t mask = slots.size() - 1;
+        size_t i = hash_key(key) & mask;
+
+        while (slots[i].num != EMPTY) {
+            i = (i + 1) & mask;
+        }
+
+        slots[i] = {key, num, point};
+    }
+
+    void insert(const qvec3d &point, size_t num)
+    {
+        // keep load factor under 1/2
+        if ((count + 1) * 2 > slots.size()) {
+            std::vector<slot_t> old = std::exchange(slots, std::vector<slot_t>(slots.size() * 2));
+
+            for (auto &slot : old) {
+                if (slot.num != EMPTY) {
+                    insert(slot.key, slot.point, slot.num);
+                }
+            }
+        }
+
+        insert(cell_key(point), point, num);
+        count++;
+    }
+};
+
+struct edgehash_t
+{
+    static constexpr int64_t EMPTY = std::numeric_limits<int64_t>::min();
+
+    // open addressing with linear probing, keyed on the packed (v1, v2)
+    // pair; edges are stored by value. power-of-two sized.
+    std::vector<hashedge_t> slots = std::vector<hashedge_t>(1024, hashedge_t{.edge_index = EMPTY});
+    size_t count = 0;
+
+    // vertex indices are written out as uint32_t, so this can't collide
+    static uint64_t edge_key(size_t v1, size_t v2) { return (static_cast<uint64_t>(v1) << 32) | v2; }
+
+    const hashedge_t *find(size_t v1, size_t v2) const
+    {
+        const size_t mask = slots.size() - 1;
+
+        for (size_t i = hash_key(edge_key(v1, v2)) & mask;; i = (i + 1) & mask) {
+            const hashedge_t &slot = slots[i];
+
+            if (slot.edge_index == EMPTY) {
+                return nullptr;
+            } else if (slot.v1 == v1 && slot.v2 == v2) {
+                return &slot;
+            }
+        }
+    }
+
+    // like std::map::emplace, existing entries are left alone
+    void insert_unique(const hashedge_t &edge)
+    {
+        const size_t mask = slots.size() - 1;
+        size_t i = hash_key(edge_key(edge.v1, edge.v2)) & mask;
+
+        for (; slots[i].edge_index != EMPTY; i = (i + 1) & mask) {
+            if (slots[i].v1 == edge.v1 && slots[i].v2 == edge.v2) {
+                return;
+            }
+        }
+
+        slots[i] = edge;
+        count++;
+    }
+
+    void insert(const hashedge_t &edge)
+    {
+        // keep load factor under 1/2
+        if ((count + 1) * 2 > slots.size()) {
+            std::vector<hashedge_t> old =
+                std::exchange(slots, std::vector<hashedge_t>(slots.size() * 2, hashedge_t{.edge_index = EMPTY}));
+            count = 0;
+
+            for (auto &slot : old) {
+                if (slot.edge_index != EMPTY) {
+                    insert_unique(slot);
+                }
+            }
+        }
+
+        insert_unique(edge);
+    }
+
+    void clear()
+    {
+        slots.assign(1024, hashedge_t{.edge_index = EMPTY});
+        count = 0;
+    }
 };
 
 mapdata_t::mapdata_t()
     : plane_hash(std::make_unique<planehash_t>()),
-      hashverts(std::make_unique<vertexhash_t>())
+      hashverts(std::make_unique<vertexhash_t>()),
+      hashedges(std::make_unique<edgehash_t>())
 {
 }
 
@@ -145,29 +328,35 @@ const qbsp_plane_t &mapdata_t::get_plane(size_t pnum)
 }
 
 // find output index for specified already-output vector.
-std::optional<size_t> mapdata_t::find_emitted_hash_vector(const qvec3d &vert)
+std::optional<size_t> mapdata_t::find_emitted_hash_vector(const qvec3d &vert) const
 {
-    constexpr vec_t HALF_EPSILON = POINT_EQUAL_EPSILON * 0.5;
-
-    if (auto it =
-            hashverts->hash.find_intersection({vert[0] - HALF_EPSILON, vert[1] - HALF_EPSILON, vert[2] - HALF_EPSILON},
-                {vert[0] + HALF_EPSILON, vert[1] + HALF_EPSILON, vert[2] + HALF_EPSILON});
-        it != hashverts->hash.end()) {
-        return it->second;
-    }
-
-    return std::nullopt;
+    return hashverts->find(vert);
 }
 
 // add vector to hash
 void mapdata_t::add_hash_vector(const qvec3d &point, const size_t &num)
 {
-    hashverts->hash.emplace(pareto::point<vec_t, 3>({point[0], point[1], point[2]}), num);
+    hashverts->insert(point, num);
+}
+
+const hashedge_t *mapdata_t::find_hash_edge(size_t v1, size_t v2) const
+{
+    return hashedges->find(v1, v2);
 }
 
 void mapdata_t::add_hash_edge(size_t v1, size_t v2, int64_t edge_index, const face_t *face)
 {
-    hashedges.emplace(std::make_pair(v1, v2), hashedge_t{.v1 = v1, .v2 = v2, .edge_index = edge_index, .face = face});
+    hashedges->insert(hashedge_t{.v1 = v1, .v2 = v2, .edge_index = edge_index, .face = face});
+}
+
+bool mapdata_t::hash_edges_empty() const
+{
+    return !hashedges->count;
+}
+
+void mapdata_t::clear_hash_edges()
+{
+    hashedges->clear();
 }
 
 const std::optional<img::texture_meta> &mapdata_t::load_image_meta(const std::string_view &name)
@@ -1419,8 +1608,8 @@ static void SetTexinfo_QuakeEd(const qbsp_plane_t &plane, const std::array<qvec3
     }
 }
 
-static void SetTexinfo_QuArK(
-    parser_t &parser, const std::array<qvec3d, 3> &planepts, texcoord_style_t style, maptexinfo_t *out)
+static void SetTexinfo_QuArK(const parser_source_location &location, const std::array<qvec3d, 3> &planepts,
+    texcoord_style_t style, maptexinfo_t *out)
 {
     int i;
     qvec3d vecs[2];
@@ -1441,7 +1630,7 @@ static void SetTexinfo_QuArK(
             vecs[0] = planepts[1] - planepts[0];
             vecs[1] = planepts[2] - planepts[0];
             break;
-        default: FError("{}: bad texture coordinate style", parser.location);
+        default: FError("{}: bad texture coordinate style", location);
     }
 
     vecs[0] *= 1.0 / 128.0;
@@ -1463,7 +1652,7 @@ static void SetTexinfo_QuArK(
      */
     determinant = a * d - b * c;
     if (fabs(determinant) < ZERO_EPSILON) {
-        logging::print("WARNING: {}: Face with degenerate QuArK-style texture axes\n", parser.location);
+        logging::print("WARNING: {}: Face with degenerate QuArK-style texture axes\n", location);
         for (i = 0; i < 3; i++)
             out->vecs.at(0, i) = out->vecs.at(1, i) = 0;
     } else {
@@ -1686,65 +1875,91 @@ parse_error:
     FError("{}: couldn't parse Brush Primitives texture info", parser.location);
 }
 
-static void ParseTextureDef(const mapentity_t &entity, parser_t &parser, mapface_t &mapface, const mapbrush_t &brush,
-    maptexinfo_t *tx, std::array<qvec3d, 3> &planepts, const qplane3d &plane, texture_def_issues_t &issue_stats)
-{
-    vec_t rotate;
-    qmat<vec_t, 2, 3> texMat, axis;
-    qvec2d shift, scale;
-    texcoord_style_t tx_type;
+/*
+================
+map_text_face_t / map_text_brush_t
 
+A brush as it was written in the .map, with the numbers parsed but
+before any planes, textures or texinfos were looked up. These can be
+produced in parallel, since they don't touch any global state.
+================
+*/
+struct map_text_face_t
+{
+    parser_source_location line;
+    std::array<qvec3d, 3> planepts{};
+    std::string texname;
+    texcoord_style_t tx_type = TX_QUAKED;
+    qmat<vec_t, 2, 3> texMat{}, axis{};
+    qvec2d shift{}, scale{};
+    vec_t rotate = 0;
     quark_tx_info_t extinfo;
+};
 
-    if (brush.format == brushformat_t::BRUSH_PRIMITIVES) {
-        ParseBrushPrimTX(parser, texMat);
-        tx_type = TX_BRUSHPRIM;
+struct map_text_brush_t
+{
+    brushformat_t format = brushformat_t::NORMAL;
+    parser_source_location line;
+    std::vector<map_text_face_t> faces;
+};
+
+static void ParseTextureDefText(parser_t &parser, map_text_face_t &face, brushformat_t format)
+{
+    if (format == brushformat_t::BRUSH_PRIMITIVES) {
+        ParseBrushPrimTX(parser, face.texMat);
+        face.tx_type = TX_BRUSHPRIM;
 
         parser.parse_token(PARSE_SAMELINE);
-        mapface.texname = parser.token;
+        face.texname = parser.token;
 
         // Read extra Q2 params
-        extinfo = ParseExtendedTX(parser);
-
-        mapface.raw_info = extinfo.info;
-    } else if (brush.format == brushformat_t::NORMAL) {
+        face.extinfo = ParseExtendedTX(parser);
+    } else if (format == brushformat_t::NORMAL) {
         parser.parse_token(PARSE_SAMELINE);
-        mapface.texname = parser.token;
+        face.texname = parser.token;
 
         parser.parse_token(PARSE_SAMELINE | PARSE_PEEK);
         if (parser.token == "[") {
-            ParseValve220TX(parser, axis, shift, rotate, scale);
-            tx_type = TX_VALVE_220;
+            ParseValve220TX(parser, face.axis, face.shift, face.rotate, face.scale);
+            face.tx_type = TX_VALVE_220;
 
             // Read extra Q2 params
-            extinfo = ParseExtendedTX(parser);
+            face.extinfo = ParseExtendedTX(parser);
         } else {
             parser.parse_token(PARSE_SAMELINE);
-            shift[0] = std::stod(parser.token);
+            face.shift[0] = std::stod(parser.token);
             parser.parse_token(PARSE_SAMELINE);
-            shift[1] = std::stod(parser.token);
+            face.shift[1] = std::stod(parser.token);
             parser.parse_token(PARSE_SAMELINE);
-            rotate = std::stod(parser.token);
+            face.rotate = std::stod(parser.token);
             parser.parse_token(PARSE_SAMELINE);
-            scale[0] = std::stod(parser.token);
+            face.scale[0] = std::stod(parser.token);
             parser.parse_token(PARSE_SAMELINE);
-            scale[1] = std::stod(parser.token);
+            face.scale[1] = std::stod(parser.token);
 
             // Read extra Q2 params and/or QuArK subtype
-            extinfo = ParseExtendedTX(parser);
-            if (extinfo.quark_tx1) {
-                tx_type = TX_QUARK_TYPE1;
-            } else if (extinfo.quark_tx2) {
-                tx_type = TX_QUARK_TYPE2;
+            face.extinfo = ParseExtendedTX(parser);
+            if (face.extinfo.quark_tx1) {
+                face.tx_type = TX_QUARK_TYPE1;
+            } else if (face.extinfo.quark_tx2) {
+                face.tx_type = TX_QUARK_TYPE2;
             } else {
-                tx_type = TX_QUAKED;
+                face.tx_type = TX_QUAKED;
             }
         }
-
-        mapface.raw_info = extinfo.info;
     } else {
         FError("{}: Bad brush format", parser.location);
     }
+}
+
+static void ParseTextureDef(const mapentity_t &entity, const map_text_face_t &text, mapface_t &mapface,
+    maptexinfo_t *tx, std::array<qvec3d, 3> &planepts, const qplane3d &plane, texture_def_issues_t &issue_stats)
+{
+    const texcoord_style_t tx_type = text.tx_type;
+    quark_tx_info_t extinfo = text.extinfo;
+
+    mapface.texname = text.texname;
+    mapface.raw_info = extinfo.info;
 
     // if we have texture defs, see if we should remap this one
     if (auto it = qbsp_options.loaded_texture_defs.find(mapface.texname);
@@ -1852,18 +2067,22 @@ static void ParseTextureDef(const mapentity_t &entity, parser_t &parser, mapface
 
     switch (tx_type) {
         case TX_QUARK_TYPE1:
-        case TX_QUARK_TYPE2: SetTexinfo_QuArK(parser, planepts, tx_type, tx); break;
-        case TX_VALVE_220: SetTexinfo_Valve220(axis, shift, scale, tx); break;
+        case TX_QUARK_TYPE2: SetTexinfo_QuArK(mapface.line, planepts, tx_type, tx); break;
+        case TX_VALVE_220: {
+            qmat<vec_t, 2, 3> axis = text.axis;
+            SetTexinfo_Valve220(axis, text.shift, text.scale, tx);
+            break;
+        }
         case TX_BRUSHPRIM: {
             const auto &texture = map.load_image_meta(mapface.texname.c_str());
             const int32_t width = texture ? texture->width : 64;
             const int32_t height = texture ? texture->height : 64;
 
-            SetTexinfo_BrushPrimitives(texMat, plane.normal, width, height, tx->vecs);
+            SetTexinfo_BrushPrimitives(text.texMat, plane.normal, width, height, tx->vecs);
             break;
         }
         case TX_QUAKED:
-        default: SetTexinfo_QuakeEd(plane, planepts, shift, rotate, scale, tx); break;
+        default: SetTexinfo_QuakeEd(plane, planepts, text.shift, text.rotate, text.scale, tx); break;
     }
 }
 
@@ -1958,24 +2177,21 @@ static void ValidateTextureProjection(mapface_t &mapface, maptexinfo_t *tx, text
 }
 
 static std::optional<mapface_t> ParseBrushFace(
-    parser_t &parser, const mapbrush_t &brush, const mapentity_t &entity, texture_def_issues_t &issue_stats)
+    const map_text_face_t &text, const mapentity_t &entity, texture_def_issues_t &issue_stats)
 {
-    std::array<qvec3d, 3> planepts;
     bool normal_ok;
     maptexinfo_t tx;
     int i, j;
     mapface_t face;
 
-    face.line = parser.location;
-
-    ParsePlaneDef(parser, planepts);
+    face.line = text.line;
 
-    normal_ok = face.set_planepts(planepts);
+    normal_ok = face.set_planepts(text.planepts);
 
-    ParseTextureDef(entity, parser, face, brush, &tx, face.planepts, face.get_plane(), issue_stats);
+    ParseTextureDef(entity, text, face, &tx, face.planepts, face.get_plane(), issue_stats);
 
     if (!normal_ok) {
-        logging::print("WARNING: {}: Brush plane with no normal\n", parser.location);
+        logging::print("WARNING: {}: Brush plane with no normal\n", face.line);
         return std::nullopt;
     }
 
@@ -2490,9 +2706,94 @@ static mapbrush_t CloneBrush(const mapbrush_t &input, bool faces = false)
     return brush;
 }
 
-static mapbrush_t ParseBrush(parser_t &parser, mapentity_t &entity, texture_def_issues_t &issue_stats)
+/*
+================
+ScanBrushText
+
+Skip over the text of a brush (the opening { has already been read)
+and return it, so it can be parsed later with ParseBrushText. This only
+looks at whitespace-separated { and } tokens, quotes and comments.
+================
+*/
+struct map_brush_span_t
 {
-    mapbrush_t brush;
+    std::string_view text;
+    parser_source_location location;
+};
+
+static map_brush_span_t ScanBrushText(parser_t &parser)
+{
+    map_brush_span_t span{{}, parser.location};
+    const char *start = parser.pos;
+    const char *&pos = parser.pos;
+    size_t depth = 1;
+
+    while (depth) {
+        // skip space
+        while (!parser.at_end() && *pos && *pos <= 32) {
+            if (*pos == '\n') {
+                parser.location.line_number.value()++;
+            }
+            pos++;
+        }
+
+        if (parser.at_end() || !*pos) {
+            FError("{}: unexpected EOF inside brush", span.location);
+        }
+
+        if ((pos[0] == '/' && pos[1] == '/') || pos[0] == ';') {
+            // comment; the newline is counted above
+            while (!parser.at_end() && *pos && *pos != '\n') {
+                pos++;
+            }
+        } else if (*pos == '"') {
+            // quoted token; see parser_t::parse_token
+            for (pos++; *pos != '"'; pos++) {
+                if (parser.at_end() || !*pos) {
+                    FError("{}: EOF inside quoted token", parser.location);
+                }
+                if (pos[0] == '\\') {
+                    // two-char escapes; same rules as parser_t::parse_token
+                    if ((pos[1] && strchr("n'rt\\b", pos[1])) || (pos[1] == '"' && pos[2] != '\r' && pos[2] != '\n')) {
+                        pos++;
+                    }
+                }
+            }
+            pos++;
+        } else {
+            const char *token = pos;
+
+            while (!parser.at_end() && *pos > 32) {
+                pos++;
+            }
+
+            if (pos - token == 1) {
+                if (*token == '{') {
+                    depth++;
+                } else if (*token == '}') {
+                    depth--;
+                }
+            }
+        }
+    }
+
+    span.text = std::string_view(start, pos - start);
+    return span;
+}
+
+/*
+================
+ParseBrushText
+
+Parse the text found by ScanBrushText. Thread-safe.
+================
+*/
+static map_text_brush_t ParseBrushText(const map_brush_span_t &span)
+{
+    parser_t parser(span.text, span.location);
+    parser.location = span.location;
+
+    map_text_brush_t brush;
 
     // ericw -- brush primitives
     if (!parser.parse_token(PARSE_PEEK))
@@ -2516,8 +2817,6 @@ static mapbrush_t ParseBrush(parser_t &parser, mapentity_t &entity, texture_def_
     }
     // ericw -- end brush primitives
 
-    bool is_hint = false;
-
     while (parser.parse_token()) {
 
         // set linenum after first parsed token
@@ -2528,7 +2827,45 @@ static mapbrush_t ParseBrush(parser_t &parser, mapentity_t &entity, texture_def_
         if (parser.token == "}")
             break;
 
-        std::optional<mapface_t> face = ParseBrushFace(parser, brush, entity, issue_stats);
+        map_text_face_t &face = brush.faces.emplace_back();
+
+        face.line = parser.location;
+
+        ParsePlaneDef(parser, face.planepts);
+        ParseTextureDefText(parser, face, brush.format);
+    }
+
+    // ericw -- brush primitives - there should be another closing }
+    if (brush.format == brushformat_t::BRUSH_PRIMITIVES) {
+        if (!parser.parse_token())
+            FError("Brush primitives: unexpected EOF (no closing brace)");
+        if (parser.token != "}")
+            FError("Brush primitives: Expected }}, got: {}", parser.token);
+    }
+    // ericw -- end brush primitives
+
+    return brush;
+}
+
+/*
+================
+ParseBrush
+
+Turn parsed brush text into a brush; this looks up planes, textures
+and texinfos, so it must be called in file order.
+================
+*/
+static mapbrush_t ParseBrush(const map_text_brush_t &text, mapentity_t &entity, texture_def_issues_t &issue_stats)
+{
+    mapbrush_t brush;
+
+    brush.format = text.format;
+    brush.line = text.line;
+
+    bool is_hint = false;
+
+    for (auto &text_face : text.faces) {
+        std::optional<mapface_t> face = ParseBrushFace(text_face, entity, issue_stats);
 
         if (!face) {
             continue;
@@ -2538,13 +2875,13 @@ static mapbrush_t ParseBrush(parser_t &parser, mapentity_t &entity, texture_def_
         bool discardFace = false;
         for (auto &check : brush.faces) {
             if (qv::epsilonEqual(check.get_plane(), face->get_plane())) {
-                logging::print("{}: Brush with duplicate plane\n", parser.location);
+                logging::print("{}: Brush with duplicate plane\n", face->line);
                 discardFace = true;
                 continue;
             }
             if (qv::epsilonEqual(-check.get_plane(), face->get_plane())) {
                 /* FIXME - this is actually an invalid brush */
-                logging::print("{}: Brush with duplicate plane\n", parser.location);
+                logging::print("{}: Brush with duplicate plane\n", face->line);
                 continue;
             }
         }
@@ -2586,13 +2923,13 @@ static mapbrush_t ParseBrush(parser_t &parser, mapentity_t &entity, texture_def_
     // check for region/antiregion brushes
     if (is_antiregion) {
         if (!map.is_world_entity(entity)) {
-            FError("Region brush at {} isn't part of the world entity", parser.token);
+            FError("Region brush at {} isn't part of the world entity", brush.line);
         }
 
         map.antiregions.push_back(CloneBrush(brush, true));
     } else if (is_region) {
         if (!map.is_world_entity(entity)) {
-            FError("Region brush at {} isn't part of the world entity", parser.token);
+            FError("Region brush at {} isn't part of the world entity", brush.line);
         }
 
         // construct region brushes
@@ -2651,7 +2988,7 @@ static mapbrush_t ParseBrush(parser_t &parser, mapentity_t &entity, texture_def_
         if (!map.region) {
             map.region = std::move(brush);
         } else {
-            FError("Multiple region brushes detected; newest at {}", parser.token);
+            FError("Multiple region brushes detected; newest at {}", brush.line);
         }
 
         return brush;
@@ -2670,15 +3007,6 @@ static mapbrush_t ParseBrush(parser_t &parser, mapentity_t &entity, texture_def_
         }
     }
 
-    // ericw -- brush primitives - there should be another closing }
-    if (brush.format == brushformat_t::BRUSH_PRIMITIVES) {
-        if (!parser.parse_token())
-            FError("Brush primitives: unexpected EOF (no closing brace)");
-        if (parser.token != "}")
-            FError("Brush primitives: Expected }}, got: {}", parser.token);
-    }
-    // ericw -- end brush primitives
-
     brush.contents = Brush_GetContents(entity, brush);
 
     return brush;
@@ -2704,6 +3032,11 @@ bool ParseEntity(parser_t &parser, mapentity_t &entity, texture_def_issues_t &is
 
     bool first_brush = false;
 
+    // brushes are only located here; they're parsed once the whole
+    // entity has been read. Note that this means brushes see all of the
+    // entity's keys, even ones that come after them in the file.
+    std::vector<map_brush_span_t> brush_spans;
+
     do {
         if (!parser.parse_token())
             FError("Unexpected EOF (no closing brace)");
@@ -2726,17 +3059,29 @@ bool ParseEntity(parser_t &parser, mapentity_t &entity, texture_def_issues_t &is
                     }
                 } while (parser.token != "}");
             } else {
-                auto brush = ParseBrush(parser, entity, issue_stats);
-
-                if (brush.faces.size()) {
-                    entity.mapbrushes.push_back(std::move(brush));
-                }
+                brush_spans.push_back(ScanBrushText(parser));
             }
         } else {
             ParseEpair(parser, entity);
         }
     } while (1);
 
+    // tokenizing and number parsing is independent per brush...
+    std::vector<map_text_brush_t> brush_texts(brush_spans.size());
+
+    tbb::parallel_for(static_cast<size_t>(0), brush_spans.size(),
+        [&](size_t i) { brush_texts[i] = ParseBrushText(brush_spans[i]); });
+
+    // ...but plane, texture and texinfo lookups are done in file
+    // order so that their numbering stays deterministic
+    for (auto &text : brush_texts) {
+        auto brush = ParseBrush(text, entity, issue_stats);
+
+        if (brush.faces.size()) {
+            entity.mapbrushes.push_back(std::move(brush));
+        }
+    }
+
     // replace aliases
     auto alias_it = qbsp_options.loaded_entity_defs.find(entity.epairs.get("classname"));
 
@@ -3361,6 +3706,8 @@ void LoadMapFile(void)
                 return;
             }
 
+            logging::stats_input(qbsp_options.map_path, file->size());
+
             parser_t parser(file, {qbsp_options.map_path.string()});
 
             for (int i = 0;; i++) {
@@ -3385,6 +3732,8 @@ void LoadMapFile(void)
                 return;
             }
 
+            logging::stats_input(qbsp_options.add.value(), file->size());
+
             parser_t parser(file, {qbsp_options.add.value()});
 
             for (int i = 0;; i++) {
@@ -28,6 +28,10 @@
 #include <qbsp/map.hh>
 #include <qbsp/faces.hh>
 
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
 #ifdef PARANOID
 static void CheckColinear(face_t *f)
 {
@@ -162,44 +166,173 @@ static std::unique_ptr<face_t> TryMerge(const face_t *f1, const face_t *f2)
 
 /*
 ===============
-MergeFaceToList
+merge_group_t
+
+Faces that could possibly merge with each other: same plane, texinfo,
+lmshift and (for Q1) liquid/sky-ness. Faces already in the group are
+indexed by the grid cells their vertices fall in, so the candidates
+for a merge are just the faces sharing a (nearly) identical vertex.
 ===============
 */
-void MergeFaceToList(
-    std::unique_ptr<face_t> face, std::list<std::unique_ptr<face_t>> &list, logging::stat_tracker_t::stat &num_merged)
+struct merge_group_t
 {
-    for (auto it = list.begin(); it != list.end();) {
+    // larger than any epsilon TryMerge allows for
+    static constexpr vec_t CELL_SIZE = 1.0;
+
+    struct entry_t
+    {
+        std::unique_ptr<face_t> face; // nullptr once it got merged into something else
+        size_t stamp; // index of the input face that added this
+    };
+
+    // in the order they were added, which is the order of the
+    // result list in the unsorted algorithm
+    std::vector<entry_t> entries;
+    std::unordered_map<uint64_t, std::vector<size_t>> cells;
+
+    static uint64_t cell_key(int64_t x, int64_t y, int64_t z)
+    {
+        constexpr uint64_t mask = (1 << 21) - 1;
+        return (static_cast<uint64_t>(x) & mask) | ((static_cast<uint64_t>(y) & mask) << 21) |
+               ((static_cast<uint64_t>(z) & mask) << 42);
+    }
+
+    // add every entry that has a vertex within QBSP_EQUAL_EPSILON of
+    // any of `face`'s vertices to `candidates`
+    void find_candidates(const face_t *face, std::vector<size_t> &candidates) const
+    {
+        candidates.clear();
+
+        for (auto &p : face->w) {
+            qvec<int64_t, 3> lo, hi;
+
+            for (size_t i = 0; i < 3; i++) {
+                lo[i] = static_cast<int64_t>(floor((p[i] - QBSP_EQUAL_EPSILON) / CELL_SIZE));
+                hi[i] = static_cast<int64_t>(floor((p[i] + QBSP_EQUAL_EPSILON) / CELL_SIZE));
+            }
+
+            for (int64_t x = lo[0]; x <= hi[0]; x++) {
+                for (int64_t y = lo[1]; y <= hi[1]; y++) {
+                    for (int64_t z = lo[2]; z <= hi[2]; z++) {
+                        if (auto it = cells.find(cell_key(x, y, z)); it != cells.end()) {
+                            for (size_t e : it->second) {
+                                if (entries[e].face) {
+                                    candidates.push_back(e);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // try them in the order they were added
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    }
+
+    void add(std::unique_ptr<face_t> face, size_t stamp)
+    {
+        size_t index = entries.size();
+
+        for (auto &p : face->w) {
+            auto &cell = cells[cell_key(static_cast<int64_t>(floor(p[0] / CELL_SIZE)),
+                static_cast<int64_t>(floor(p[1] / CELL_SIZE)), static_cast<int64_t>(floor(p[2] / CELL_SIZE)))];
+
+            if (cell.empty() || cell.back() != index) {
+                cell.push_back(index);
+            }
+        }
+
+        entries.push_back({std::move(face), stamp});
+    }
+
+    /*
+    ===============
+    merge
+
+    Merge `face` into the group, repeatedly merging the result with
+    the earliest-added face that accepts it, then add it.
+    ===============
+    */
+    void merge(std::unique_ptr<face_t> face, size_t stamp, logging::stat_tracker_t::stat &num_merged)
+    {
+        std::vector<size_t> candidates;
+
+        while (true) {
+            find_candidates(face.get(), candidates);
+
+            std::unique_ptr<face_t> newf;
+
+            for (size_t e : candidates) {
 #ifdef PARANOID
-        CheckColinear(f);
+                CheckColinear(face.get());
 #endif
-        std::unique_ptr<face_t> newf = TryMerge(face.get(), it->get());
+                if ((newf = TryMerge(face.get(), entries[e].face.get()))) {
+                    entries[e].face.reset();
+                    break;
+                }
+            }
+
+            if (!newf) {
+                break;
+            }
 
-        if (newf) {
-            list.erase(it);
-            // restart, now trying to merge `newf` into the list
+            // restart, now trying to merge `newf` into the group
             face = std::move(newf);
-            it = list.begin();
             num_merged++;
-        } else {
-            it++;
         }
-    }
 
-    list.emplace_back(std::move(face));
-}
+        add(std::move(face), stamp);
+    }
+};
 
 /*
 ===============
 MergeFaceList
+
+Only faces in the same merge group can ever merge, so each group is
+merged on its own. Each input face ends up appending exactly one face
+to the result, so sorting the survivors by the index of the input face
+that appended them gives the same order as merging the whole list at once.
 ===============
 */
 std::list<std::unique_ptr<face_t>> MergeFaceList(
     std::list<std::unique_ptr<face_t>> input, logging::stat_tracker_t::stat &num_merged)
 {
-    std::list<std::unique_ptr<face_t>> result;
+    using group_key_t = std::tuple<size_t, int, int16_t, bool, bool>;
+    std::map<group_key_t, merge_group_t> groups;
+
+    size_t stamp = 0;
 
     for (auto &face : input) {
-        MergeFaceToList(std::move(face), result, num_merged);
+        group_key_t key{face->planenum, face->texinfo, face->original_side->lmshift, false, false};
+
+        // see TryMerge
+        if (qbsp_options.target_game->id != GAME_QUAKE_II) {
+            std::get<3>(key) = face->contents[0].is_liquid(qbsp_options.target_game);
+            std::get<4>(key) = face->contents[0].is_sky(qbsp_options.target_game);
+        }
+
+        groups[key].merge(std::move(face), stamp++, num_merged);
+    }
+
+    std::vector<merge_group_t::entry_t> merged;
+
+    for (auto &[key, group] : groups) {
+        for (auto &entry : group.entries) {
+            if (entry.face) {
+                merged.push_back(std::move(entry));
+            }
+        }
+    }
+
+    std::sort(merged.begin(), merged.end(), [](auto &a, auto &b) { return a.stamp < b.stamp; });
+
+    std::list<std::unique_ptr<face_t>> result;
+
+    for (auto &entry : merged) {
+        result.push_back(std::move(entry.face));
     }
 
     return result;
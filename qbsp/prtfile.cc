@@ -23,6 +23,7 @@
 
 #include <common/log.hh>
 #include <common/ostream.hh>
+#include <common/prtfile.hh>
 #include <qbsp/map.hh>
 #include <qbsp/portals.hh>
 #include <qbsp/qbsp.hh>
@@ -38,15 +39,14 @@ PORTAL FILE GENERATION
 ==============================================================================
 */
 
-static void WriteFloat(std::ofstream &portalFile, vec_t v)
+static vec_t SnapPortalFloat(vec_t v)
 {
     if (fabs(v - Q_rint(v)) < ZERO_EPSILON)
-        ewt::print(portalFile, "{} ", (int)Q_rint(v));
-    else
-        ewt::print(portalFile, "{} ", v);
+        return Q_rint(v);
+    return v;
 }
 
-static void WritePortals_r(node_t *node, std::ofstream &portalFile, bool clusters)
+static void AddPortals_r(node_t *node, prtfile_t &prtfile, bool clusters)
 {
     const portal_t *p, *next;
     const winding_t *w;
@@ -54,8 +54,8 @@ static void WritePortals_r(node_t *node, std::ofstream &portalFile, bool cluster
     qplane3d plane2;
 
     if (!node->is_leaf && !node->detail_separator) {
-        WritePortals_r(node->children[0], portalFile, clusters);
-        WritePortals_r(node->children[1], portalFile, clusters);
+        AddPortals_r(node->children[0], prtfile, clusters);
+        AddPortals_r(node->children[1], prtfile, clusters);
         return;
     }
     // at this point, `node` may be a leaf or a cluster
@@ -82,6 +82,8 @@ static void WritePortals_r(node_t *node, std::ofstream &portalFile, bool cluster
                 back_contents.to_string(qbsp_options.target_game), w->center());
         }
 
+        prtfile_portal_t &portal = prtfile.portals.emplace_back();
+
         /*
          * sometimes planes get turned around when they are very near the
          * changeover point between different axis.  interpret the plane the
@@ -89,35 +91,36 @@ static void WritePortals_r(node_t *node, std::ofstream &portalFile, bool cluster
          */
         plane2 = w->plane();
         if (qv::dot(p->plane.get_normal(), plane2.normal) < 1.0 - ANGLEEPSILON) {
-            ewt::print(portalFile, "{} {} {} ", w->size(), back, front);
+            portal.leafnums[0] = back;
+            portal.leafnums[1] = front;
         } else {
-            ewt::print(portalFile, "{} {} {} ", w->size(), front, back);
+            portal.leafnums[0] = front;
+            portal.leafnums[1] = back;
         }
 
+        // round the points the same way writing them to the .prt would, so vis
+        // gets the same input whether or not it goes through the file
+        portal.winding.resize(w->size());
         for (i = 0; i < w->size(); i++) {
-            ewt::print(portalFile, "(");
-            WriteFloat(portalFile, w->at(i)[0]);
-            WriteFloat(portalFile, w->at(i)[1]);
-            WriteFloat(portalFile, w->at(i)[2]);
-            ewt::print(portalFile, ") ");
+            portal.winding[i][0] = SnapPortalFloat(w->at(i)[0]);
+            portal.winding[i][1] = SnapPortalFloat(w->at(i)[1]);
+            portal.winding[i][2] = SnapPortalFloat(w->at(i)[2]);
         }
-        ewt::print(portalFile, "\n");
     }
 }
 
-static int WritePTR2ClusterMapping_r(node_t *node, std::ofstream &portalFile, int viscluster)
+static int AddClusterMapping_r(node_t *node, prtfile_t &prtfile, int viscluster)
 {
     if (!node->is_leaf) {
-        viscluster = WritePTR2ClusterMapping_r(node->children[0], portalFile, viscluster);
-        viscluster = WritePTR2ClusterMapping_r(node->children[1], portalFile, viscluster);
+        viscluster = AddClusterMapping_r(node->children[0], prtfile, viscluster);
+        viscluster = AddClusterMapping_r(node->children[1], prtfile, viscluster);
         return viscluster;
     }
     if (node->is_leaf && node->contents.is_any_solid(qbsp_options.target_game))
         return viscluster;
 
-    /* If we're in the next cluster, start a new line */
+    /* If we're in the next cluster, start a new one */
     if (node->viscluster != viscluster) {
-        ewt::print(portalFile, "-1\n");
         viscluster++;
     }
 
@@ -125,7 +128,7 @@ static int WritePTR2ClusterMapping_r(node_t *node, std::ofstream &portalFile, in
     if (node->viscluster != viscluster)
         FError("Internal error: Detail cluster mismatch");
 
-    ewt::print(portalFile, "{} ", node->visleafnum);
+    prtfile.dleafinfos[node->visleafnum + 1].cluster = viscluster;
 
     return viscluster;
 }
@@ -194,62 +197,61 @@ static void NumberLeafs_r(node_t *node, portal_state_t &state, int cluster)
 
 /*
 ================
-WritePortalfile
+MakePortalfile
+
+Builds the portal data the way vis would load it from the .prt file
 ================
 */
-static void WritePortalfile(node_t *headnode, portal_state_t &state)
+static prtfile_t MakePortalfile(node_t *headnode, portal_state_t &state)
 {
-    int check;
-
     /*
      * Set the visleafnum and viscluster field in every leaf and count the
      * total number of portals.
      */
     NumberLeafs_r(headnode, state, -1);
 
-    // write the file
-    fs::path name = qbsp_options.bsp_path;
-    name.replace_extension("prt");
-
-    std::ofstream portalFile(name, std::ios_base::out); // .prt files are intentionally text mode
-    if (!portalFile)
-        FError("Failed to open {}: {}", name, strerror(errno));
+    prtfile_t prtfile{};
+    prtfile.portals.reserve(state.num_visportals.count.load());
 
     // q2 uses a PRT1 file, but with clusters.
     // (Since q2bsp natively supports clusters, we don't need PRT2.)
     if (qbsp_options.target_game->id == GAME_QUAKE_II) {
-        ewt::print(portalFile, "PRT1\n");
-        ewt::print(portalFile, "{}\n", state.num_visclusters.count.load());
-        ewt::print(portalFile, "{}\n", state.num_visportals.count.load());
-        WritePortals_r(headnode, portalFile, true);
-        return;
+        prtfile.portalleafs = state.num_visclusters.count.load();
+        prtfile.portalleafs_real = 0;
+        AddPortals_r(headnode, prtfile, true);
+        return prtfile;
     }
 
-    /* If no detail clusters, just use a normal PRT1 format */
-    if (!state.uses_detail) {
-        ewt::print(portalFile, "PRT1\n");
-        ewt::print(portalFile, "{}\n", state.num_visleafs.count.load());
-        ewt::print(portalFile, "{}\n", state.num_visportals.count.load());
-        WritePortals_r(headnode, portalFile, false);
-    } else if (qbsp_options.forceprt1.value()) {
-        /* Write a PRT1 file for loading in the map editor. Vis will reject it. */
-        ewt::print(portalFile, "PRT1\n");
-        ewt::print(portalFile, "{}\n", state.num_visclusters.count.load());
-        ewt::print(portalFile, "{}\n", state.num_visportals.count.load());
-        WritePortals_r(headnode, portalFile, true);
-    } else {
-        /* Write a PRT2 */
-        ewt::print(portalFile, "PRT2\n");
-        ewt::print(portalFile, "{}\n", state.num_visleafs.count.load());
-        ewt::print(portalFile, "{}\n", state.num_visclusters.count.load());
-        ewt::print(portalFile, "{}\n", state.num_visportals.count.load());
-        WritePortals_r(headnode, portalFile, true);
-        check = WritePTR2ClusterMapping_r(headnode, portalFile, 0);
-        if (check != state.num_visclusters.count.load() - 1) {
-            FError("Internal error: Detail cluster mismatch");
+    if (!state.uses_detail || qbsp_options.forceprt1.value()) {
+        /* If no detail clusters, just use a normal PRT1 format */
+        /* -forceprt1 writes a PRT1 file for loading in the map editor. Vis will reject it. */
+        const bool clusters = state.uses_detail;
+
+        prtfile.portalleafs = prtfile.portalleafs_real =
+            clusters ? state.num_visclusters.count.load() : state.num_visleafs.count.load();
+        AddPortals_r(headnode, prtfile, clusters);
+
+        // identity cluster numbers, same as LoadPrtFile assigns for a PRT1
+        prtfile.dleafinfos.resize(prtfile.portalleafs + 1);
+        for (int i = 0; i < prtfile.portalleafs; i++) {
+            prtfile.dleafinfos[i + 1].cluster = i;
         }
-        ewt::print(portalFile, "-1\n");
+        return prtfile;
     }
+
+    /* PRT2 */
+    prtfile.has_cluster_map = true;
+    prtfile.portalleafs_real = state.num_visleafs.count.load();
+    prtfile.portalleafs = state.num_visclusters.count.load();
+    AddPortals_r(headnode, prtfile, true);
+
+    prtfile.dleafinfos.resize(prtfile.portalleafs_real + 1);
+    int check = AddClusterMapping_r(headnode, prtfile, 0);
+    if (check != state.num_visclusters.count.load() - 1) {
+        FError("Internal error: Detail cluster mismatch");
+    }
+
+    return prtfile;
 }
 
 /*
@@ -277,8 +279,19 @@ void WritePortalFile(tree_t &tree)
 
     portal_state_t state{};
 
+    prtfile_t prtfile = MakePortalfile(tree.headnode, state);
+
+    // the in-process compile pipeline hands this to vis directly
+    if (map.keep_output) {
+        map.output_prt = std::move(prtfile);
+        return;
+    }
+
     /* save portal file for vis tracing */
-    WritePortalfile(tree.headnode, state);
+    fs::path name = qbsp_options.bsp_path;
+    name.replace_extension("prt");
+
+    WritePrtFile(name, prtfile);
 }
 
 /*
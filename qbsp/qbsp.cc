@@ -516,6 +516,8 @@ qbsp_settings::qbsp_settings()
           {{"none", tjunclevel_t::NONE}, {"rotate", tjunclevel_t::ROTATE}, {"retopologize", tjunclevel_t::RETOPOLOGIZE},
               {"mwt", tjunclevel_t::MWT}},
           &debugging_group, "T-junction fix level"},
+      mwtmaxverts{this, "mwtmaxverts", 128, 0, std::numeric_limits<int32_t>::max(), &debugging_group,
+          "faces with more vertices than this (after T-junction fixing) skip MWT and are fanned instead; 0 for no limit"},
       objexport{
           this, "objexport", false, &debugging_group, "export the map file as .OBJ models during various CSG phases"},
       noextendedsurfflags{this, "noextendedsurfflags", false, &debugging_group, "suppress writing a .texinfo file"},
@@ -1562,6 +1564,8 @@ static void LoadTextureData()
         omemstream stream(miptex.data.data(), miptex.data.size());
         stream <= header;
     }
+
+    img::print_texture_cache_stats();
 }
 
 static void AddAnimationFrames()
@@ -51,6 +51,28 @@ struct tjunc_stats_t : logging::stat_tracker_t
     // # of faces that were created as a result of splitting faces that are too large
     // to be contained on a single face
     stat &faceoverflows = register_stat("faces added by splitting large faces");
+    // # of faces that had more vertices than -mwtmaxverts, and went
+    // straight to rotation/re-topology instead
+    stat &mwtskipped = register_stat("faces too large for MWT");
+    // timing; the per-face ones are summed across all threads
+    stat &time_index = register_stat("ms building vertex index");
+    stat &time_superface = register_stat("ms finding edge vertices (all threads)");
+    stat &time_mwt = register_stat("ms computing MWT (all threads)");
+
+    std::atomic<uint64_t> superface_usec = 0;
+    std::atomic<uint64_t> mwt_usec = 0;
+};
+
+// adds the time between construction and destruction to `total`, in microseconds
+struct tjunc_timer_t
+{
+    std::atomic<uint64_t> &total;
+    time_point start = I_FloatTime();
+
+    ~tjunc_timer_t()
+    {
+        total += std::chrono::duration_cast<std::chrono::microseconds>(I_FloatTime() - start).count();
+    }
 };
 
 static std::optional<vec_t> PointOnEdge(
@@ -138,77 +160,130 @@ static void FindEdgeVerts_BruteForce(
 }
 #endif
 
-/**
- * This is to prevent func_detail_wall touching solid from creating
- * tjunc fixes. func_detail_wall is meant to act like a separate mesh,
- * so it shouldn't interact with solid.
- */
-static bool HasTJuncInteraction(const face_t *f1, const face_t *f2)
+/*
+==========
+tjunc_vertex_index_t
+
+Spatial hash of every vertex referenced by a face that takes part
+in T-junction fixing, bucketed on a coarse grid. Built once up front
+so that each edge only has to look at the handful of cells its line
+passes through, instead of walking the BSP tree per edge.
+==========
+*/
+struct tjunc_vertex_index_t
 {
+    // large enough that most edges only touch a few cells,
+    // small enough that big open floors don't end up in one bucket
+    static constexpr vec_t CELL_SIZE = 64.0;
+
+    // which kind of faces reference a given vertex.
+    // This is to prevent func_detail_wall touching solid from creating
+    // tjunc fixes. func_detail_wall is meant to act like a separate mesh,
+    // so it shouldn't interact with solid.
     // FIXME: handle func_detail_fence, func_detail_illusionary,
     // liquids? make sure a combination of solid + func_detail_wall
     // is treated as solid?
+    static constexpr uint8_t FROM_SOLID = nth_bit(0);
+    static constexpr uint8_t FROM_DETAIL_WALL = nth_bit(1);
 
-    if (f1->contents.back.is_detail_wall(qbsp_options.target_game) &&
-        !f2->contents.back.is_detail_wall(qbsp_options.target_game))
-        return false;
-
-    if (f2->contents.back.is_detail_wall(qbsp_options.target_game) &&
-        !f1->contents.back.is_detail_wall(qbsp_options.target_game))
-        return false;
+    std::unordered_map<uint64_t, std::vector<size_t>> cells;
+    std::vector<uint8_t> vertex_flags;
 
-    return true;
-}
+    static qvec3i cell_for(const qvec3d &p)
+    {
+        return {static_cast<int32_t>(floor(p[0] / CELL_SIZE)), static_cast<int32_t>(floor(p[1] / CELL_SIZE)),
+            static_cast<int32_t>(floor(p[2] / CELL_SIZE))};
+    }
 
-/*
-==========
-FindEdgeVerts_FaceBounds_R
+    static uint64_t cell_key(int32_t x, int32_t y, int32_t z)
+    {
+        constexpr uint64_t mask = (1 << 21) - 1;
+        return (static_cast<uint64_t>(x) & mask) | ((static_cast<uint64_t>(y) & mask) << 21) |
+               ((static_cast<uint64_t>(z) & mask) << 42);
+    }
 
-Recursive function for matching nodes that intersect the aabb
-for vertex checking.
-==========
-*/
-static void FindEdgeVerts_FaceBounds_R(
-    const node_t *node, const face_t *f, const aabb3d &aabb, std::vector<size_t> &verts)
-{
-    if (node->is_leaf) {
-        return;
-    } else if (node->bounds.disjoint(aabb, 0.0)) {
-        return;
+    static uint8_t flag_for(const face_t *f)
+    {
+        return f->contents.back.is_detail_wall(qbsp_options.target_game) ? FROM_DETAIL_WALL : FROM_SOLID;
     }
 
-    for (auto &face : node->facelist) {
-        if (!HasTJuncInteraction(f, face.get()))
-            continue;
-        for (auto &v : face->original_vertices) {
-            if (aabb.containsPoint(map.bsp.dvertexes[v])) {
-                verts.push_back(v);
+    void build(const std::unordered_set<face_t *> &faces)
+    {
+        vertex_flags.assign(map.bsp.dvertexes.size(), 0);
+
+        for (auto *f : faces) {
+            const uint8_t flag = flag_for(f);
+
+            for (auto &v : f->original_vertices) {
+                // only bucket each vertex once
+                if (!vertex_flags[v]) {
+                    const qvec3i c = cell_for(map.bsp.dvertexes[v]);
+                    cells[cell_key(c[0], c[1], c[2])].push_back(v);
+                }
+
+                vertex_flags[v] |= flag;
             }
         }
     }
 
-    FindEdgeVerts_FaceBounds_R(node->children[0], f, aabb, verts);
-    FindEdgeVerts_FaceBounds_R(node->children[1], f, aabb, verts);
-}
+    /*
+    ==========
+    find_edge_verts
+
+    Use a loose AABB around the line and only capture vertices that intersect it.
+
+    f is the face we're fixing; this will affect the candidate other faces
+    because not everything has tjunc interactions (e.g. func_detail_wall and worldspawn.)
+    ==========
+    */
+    void find_edge_verts(const face_t *f, const qvec3d &p1, const qvec3d &p2, std::vector<size_t> &verts) const
+    {
+        const aabb3d bounds = (aabb3d{} + p1 + p2).grow(qvec3d(1.0, 1.0, 1.0));
+        const uint8_t wanted = flag_for(f);
+
+        // walk the line in cell-sized pieces, so long diagonal edges
+        // don't visit every cell in their bounding box
+        const size_t steps =
+            std::max(static_cast<size_t>(1), static_cast<size_t>(ceil(qv::distance(p1, p2) / CELL_SIZE)));
+        std::vector<uint64_t> keys;
+
+        for (size_t s = 0; s < steps; s++) {
+            const qvec3d a = p1 + (p2 - p1) * (static_cast<vec_t>(s) / steps);
+            const qvec3d b = p1 + (p2 - p1) * (static_cast<vec_t>(s + 1) / steps);
+            const aabb3d piece = (aabb3d{} + a + b).grow(qvec3d(1.0, 1.0, 1.0));
+            const qvec3i mins = cell_for(piece.mins());
+            const qvec3i maxs = cell_for(piece.maxs());
+
+            for (int32_t x = mins[0]; x <= maxs[0]; x++) {
+                for (int32_t y = mins[1]; y <= maxs[1]; y++) {
+                    for (int32_t z = mins[2]; z <= maxs[2]; z++) {
+                        keys.push_back(cell_key(x, y, z));
+                    }
+                }
+            }
+        }
 
-/*
-==========
-FindEdgeVerts_FaceBounds
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
 
-Use a loose AABB around the line and only capture vertices that intersect it.
+        for (auto key : keys) {
+            auto it = cells.find(key);
 
-f is the face we're fixing; this will affect the candidate other faces
-because not everything has tjunc interactions (e.g. func_detail_wall and worldspawn.)
-==========
-*/
-static void FindEdgeVerts_FaceBounds(
-    const node_t *headnode, const face_t *f, const qvec3d &p1, const qvec3d &p2, std::vector<size_t> &verts)
-{
-    // magic number, average of "usual" points per edge
-    verts.reserve(8);
+            if (it == cells.end()) {
+                continue;
+            }
 
-    FindEdgeVerts_FaceBounds_R(headnode, f, (aabb3d{} + p1 + p2).grow(qvec3d(1.0, 1.0, 1.0)), verts);
-}
+            for (auto &v : it->second) {
+                if ((vertex_flags[v] & wanted) && bounds.containsPoint(map.bsp.dvertexes[v])) {
+                    verts.push_back(v);
+                }
+            }
+        }
+
+        // keep the split order independent of hash iteration order
+        std::sort(verts.begin(), verts.end());
+    }
+};
 
 /*
 ==================
@@ -277,8 +352,9 @@ Generate a superface (the input face `f` but with all of the
 verts in the world added that lay on the line) and return it
 ==================
 */
-static std::vector<size_t> CreateSuperFace(node_t *headnode, face_t *f, tjunc_stats_t &stats)
+static std::vector<size_t> CreateSuperFace(const tjunc_vertex_index_t &index, face_t *f, tjunc_stats_t &stats)
 {
+    tjunc_timer_t timer{stats.superface_usec};
     std::vector<size_t> superface;
 
     superface.reserve(f->original_vertices.size() * 2);
@@ -297,7 +373,7 @@ static std::vector<size_t> CreateSuperFace(node_t *headnode, face_t *f, tjunc_st
         qvec3d e2 = map.bsp.dvertexes[v2];
 
         edge_verts.clear();
-        FindEdgeVerts_FaceBounds(headnode, f, edge_start, e2, edge_verts);
+        index.find_edge_verts(f, edge_start, e2, edge_verts);
 
         vec_t len;
         qvec3d edge_dir = qv::normalize(e2 - edge_start, len);
@@ -485,6 +561,16 @@ static std::vector<qvectri> minimum_weight_triangulation(
     std::vector<vec_t> T(n * n);
     std::vector<std::optional<size_t>> K(n * n);
 
+    // every edge length gets used O(n) times below, so
+    // compute them all once up front
+    std::vector<vec_t> D(n * n);
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            D[i + (j * n)] = D[j + (i * n)] = qv::distance(vertices[i], vertices[j]);
+        }
+    }
+
     // fill the table diagonally using the recurrence relation
     for (size_t diagonal = 0; diagonal < n; diagonal++) {
         for (size_t i = 0, j = diagonal; j < n; i++, j++) {
@@ -503,9 +589,7 @@ static std::vector<qvectri> minimum_weight_triangulation(
                 if (!TriangleIsValid(indices[i], indices[j], indices[k], 0.01)) {
                     weight = std::nexttoward(std::numeric_limits<vec_t>::max(), 0.0);
                 } else {
-                    weight = (qv::distance(vertices[i], vertices[j]) + qv::distance(vertices[j], vertices[k]) +
-                                 qv::distance(vertices[k], vertices[i])) +
-                             T[i + (k * n)] + T[k + (j * n)];
+                    weight = (D[i + (j * n)] + D[j + (k * n)] + D[k + (i * n)]) + T[i + (k * n)] + T[k + (j * n)];
                 }
                 vec_t &t_weight = T[i + (j * n)];
 
@@ -552,6 +636,7 @@ static std::vector<qvectri> minimum_weight_triangulation(
 static std::list<std::vector<size_t>> mwt_face(
     const face_t *f, const std::vector<size_t> &vertices, tjunc_stats_t &stats)
 {
+    tjunc_timer_t timer{stats.mwt_usec};
     const auto &p = f->get_plane();
     auto [u, v] = qv::MakeTangentAndBitangentUnnormalized(p.get_normal());
     qv::normalizeInPlace(u);
@@ -736,7 +821,7 @@ FixFaceEdges
 If the face has any T-junctions, fix them here.
 ==================
 */
-static void FixFaceEdges(node_t *headnode, face_t *f, tjunc_stats_t &stats)
+static void FixFaceEdges(const tjunc_vertex_index_t &index, face_t *f, tjunc_stats_t &stats)
 {
     // we were asked not to bother fixing any of the faces.
     if (qbsp_options.tjunc.value() == settings::tjunclevel_t::NONE) {
@@ -744,7 +829,7 @@ static void FixFaceEdges(node_t *headnode, face_t *f, tjunc_stats_t &stats)
         return;
     }
 
-    std::vector<size_t> superface = CreateSuperFace(headnode, f, stats);
+    std::vector<size_t> superface = CreateSuperFace(index, f, stats);
 
     if (superface.size() < 3) {
         // entire face collapsed
@@ -763,12 +848,18 @@ static void FixFaceEdges(node_t *headnode, face_t *f, tjunc_stats_t &stats)
     std::list<std::vector<size_t>> faces;
 
     // do MWT first; it will generate optimal results for everything.
+    // it's O(n^3) though, so very large faces fall back to fans.
     if (qbsp_options.tjunc.value() >= settings::tjunclevel_t::MWT) {
-        faces = mwt_face(f, superface, stats);
+        if (qbsp_options.mwtmaxverts.value() &&
+            superface.size() > static_cast<size_t>(qbsp_options.mwtmaxverts.value())) {
+            stats.mwtskipped++;
+        } else {
+            faces = mwt_face(f, superface, stats);
 
-        if (faces.size()) {
-            stats.mwt++;
-            stats.facemwt += faces.size() - 1;
+            if (faces.size()) {
+                stats.mwt++;
+                stats.facemwt += faces.size() - 1;
+            }
         }
     }
 
@@ -892,5 +983,21 @@ void TJunc(node_t *headnode)
 
     FindFaces_r(headnode, faces);
 
-    logging::parallel_for_each(faces, [&](auto &face) { FixFaceEdges(headnode, face, stats); });
+    tjunc_vertex_index_t index;
+
+    {
+        std::atomic<uint64_t> index_usec = 0;
+
+        {
+            tjunc_timer_t timer{index_usec};
+            index.build(faces);
+        }
+
+        stats.time_index += index_usec / 1000;
+    }
+
+    logging::parallel_for_each(faces, [&](auto &face) { FixFaceEdges(index, face, stats); });
+
+    stats.time_superface += stats.superface_usec / 1000;
+    stats.time_mwt += stats.mwt_usec / 1000;
 }
@@ -453,6 +453,8 @@ WriteBSPFile
 */
 static void WriteBSPFile()
 {
+    logging::trace_zone zone(__func__);
+
     bspdata_t bspdata{};
 
     bspdata.bsp = std::move(map.bsp);
@@ -502,6 +504,15 @@ static void WriteBSPFile()
 
     qbsp_options.bsp_path.replace_extension("bsp");
 
+    // the in-process compile pipeline hands this to vis/light directly
+    if (map.keep_output) {
+        PrintBSPFileSizes(&bspdata);
+
+        bspdata.file = qbsp_options.bsp_path;
+        map.output_bsp = std::move(bspdata);
+        return;
+    }
+
     WriteBSPFile(qbsp_options.bsp_path, &bspdata);
     logging::print("Wrote {}\n", qbsp_options.bsp_path);
 
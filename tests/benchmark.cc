@@ -1,9 +1,17 @@
 #include <nanobench.h>
 #include <doctest/doctest.h>
 #include <common/qvec.hh>
+#include <common/entdata.h>
+#include <common/parser.hh>
 #include <common/polylib.hh>
+#include <light/light.hh>
+#include <light/ltface.hh>
+#include <qbsp/qbsp.hh>
+#include "test_qbsp.hh"
+#include <testmaps.hh>
 
 #include <array>
+#include <string>
 #include <vector>
 
 TEST_CASE("winding" * doctest::test_suite("benchmark") * doctest::skip())
@@ -78,3 +86,70 @@ TEST_CASE("SplitFace" * doctest::test_suite("benchmark"))
     // run with doctest assertions, to validate that they actually work
     test_polylib(true);
 }
+
+TEST_CASE("light -raypackets" * doctest::test_suite("benchmark") * doctest::skip())
+{
+    LoadTestmapQ1("q1_mountain.map");
+    const std::string bsp_path = qbsp_options.bsp_path.string();
+
+    auto run_light = [&](const std::string &raypackets) {
+        light_main({"", "-nodefaultpaths", "-noverbose", "-raypackets", raypackets, bsp_path});
+        return total_light_rays + total_surflight_rays + total_bounce_rays;
+    };
+
+    ankerl::nanobench::Bench bench;
+    bench.title("light q1_mountain.map").unit("ray").epochs(3);
+
+    for (const std::string raypackets : {"none", "8", "16"}) {
+        // the ray count is the same for every run, so it's taken from a warmup run
+        const uint32_t rays = run_light(raypackets);
+
+        bench.batch(rays).run("-raypackets " + raypackets, [&]() { run_light(raypackets); });
+    }
+}
+
+TEST_CASE("parser_t" * doctest::test_suite("benchmark") * doctest::skip())
+{
+    const fs::path map_path = fs::path(testmaps_dir) / "quake_map_source" / "E3M5-test.map";
+    const fs::data map_data = fs::load(map_path);
+    REQUIRE(map_data);
+
+    ankerl::nanobench::Bench bench;
+    bench.title("parser_t " + map_path.filename().string()).unit("byte").batch(map_data->size());
+
+    bench.run("parse_token", [&]() {
+        parser_t parser(map_data, {map_path.string()});
+        size_t tokens = 0;
+
+        while (parser.parse_token()) {
+            tokens++;
+        }
+
+        ankerl::nanobench::doNotOptimizeAway(tokens);
+    });
+
+    // the pattern LoadMapFile uses for the end of an entity/brush
+    bench.run("parse_token with PARSE_PEEK", [&]() {
+        parser_t parser(map_data, {map_path.string()});
+        size_t tokens = 0;
+
+        while (parser.parse_token(PARSE_PEEK)) {
+            parser.parse_token();
+            tokens++;
+        }
+
+        ankerl::nanobench::doNotOptimizeAway(tokens);
+    });
+}
+
+TEST_CASE("entdict_t::find" * doctest::test_suite("benchmark") * doctest::skip())
+{
+    entdict_t dict{{"classname", "light"}, {"origin", "0 0 0"}, {"light", "300"}, {"_color", "1 0.5 0"},
+        {"wait", "2"}, {"delay", "1"}, {"targetname", "switch"}, {"style", "32"}};
+
+    ankerl::nanobench::Bench bench;
+    bench.title("entdict_t::find").relative(true);
+
+    bench.run("present key", [&]() { ankerl::nanobench::doNotOptimizeAway(dict.get("targetname")); });
+    bench.run("absent key", [&]() { ankerl::nanobench::doNotOptimizeAway(dict.has("_dirt")); });
+}
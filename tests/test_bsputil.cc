@@ -3,6 +3,7 @@
 #include <common/fs.hh>
 #include <common/decompile.hh>
 #include <common/bsputils.hh>
+#include <common/bspfile_q1.hh>
 #include <qbsp/map.hh>
 #include <bsputil/bsputil.hh>
 
@@ -73,4 +74,61 @@ TEST_SUITE("bsputil")
             CHECK(loaded_tex);
         }
     }
+
+    TEST_CASE("convert round trip")
+    {
+        const auto [bsp, bspx, prt] = LoadTestmapQ1("q1_cube.map");
+
+        bspdata_t bspdata;
+        bspdata.bsp = bsp;
+        bspdata.version = &bspver_generic;
+
+        REQUIRE(ConvertBSPFormat(&bspdata, &bspver_bsp2));
+        CHECK(std::holds_alternative<bsp2_t>(bspdata.bsp));
+
+        REQUIRE(ConvertBSPFormat(&bspdata, &bspver_generic));
+        const mbsp_t &converted = std::get<mbsp_t>(bspdata.bsp);
+
+        CHECK(converted.dentdata == bsp.dentdata);
+        CHECK(converted.dplanes.size() == bsp.dplanes.size());
+        CHECK(converted.dvertexes == bsp.dvertexes);
+        CHECK(converted.dleaffaces == bsp.dleaffaces);
+        CHECK(converted.dsurfedges == bsp.dsurfedges);
+        CHECK(converted.dfaces.size() == bsp.dfaces.size());
+        CHECK(converted.dmodels.size() == bsp.dmodels.size());
+    }
+
+    TEST_CASE("convert several files")
+    {
+        LoadTestmapQ1("q1_cube.map");
+
+        auto dir = std::filesystem::temp_directory_path() / "ericw-tools-test-convert";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+
+        // where LoadTestmapQ1 wrote it
+        const std::filesystem::path source = qbsp_options.bsp_path;
+        std::filesystem::copy_file(source, dir / "a.bsp");
+        std::filesystem::copy_file(source, dir / "b.bsp");
+
+        std::vector<std::string> arg_strings{"bsputil", "--convert", "bsp2", (dir / "a.bsp").string(),
+            (dir / "b.bsp").string()};
+        std::vector<char *> args;
+        for (auto &arg : arg_strings) {
+            args.push_back(arg.data());
+        }
+
+        CHECK(0 == bsputil_main(static_cast<int>(args.size()), args.data()));
+
+        for (std::filesystem::path converted : {dir / "a-bsp2.bsp", dir / "b-bsp2.bsp"}) {
+            INFO(converted.string());
+            REQUIRE(std::filesystem::exists(converted));
+
+            bspdata_t bspdata;
+            LoadBSPFile(converted, &bspdata);
+            CHECK(bspdata.version == &bspver_bsp2);
+        }
+
+        std::filesystem::remove_all(dir);
+    }
 }
@@ -1,13 +1,24 @@
 #include <doctest/doctest.h>
 
 #include <filesystem>
+#include <fstream>
 #include <common/bspfile.hh>
 #include <common/bspfile_q1.hh>
 #include <common/bspfile_q2.hh>
 #include <common/imglib.hh>
+#include <common/json.hh>
+#include <common/log.hh>
+#include <common/parallel.hh>
 #include <common/settings.hh>
 #include <testmaps.hh>
 
+#ifdef _WIN32
+#include <process.h> // for _getpid
+#define getpid _getpid
+#else
+#include <unistd.h> // for getpid
+#endif
+
 TEST_SUITE("common")
 {
 
@@ -268,6 +279,63 @@ TEST_SUITE("common")
         }
     }
 
+    TEST_CASE("fs directory index")
+    {
+        fs::clear();
+
+        auto dir = fs::addArchive(std::filesystem::path(testmaps_dir) / "q2_wal_metadata");
+        REQUIRE(dir);
+
+        INFO("lookups into directories are case-insensitive");
+        auto pos = fs::where("TEXTURES/E1U1/Test.WAL");
+        REQUIRE(pos);
+        CHECK(pos.archive == dir);
+
+        auto data = fs::load(pos);
+        REQUIRE(data);
+        CHECK(!data->empty());
+
+        CHECK(!fs::where("textures/e1u1/doesnotexist.wal"));
+
+        fs::clear();
+    }
+
+    TEST_CASE("fs directory archives follow directory symlinks")
+    {
+        auto root = std::filesystem::temp_directory_path() / "ericw-tools-test-fs-symlink";
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root / "real" / "sub");
+        std::filesystem::create_directories(root / "search");
+        std::ofstream(root / "real" / "sub" / "file.txt") << "data";
+
+        // creating symlinks needs extra privileges on Windows
+        std::error_code ec;
+        std::filesystem::create_directory_symlink(root / "real", root / "search" / "linked", ec);
+        if (ec) {
+            MESSAGE("can't create symlinks here, skipping");
+            return;
+        }
+
+        fs::clear();
+
+        auto dir = fs::addArchive(root / "search");
+        REQUIRE(dir);
+
+        auto pos = fs::where("LINKED/sub/File.txt");
+        REQUIRE(pos);
+        CHECK(pos.archive == dir);
+
+        auto data = fs::load(pos);
+        REQUIRE(data);
+        CHECK(data->size() == 4);
+
+        INFO("directories aren't found as files");
+        CHECK(!fs::where("linked/sub"));
+
+        fs::clear();
+        std::filesystem::remove_all(root);
+    }
+
     TEST_CASE("imglib png loader")
     {
         auto *game = bspver_q2.game;
@@ -293,6 +361,212 @@ TEST_SUITE("common")
         CHECK(texture->width_scale == 1);
         CHECK(texture->height_scale == 1);
     }
+
+    TEST_CASE("imglib texture cache")
+    {
+        auto *game = bspver_q2.game;
+        auto wal_metadata_path = std::filesystem::path(testmaps_dir) / "q2_wal_metadata";
+        auto cache_path = std::filesystem::temp_directory_path() / "ericw-tools-test-texturecache";
+        std::filesystem::remove_all(cache_path);
+
+        settings::common_settings settings;
+        settings.paths.add_value(wal_metadata_path.string(), settings::source::COMMANDLINE);
+        settings.texturecache.set_value(cache_path, settings::source::COMMANDLINE);
+
+        game->init_filesystem("placeholder.map", settings);
+
+        auto [decoded, _0, _1] = img::load_texture("e1u1/yellow32x32", false, game, settings);
+        REQUIRE(decoded);
+        CHECK(!std::filesystem::is_empty(cache_path));
+
+        // now it comes from the cache
+        auto [cached, _2, _3] = img::load_texture("e1u1/yellow32x32", false, game, settings);
+        REQUIRE(cached);
+        CHECK(cached->width == decoded->width);
+        CHECK(cached->height == decoded->height);
+        CHECK(cached->pixels == decoded->pixels);
+        CHECK(cached->meta.extension.value() == img::ext::STB);
+
+        auto [meta, _4, _5] = img::load_texture("e1u1/yellow32x32", true, game, settings);
+        REQUIRE(meta);
+        CHECK(meta->meta.width == 32);
+        CHECK(meta->pixels.empty());
+
+        std::filesystem::remove_all(cache_path);
+    }
+
+    TEST_CASE("imglib clear texture cache")
+    {
+        auto *game = bspver_q2.game;
+        auto wal_metadata_path = std::filesystem::path(testmaps_dir) / "q2_wal_metadata";
+        auto cache_path = std::filesystem::temp_directory_path() / "ericw-tools-test-cleartexturecache";
+        std::filesystem::remove_all(cache_path);
+
+        settings::common_settings settings;
+        settings.paths.add_value(wal_metadata_path.string(), settings::source::COMMANDLINE);
+        settings.texturecache.set_value(cache_path, settings::source::COMMANDLINE);
+
+        game->init_filesystem("placeholder.map", settings);
+
+        auto [decoded, _0, _1] = img::load_texture("e1u1/yellow32x32", false, game, settings);
+        REQUIRE(decoded);
+
+        // a temporary file left behind by a killed process, and files that aren't ours
+        std::ofstream(cache_path / "0123456789abcdef.tex.1234") << "partial";
+        std::ofstream(cache_path / "fedcba9876543210.tex") << "not a cache entry";
+        std::ofstream(cache_path / "notes.txt") << "keep me";
+
+        CHECK(img::clear_texture_cache(cache_path) == 2);
+
+        std::vector<std::string> remaining;
+        for (auto &entry : std::filesystem::directory_iterator(cache_path)) {
+            remaining.push_back(entry.path().filename().string());
+        }
+        std::sort(remaining.begin(), remaining.end());
+        CHECK(remaining == std::vector<std::string>{"fedcba9876543210.tex", "notes.txt"});
+
+        std::filesystem::remove_all(cache_path);
+    }
+}
+
+TEST_SUITE("logging")
+{
+    TEST_CASE("writer thread")
+    {
+        auto log_path = std::filesystem::temp_directory_path() / "ericw-tools-test-logging.log";
+
+        settings::common_settings settings;
+        logging::init(log_path, settings);
+
+        constexpr size_t count = 256;
+        logging::parallel_for(static_cast<size_t>(0), count, [](size_t i) { logging::print("line {}\n", i); });
+        logging::close();
+
+        std::ifstream file(log_path);
+        std::string line;
+        std::vector<bool> seen(count);
+
+        // skip the header
+        REQUIRE(std::getline(file, line));
+
+        while (std::getline(file, line)) {
+            size_t i = std::stoul(line.substr(strlen("line ")));
+            REQUIRE(i < count);
+            CHECK(!seen[i]);
+            seen[i] = true;
+        }
+
+        CHECK(std::all_of(seen.begin(), seen.end(), [](bool b) { return b; }));
+
+        file.close();
+        std::filesystem::remove(log_path);
+    }
+
+    TEST_CASE("trace file")
+    {
+        auto trace_path = std::filesystem::temp_directory_path() / "ericw-tools-test-trace.json";
+
+        auto system_us = []() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        };
+        const auto begin_us = system_us();
+
+        logging::trace_begin(trace_path);
+        {
+            logging::trace_zone outer("outer");
+            logging::parallel_for(static_cast<size_t>(0), static_cast<size_t>(16),
+                [](size_t) { logging::trace_zone inner("inner"); });
+        }
+        logging::close();
+
+        const auto end_us = system_us();
+
+        std::ifstream file(trace_path);
+        json trace = json::parse(file);
+        file.close();
+
+        size_t outer = 0, inner = 0;
+
+        for (auto &event : trace.at("traceEvents")) {
+            CHECK(event.at("pid").get<int64_t>() == getpid());
+
+            if (event.at("ph") != "X") {
+                continue;
+            }
+
+            // ts is wall-clock time, so traces from separate processes line up
+            CHECK(event.at("ts").get<double>() >= begin_us - 1);
+            CHECK(event.at("ts").get<double>() <= end_us + 1);
+            CHECK(event.at("dur").get<double>() >= 0);
+
+            if (event.at("name") == "outer") {
+                outer++;
+            } else if (event.at("name") == "inner") {
+                inner++;
+            }
+        }
+
+        CHECK(outer == 1);
+        CHECK(inner == 16);
+
+        std::filesystem::remove(trace_path);
+    }
+
+    TEST_CASE("stats file")
+    {
+        auto stats_path = std::filesystem::temp_directory_path() / "ericw-tools-test-stats.json";
+
+        logging::stats_begin(stats_path);
+        logging::stats_input("input.map", 1234);
+        {
+            logging::trace_zone phase("phase", true);
+            logging::trace_zone not_a_phase("not_a_phase");
+
+            struct test_stats_t : logging::stat_tracker_t
+            {
+                stat &things = register_stat("things");
+            } stats;
+
+            stats.things += 5;
+        }
+        {
+            // counted outside of any phase
+            struct test_stats_t : logging::stat_tracker_t
+            {
+                stat &others = register_stat("others");
+            } stats;
+
+            stats.others += 2;
+        }
+        logging::close();
+
+        std::ifstream file(stats_path);
+        json stats = json::parse(file);
+        file.close();
+
+        CHECK(stats.at("threads").get<size_t>() > 0);
+        CHECK(stats.at("wall_time").get<double>() >= 0);
+        CHECK(stats.at("peak_memory").get<uint64_t>() > 0);
+
+        REQUIRE(stats.at("inputs").size() == 1);
+        CHECK(stats.at("inputs")[0].at("path") == "input.map");
+        CHECK(stats.at("inputs")[0].at("size") == 1234);
+
+        REQUIRE(stats.at("phases").size() == 1);
+        CHECK(stats.at("phases")[0].at("name") == "phase");
+
+        REQUIRE(stats.at("stats").size() == 2);
+        CHECK(stats.at("stats")[0].at("name") == "things");
+        CHECK(stats.at("stats")[0].at("phase") == "phase");
+        CHECK(stats.at("stats")[0].at("count") == 5);
+        CHECK(stats.at("stats")[1].at("name") == "others");
+        CHECK(stats.at("stats")[1].at("phase").is_null());
+        CHECK(stats.at("stats")[1].at("count") == 2);
+
+        std::filesystem::remove(stats_path);
+    }
 }
 
 TEST_SUITE("qmat")
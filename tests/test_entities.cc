@@ -1,6 +1,11 @@
 #include <doctest/doctest.h>
 
 #include <light/entities.hh>
+#include <light/light.hh>
+
+#include "test_qbsp.hh"
+
+#include <thread>
 
 TEST_SUITE("entities")
 {
@@ -18,4 +23,104 @@ TEST_SUITE("entities")
         CHECK_FALSE(EntDict_CheckNoEmptyValues(nullptr, bad2));
         CHECK_FALSE(EntDict_CheckNoEmptyValues(nullptr, bad3));
     }
+
+    TEST_CASE("GetVector")
+    {
+        entdict_t dict{{"origin", "1 -2 3.5"}, {"scale", "2"}, {"empty", ""}};
+        qvec3d vec{};
+
+        CHECK(3 == dict.get_vector("origin", vec));
+        CHECK(vec == qvec3d{1, -2, 3.5});
+
+        CHECK(1 == dict.get_vector("scale", vec));
+        CHECK(vec == qvec3d{2, 0, 0});
+
+        // missing and empty keys read nothing and zero the output
+        CHECK(dict.get_vector("empty", vec) <= 0);
+        CHECK(vec == qvec3d{});
+        CHECK(dict.get_vector("missing", vec) <= 0);
+    }
+
+    TEST_CASE("entdict_t keeps insertion order")
+    {
+        entdict_t dict{{"classname", "light"}, {"origin", "0 0 0"}};
+        dict.set("light", "300");
+        dict.set("classname", "light_torch_small_walltorch");
+        dict.rename("origin", "_origin");
+        dict.remove("missing");
+
+        CHECK(dict == entdict_t{{"classname", "light_torch_small_walltorch"}, {"light", "300"}, {"_origin", "0 0 0"}});
+        CHECK(dict.get("light") == "300");
+        CHECK(!dict.has("origin"));
+        CHECK(!dict.has("a key no entity has ever had"));
+
+        // keys are case-sensitive
+        CHECK(!dict.has("Light"));
+
+        dict.remove("light");
+        CHECK(dict == entdict_t{{"classname", "light_torch_small_walltorch"}, {"_origin", "0 0 0"}});
+        CHECK(dict.get("_origin") == "0 0 0");
+    }
+
+    TEST_CASE("entdict_t finds keys interned after a failed lookup")
+    {
+        // each thread caches the keys it didn't find; interning a key has to expire that
+        entdict_t dict{{"classname", "info_null"}};
+        CHECK(!dict.has("_key_interned_later"));
+        CHECK(!dict.has("_key_interned_by_another_thread"));
+
+        dict.set("_key_interned_later", "1");
+        CHECK(dict.get("_key_interned_later") == "1");
+
+        entdict_t other;
+        std::thread([&other]() { other.set("_key_interned_by_another_thread", "2"); }).join();
+        CHECK(other.get("_key_interned_by_another_thread") == "2");
+        CHECK(!dict.has("_key_interned_by_another_thread"));
+    }
+
+    TEST_CASE("target and key/value lookups")
+    {
+        QbspVisLight_Q1("q1_light_targets.map", {"-lit"});
+
+        auto light_with = [](const std::string &key, const std::string &value) -> const light_t * {
+            for (auto &light : GetLights()) {
+                if (light->epairs->get(key) == value) {
+                    return light.get();
+                }
+            }
+            return nullptr;
+        };
+
+        SUBCASE("targets are case-insensitive, and the first matching targetname wins")
+        {
+            auto *targeting = light_with("target", "SPOT");
+            REQUIRE(targeting);
+            REQUIRE(targeting->targetent);
+            CHECK(targeting->targetent->get("targetname") == "Spot");
+            CHECK(targeting->targetent->get("origin") == "-200 100 100");
+        }
+
+        SUBCASE("lights sharing a targetname share a style")
+        {
+            auto *switch1 = light_with("origin", "-150 150 150");
+            auto *switch2 = light_with("origin", "-50 150 150");
+            auto *other = light_with("targetname", "other");
+            REQUIRE(switch1);
+            REQUIRE(switch2);
+            REQUIRE(other);
+
+            CHECK(switch1->style.value() >= light_options.compilerstyle_start.value());
+            CHECK(switch1->style.value() == switch2->style.value());
+            CHECK(switch1->style.value() != other->style.value());
+        }
+
+        SUBCASE("bmodel entities are found by \"model\" \"*N\"")
+        {
+            auto *wall = FindEntDictWithKeyPair("model", "*1");
+            REQUIRE(wall);
+            CHECK(wall->get("classname") == "func_wall");
+
+            CHECK(FindEntDictWithKeyPair("model", "*2") == nullptr);
+        }
+    }
 }
@@ -1,8 +1,11 @@
 #include <doctest/doctest.h>
 
 #include <light/light.hh>
+#include <light/lightgrid.hh>
+#include <light/ltface.hh>
 #include <light/surflight.hh>
 #include <common/bspinfo.hh>
+#include <compile/compile.hh>
 #include <qbsp/qbsp.hh>
 #include <testmaps.hh>
 #include <vis/vis.hh>
@@ -132,6 +135,131 @@ TEST_CASE("-world_units_per_luxel, -lightgrid")
     }
 }
 
+struct decoded_lightgrid_t
+{
+    qvec3f grid_dist;
+    qvec3i grid_size;
+    qvec3f grid_mins;
+
+    // indexed like lightgrid_raw_data; nullopt for occluded points, which includes
+    // the ones outside of every leaf
+    std::vector<std::optional<std::vector<std::pair<uint8_t, qvec3b>>>> points;
+};
+
+// decodes every point stored in a LIGHTGRID_OCTREE lump, ignoring the node structure
+static decoded_lightgrid_t DecodeLightgridOctree(const std::vector<uint8_t> &lump)
+{
+    auto stream = imemstream(lump.data(), lump.size());
+    stream >> endianness<std::endian::little>;
+
+    decoded_lightgrid_t result;
+    stream >= result.grid_dist;
+    stream >= result.grid_size;
+    stream >= result.grid_mins;
+
+    uint8_t num_styles;
+    uint32_t root_node;
+    stream >= num_styles;
+    stream >= root_node;
+
+    result.points.resize(result.grid_size[0] * result.grid_size[1] * result.grid_size[2]);
+
+    uint32_t num_nodes;
+    stream >= num_nodes;
+    stream.seekg(num_nodes * (sizeof(qvec3i) + 8 * sizeof(uint32_t)), std::ios_base::cur);
+
+    uint32_t num_leafs;
+    stream >= num_leafs;
+    for (uint32_t i = 0; i < num_leafs; ++i) {
+        qvec3i mins, size;
+        stream >= mins;
+        stream >= size;
+
+        for (int z = mins[2]; z < mins[2] + size[2]; ++z) {
+            for (int y = mins[1]; y < mins[1] + size[1]; ++y) {
+                for (int x = mins[0]; x < mins[0] + size[0]; ++x) {
+                    uint8_t used_styles;
+                    stream >= used_styles;
+
+                    if (used_styles == 0xff) {
+                        continue;
+                    }
+
+                    auto &point = result.points.at(x + result.grid_size[0] * (y + result.grid_size[1] * z));
+                    point.emplace();
+
+                    for (int j = 0; j < used_styles; ++j) {
+                        uint8_t style;
+                        qvec3b color;
+                        stream >= style;
+                        stream >= color;
+                        point->emplace_back(style, color);
+                    }
+                }
+            }
+        }
+    }
+
+    REQUIRE(stream.tellg() == static_cast<std::streamoff>(lump.size()));
+    return result;
+}
+
+TEST_CASE("-lightgrid_adaptive")
+{
+    constexpr int threshold = 8;
+
+    auto [dense_bsp, dense_bspx] = QbspVisLight_Q2("q2_light_cone.map", {"-lightgrid"});
+    const size_t dense_evaluated = lightgrid_evaluated_points;
+
+    auto [adaptive_bsp, adaptive_bspx] = QbspVisLight_Q2(
+        "q2_light_cone.map", {"-lightgrid", "-lightgrid_adaptive", std::to_string(threshold)});
+    const size_t adaptive_evaluated = lightgrid_evaluated_points;
+
+    REQUIRE(dense_bspx.contains("LIGHTGRID_OCTREE"));
+    REQUIRE(adaptive_bspx.contains("LIGHTGRID_OCTREE"));
+
+    const auto dense = DecodeLightgridOctree(dense_bspx.at("LIGHTGRID_OCTREE"));
+    const auto adaptive = DecodeLightgridOctree(adaptive_bspx.at("LIGHTGRID_OCTREE"));
+
+    // grid_dist, grid_size and grid_mins don't depend on how the points were computed
+    CHECK(dense.grid_dist == adaptive.grid_dist);
+    REQUIRE(dense.grid_size == adaptive.grid_size);
+    CHECK(dense.grid_mins == adaptive.grid_mins);
+
+    CHECK(dense_evaluated == dense.points.size());
+    CHECK(adaptive_evaluated < dense_evaluated);
+
+    for (size_t i = 0; i < dense.points.size(); ++i) {
+        CAPTURE(i);
+
+        auto &dense_point = dense.points[i];
+        auto &adaptive_point = adaptive.points[i];
+
+        REQUIRE(dense_point.has_value() == adaptive_point.has_value());
+        if (!dense_point) {
+            continue;
+        }
+
+        // a style can be missing from a cell's corners but reach its interior; that's only
+        // acceptable if it's within the threshold too, so a missing style counts as black
+        std::map<uint8_t, std::pair<qvec3b, qvec3b>> styles;
+        for (auto &[style, color] : *dense_point) {
+            styles[style].first = color;
+        }
+        for (auto &[style, color] : *adaptive_point) {
+            styles[style].second = color;
+        }
+
+        for (auto &[style, colors] : styles) {
+            INFO("style " << static_cast<int>(style));
+
+            for (int c = 0; c < 3; ++c) {
+                CHECK(std::abs(colors.first[c] - colors.second[c]) <= threshold);
+            }
+        }
+    }
+}
+
 TEST_CASE("emissive cube artifacts")
 {
     // A cube with surface flags "light", value "100", placed in a hallway.
@@ -238,9 +366,8 @@ static void CheckFaceLuxelsNonBlack(const mbsp_t &bsp, const mface_t &face)
     CheckFaceLuxels(bsp, face, [](qvec3b sample) { CHECK(sample[0] > 0); });
 }
 
-static void CheckFaceLuxelAtPoint(const mbsp_t *bsp, const dmodelh2_t *model, const qvec3b &expected_color,
-    const qvec3d &point, const qvec3d &normal = {0, 0, 0}, const std::vector<uint8_t> *lit = nullptr,
-    const bspxentries_t *bspx = nullptr)
+static qvec3b FaceLuxelAtPoint(const mbsp_t *bsp, const dmodelh2_t *model, const qvec3d &point,
+    const qvec3d &normal = {0, 0, 0}, const std::vector<uint8_t> *lit = nullptr, const bspxentries_t *bspx = nullptr)
 {
     auto *face = BSP_FindFaceAtPoint(bsp, model, point, normal);
     REQUIRE(face);
@@ -261,13 +388,15 @@ static void CheckFaceLuxelAtPoint(const mbsp_t *bsp, const dmodelh2_t *model, co
     const auto coord = extents.worldToLMCoord(point);
     const auto int_coord = qvec2i(round(coord[0]), round(coord[1]));
 
-    const qvec3b sample = LM_Sample(bsp, lit, extents, offset, int_coord);
-    INFO("world point: ", point);
-    INFO("lm coord: ", coord[0], ", ", coord[1]);
-    INFO("lm int_coord: ", int_coord[0], ", ", int_coord[1]);
-    INFO("face num: ", Face_GetNum(bsp, face));
+    return LM_Sample(bsp, lit, extents, offset, int_coord);
+}
 
-    CHECK(sample == expected_color);
+static void CheckFaceLuxelAtPoint(const mbsp_t *bsp, const dmodelh2_t *model, const qvec3b &expected_color,
+    const qvec3d &point, const qvec3d &normal = {0, 0, 0}, const std::vector<uint8_t> *lit = nullptr,
+    const bspxentries_t *bspx = nullptr)
+{
+    INFO("world point: ", point);
+    CHECK(FaceLuxelAtPoint(bsp, model, point, normal, lit, bspx) == expected_color);
 }
 
 TEST_CASE("emissive lights")
@@ -319,6 +448,72 @@ TEST_CASE("q2_dirt")
     CheckFaceLuxels(bsp, *face_under_lava, [](qvec3b sample) { CHECK(sample == qvec3b(96)); });
 }
 
+TEST_CASE("-dirtthreshold approximates full dirt with fewer rays")
+{
+    auto [full_bsp, full_bspx] = QbspVisLight_Q2("q2_dirt.map", {});
+    const uint32_t full_dirt_rays = total_dirt_rays;
+
+    auto [bsp, bspx] = QbspVisLight_Q2("q2_dirt.map", {"-dirtthreshold", "0.02"});
+    CHECK(total_dirt_rays > 0);
+    CHECK(total_dirt_rays < full_dirt_rays);
+
+    {
+        INFO("luxels where the first batch of rays was unanimous can differ a little, most don't differ at all");
+
+        REQUIRE(full_bsp.dlightdata.size() == bsp.dlightdata.size());
+        int max_difference = 0;
+        int64_t total_difference = 0;
+        for (size_t i = 0; i < bsp.dlightdata.size(); i++) {
+            const int difference = std::abs(full_bsp.dlightdata[i] - bsp.dlightdata[i]);
+            max_difference = std::max(max_difference, difference);
+            total_difference += difference;
+        }
+        CHECK(max_difference <= 32);
+        CHECK(static_cast<double>(total_difference) / bsp.dlightdata.size() <= 2.0);
+    }
+
+    // -dirtdebug tints by the number of rays: gray when all of them were cast,
+    // blue when the open areas stopped early, red towards the corners
+    auto count_tints = [](const mbsp_t &bsp) {
+        int gray = 0, blue = 0, red = 0;
+        for (size_t i = 0; i + 2 < bsp.dlightdata.size(); i += 3) {
+            const uint8_t r = bsp.dlightdata[i], g = bsp.dlightdata[i + 1], b = bsp.dlightdata[i + 2];
+            if (r == g && g == b) {
+                gray++;
+            } else if (b > r) {
+                blue++;
+            } else {
+                red++;
+            }
+        }
+        return std::make_tuple(gray, blue, red);
+    };
+
+    {
+        INFO("without a threshold every luxel casts every ray");
+
+        auto [debug_bsp, debug_bspx] = QbspVisLight_Q2("q2_dirt.map", {"-dirtdebug"});
+        auto [gray, blue, red] = count_tints(debug_bsp);
+        CHECK(gray > 0);
+        CHECK(blue == 0);
+        CHECK(red == 0);
+    }
+
+    {
+        INFO("with a threshold the open floor under the lava stops early");
+
+        auto [debug_bsp, debug_bspx] = QbspVisLight_Q2("q2_dirt.map", {"-dirtdebug", "-dirtthreshold", "0.02"});
+        auto [gray, blue, red] = count_tints(debug_bsp);
+        CHECK(blue > 0);
+        CHECK(red > 0);
+
+        auto *face_under_lava = BSP_FindFaceAtPoint(&debug_bsp, &debug_bsp.dmodels[0], {104, 112, 48});
+        REQUIRE(face_under_lava);
+
+        CheckFaceLuxels(debug_bsp, *face_under_lava, [](qvec3b sample) { CHECK(sample[2] > sample[0]); });
+    }
+}
+
 TEST_CASE("q2_light_translucency")
 {
     INFO("liquids cast translucent colored shadows (sampling texture) by default");
@@ -793,3 +988,156 @@ TEST_CASE("minlight doesn't bounce")
     auto [bsp, bspx, lit] = QbspVisLight_Q1("q1_minlight_nobounce.map", {"-lit"});
     CheckFaceLuxelAtPoint(&bsp, &bsp.dmodels[0], {50, 50, 50}, {0, 0, 0}, {0, 0, 1}, &lit);
 }
+
+TEST_CASE("-skydomeprobes approximates the full sky dome with fewer rays")
+{
+    // the full trace is the default
+    auto [full_bsp, full_bspx, full_lit] = QbspVisLight_Q1("phongtest2.map", {"-lit"});
+    CHECK(total_skydome_rays_skipped == 0);
+
+    auto [bsp, bspx, lit] = QbspVisLight_Q1("phongtest2.map", {"-skydomeprobes", "32", "-lit"});
+    CHECK(total_skydome_rays_skipped > 0);
+
+    // it's an approximation: points near a shadow edge can be classified wrongly, but
+    // only by a few of the dome's directions
+    auto max_difference = [](const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) {
+        REQUIRE(a.size() == b.size());
+        int result = 0;
+        for (size_t i = 0; i < a.size(); i++) {
+            result = std::max(result, std::abs(a[i] - b[i]));
+        }
+        return result;
+    };
+
+    CHECK(max_difference(full_bsp.dlightdata, bsp.dlightdata) <= 8);
+    CHECK(max_difference(full_lit, lit) <= 8);
+}
+
+TEST_CASE("lights sharing an origin reuse each other's shadow rays")
+{
+    // a light, a negative light and a switchable light at the same origin, plus one elsewhere
+    auto [uncached_bsp, uncached_bspx, uncached_lit] =
+        QbspVisLight_Q1("q1_light_shared_origin.map", {"-visibilitycache", "0", "-lit"});
+    const uint32_t uncached_rays = total_light_rays;
+    CHECK(total_light_rays_cached == 0);
+
+    auto [bsp, bspx, lit] = QbspVisLight_Q1("q1_light_shared_origin.map", {"-lit"});
+    CHECK(total_light_rays_cached > 0);
+    CHECK(total_light_rays < uncached_rays);
+
+    // the switchable light has its own style
+    CHECK(std::any_of(bsp.dfaces.begin(), bsp.dfaces.end(), [](const mface_t &face) { return face.styles[1] != 255; }));
+
+    // styles 0 and the switchable one are all in dlightdata / the .lit
+    REQUIRE(bsp.dfaces.size() == uncached_bsp.dfaces.size());
+    for (size_t i = 0; i < bsp.dfaces.size(); i++) {
+        CHECK(bsp.dfaces[i].styles == uncached_bsp.dfaces[i].styles);
+        CHECK(bsp.dfaces[i].lightofs == uncached_bsp.dfaces[i].lightofs);
+    }
+    CHECK(bsp.dlightdata == uncached_bsp.dlightdata);
+    CHECK(lit == uncached_lit);
+}
+
+TEST_CASE("-bvhinstancing and the BVH build flags don't change the lighting")
+{
+    // two identical func_walls with _shadow 1, which share one instanced scene
+    auto [ref_bsp, ref_bspx, ref_lit] = QbspVisLight_Q1("q1_light_instanced_bmodels.map", {"-lit"});
+
+    // both func_walls cast a shadow on the floor; a floor point at the same distance from the light isn't shadowed
+    CheckFaceLuxelAtPoint(&ref_bsp, &ref_bsp.dmodels[0], {0, 0, 0}, {-256, 144, 32}, {0, 0, 1}, &ref_lit);
+    CheckFaceLuxelAtPoint(&ref_bsp, &ref_bsp.dmodels[0], {0, 0, 0}, {-96, 144, 32}, {0, 0, 1}, &ref_lit);
+    CHECK(FaceLuxelAtPoint(&ref_bsp, &ref_bsp.dmodels[0], {-176, 64, 32}, {0, 0, 1}, &ref_lit)[0] > 0);
+
+    const std::vector<std::vector<std::string>> variants{{"-bvhinstancing"}, {"-bvhinstancing", "-bvhcompact"},
+        {"-bvhquality", "low"}, {"-bvhquality", "refit"}, {"-bvhrobust"}};
+
+    for (auto args : variants) {
+        std::string desc;
+        for (auto &arg : args) {
+            desc += arg + " ";
+        }
+        INFO(desc);
+
+        args.push_back("-lit");
+        auto [bsp, bspx, lit] = QbspVisLight_Q1("q1_light_instanced_bmodels.map", args);
+
+        CHECK(bsp.dlightdata == ref_bsp.dlightdata);
+        CHECK(lit == ref_lit);
+    }
+}
+
+TEST_CASE("-samplecache reuses sample points without changing the lighting")
+{
+    auto cache_path = fs::path(test_quake_maps_dir) / "phongtest2.lightpoints";
+    fs::remove(cache_path);
+
+    auto [ref_bsp, ref_bspx, ref_lit] = QbspVisLight_Q1("phongtest2.map", {});
+
+    // first run writes the cache, second run reads it
+    auto [write_bsp, write_bspx, write_lit] = QbspVisLight_Q1("phongtest2.map", {"-samplecache"});
+    CHECK(fs::exists(cache_path));
+    CHECK(total_samplecache_faces == 0);
+
+    auto [read_bsp, read_bspx, read_lit] = QbspVisLight_Q1("phongtest2.map", {"-samplecache"});
+    CHECK(total_samplecache_faces > 0);
+
+    CHECK(ref_bsp.dlightdata == write_bsp.dlightdata);
+    CHECK(ref_bsp.dlightdata == read_bsp.dlightdata);
+
+    fs::remove(cache_path);
+}
+
+TEST_CASE("-bounceiterations adds further bounces")
+{
+    auto [single_bsp, single_bspx, single_lit] = QbspVisLight_Q1("phongtest2.map", {"-bounce", "-lit"});
+    auto [multi_bsp, multi_bspx, multi_lit] =
+        QbspVisLight_Q1("phongtest2.map", {"-bounce", "-bounceiterations", "4", "-bounceconvergence", "0", "-lit"});
+
+    REQUIRE(single_lit.size() == multi_lit.size());
+
+    // later bounces only add light
+    size_t single_total = 0, multi_total = 0;
+    for (size_t i = 0; i < single_lit.size(); i++) {
+        single_total += single_lit[i];
+        multi_total += multi_lit[i];
+        CHECK(multi_lit[i] + 1 >= single_lit[i]);
+    }
+
+    CHECK(multi_total > single_total);
+}
+
+TEST_CASE("in-memory compile pipeline matches running the tools separately")
+{
+    auto [ref_bsp, ref_bspx, ref_lit] = QbspVisLight_Q1("qbsp_func_detail.map", {"-lit"}, runvis_t::yes);
+
+    auto wal_metadata_path = fs::path(testmaps_dir) / "q2_wal_metadata";
+
+    // a different name from the one QbspVisLight_Q1 used, so the two .lit files can be compared
+    auto bsp_path = fs::path(test_quake_maps_dir) / "qbsp_func_detail-compile.bsp";
+
+    compile_options_t options;
+    options.qbsp_args = {"-noverbose", "-path", wal_metadata_path.string()};
+    options.light_args = {"-nodefaultpaths", "-path", wal_metadata_path.string(), "-lit"};
+    options.output_path = bsp_path;
+    options.write_bsp = false;
+
+    bspdata_t bspdata = CompileMap(fs::path(testmaps_dir) / "qbsp_func_detail.map", options);
+    const mbsp_t &bsp = std::get<mbsp_t>(bspdata.bsp);
+
+    CHECK(bsp.loadversion == ref_bsp.loadversion);
+    CHECK(bsp.dvis.bits == ref_bsp.dvis.bits);
+    CHECK(bsp.dlightdata == ref_bsp.dlightdata);
+    CHECK(bsp.dentdata == ref_bsp.dentdata);
+
+    // Q1 leafs don't store their cluster, so only the in-memory copy has it; compare what
+    // actually ends up in the file
+    REQUIRE(bsp.dleafs.size() == ref_bsp.dleafs.size());
+    for (size_t i = 0; i < bsp.dleafs.size(); i++) {
+        CHECK(bsp.dleafs[i].visofs == ref_bsp.dleafs[i].visofs);
+    }
+
+    // -output puts everything next to the .bsp, and light still writes the .lit
+    CHECK(!fs::exists(bsp_path));
+    CHECK(fs::exists(fs::path(bsp_path).replace_extension("log")));
+    CHECK(LoadLitFile(fs::path(bsp_path).replace_extension("lit")) == ref_lit);
+}
@@ -972,6 +972,44 @@ TEST_CASE("tjunc_many_sided_face" * doctest::test_suite("testmaps_q1"))
     CHECK(2 == (faces_by_normal.at({0, 0, -1}).size()));
 }
 
+TEST_CASE("tjunc_many_sided_face mwtmaxverts" * doctest::test_suite("testmaps_q1"))
+{
+    auto ceiling_faces = [](const mbsp_t &bsp) {
+        std::vector<const mface_t *> result;
+        for (auto &face : bsp.dfaces) {
+            if (Face_Normal(&bsp, &face) == qvec3d{0, 0, -1}) {
+                result.push_back(&face);
+            }
+        }
+        return result;
+    };
+
+    // by default, MWT triangulates the ceiling and merges the triangles back into convex faces
+    {
+        const auto [bsp, bspx, prt] = LoadTestmapQ1("qbsp_tjunc_many_sided_face.map");
+
+        auto ceiling = ceiling_faces(bsp);
+        CHECK(ceiling.size() > 2);
+        for (auto *face : ceiling) {
+            CHECK(face->numedges <= 8);
+        }
+    }
+
+    // with the face limit set very low, MWT skips the ceiling and it takes the
+    // same fan path as "-tjunc rotate": 2 faces holding all of the T-junction vertices
+    {
+        const auto [bsp, bspx, prt] = LoadTestmapQ1("qbsp_tjunc_many_sided_face.map", {"-mwtmaxverts", "4"});
+
+        REQUIRE(prt.has_value());
+
+        auto ceiling = ceiling_faces(bsp);
+        REQUIRE(2 == ceiling.size());
+        for (auto *face : ceiling) {
+            CHECK(face->numedges > 4);
+        }
+    }
+}
+
 TEST_CASE("tjunc_angled_face" * doctest::test_suite("testmaps_q1"))
 {
     const auto [bsp, bspx, prt] = LoadTestmapQ1("q1_tjunc_angled_face.map");
@@ -335,6 +335,8 @@ static void RecursiveLeafFlow(int leafnum, threaddata_t *thread, pstack_t &prevs
 */
 void PortalFlow(visportal_t *p)
 {
+    logging::trace_zone zone(__func__);
+
     threaddata_t data{p->visbits};
 
     if (p->status != pstat_working)
@@ -384,6 +386,8 @@ static void SimpleFlood(visportal_t &srcportal, int leafnum, const leafbits_t &p
 */
 static void BasePortalThread(size_t portalnum)
 {
+    logging::trace_zone zone(__func__);
+
     int j;
     float d;
     leafbits_t portalsee(numportals * 2);
@@ -220,6 +220,12 @@ bool LoadVisState(void)
         state_time = fs::last_write_time(statefile);
     }
 
+    // no portalfile means the portals were handed over in memory, straight from qbsp
+    if (portalfile.empty()) {
+        logging::print("State file is out of date, will be overwritten\n");
+        return false;
+    }
+
     prt_time = fs::last_write_time(portalfile);
     if (prt_time > state_time) {
         logging::print("State file is out of date, will be overwritten\n");
@@ -598,10 +598,8 @@ void CalcVis(mbsp_t *bsp)
   LoadPortals
   ============
 */
-static void LoadPortals(const fs::path &name, mbsp_t *bsp)
+static void LoadPortals(const prtfile_t &prtfile, mbsp_t *bsp)
 {
-    const prtfile_t prtfile = LoadPrtFile(name, bsp->loadversion);
-
     portalleafs = prtfile.portalleafs;
     portalleafs_real = prtfile.portalleafs_real;
 
@@ -703,16 +701,19 @@ void vis_reset()
 {
     // FIXME: clear other data
 
+    // LoadPortals only appends to these, and vis can run more than once per process
+    // (ericw-compile, tests)
+    portals.clear();
+    leafs.clear();
+    vismap.clear();
+
     vis_options.reset();
 }
 
-int vis_main(int argc, const char **argv)
+static void InitVis(int argc, const char **argv)
 {
     vis_reset();
 
-    bspdata_t bspdata;
-    const bspversion_t *loadversion;
-
     vis_options.run(argc, argv);
 
     vis_options.sourceMap.replace_extension("bsp");
@@ -724,12 +725,20 @@ int vis_main(int argc, const char **argv)
 
     stateinterval = std::chrono::minutes(5); /* 5 minutes */
     starttime = statetime = I_FloatTime();
+}
 
-    LoadBSPFile(vis_options.sourceMap, &bspdata);
+/*
+  ============
+  VisBSP
 
+  Leaves `bspdata` in the generic format. If `prtfile` is null, the portals
+  are loaded from <mapname>.prt.
+  ============
+*/
+static void VisBSP(bspdata_t &bspdata, const prtfile_t *prtfile)
+{
     bspdata.version->game->init_filesystem(vis_options.sourceMap, vis_options);
 
-    loadversion = bspdata.version;
     ConvertBSPFormat(&bspdata, &bspver_generic);
 
     mbsp_t &bsp = std::get<mbsp_t>(bspdata.bsp);
@@ -747,8 +756,14 @@ int vis_main(int argc, const char **argv)
             originalvismapsize = portalleafs * ((portalleafs + 7) / 8);
         }
     } else {
-        portalfile = fs::path(vis_options.sourceMap).replace_extension("prt");
-        LoadPortals(portalfile, &bsp);
+        if (prtfile) {
+            // handed over in memory, so any state file is from an older compile
+            portalfile.clear();
+            LoadPortals(*prtfile, &bsp);
+        } else {
+            portalfile = fs::path(vis_options.sourceMap).replace_extension("prt");
+            LoadPortals(LoadPrtFile(portalfile, bsp.loadversion), &bsp);
+        }
 
         statefile = fs::path(vis_options.sourceMap).replace_extension("vis");
         statetmpfile = fs::path(vis_options.sourceMap).replace_extension("vi0");
@@ -775,12 +790,10 @@ int vis_main(int argc, const char **argv)
     } else {
         CalcPHS(&bsp);
     }
+}
 
-    /* Convert data format back if necessary */
-    ConvertBSPFormat(&bspdata, loadversion);
-
-    WriteBSPFile(vis_options.sourceMap, &bspdata);
-
+static void FinishVis()
+{
     endtime = I_FloatTime();
     logging::print("{:.2} elapsed\n", (endtime - starttime));
 
@@ -789,6 +802,39 @@ int vis_main(int argc, const char **argv)
     }
 
     logging::close();
+}
+
+int vis_main(int argc, const char **argv)
+{
+    InitVis(argc, argv);
+
+    bspdata_t bspdata;
+    LoadBSPFile(vis_options.sourceMap, &bspdata);
+
+    VisBSP(bspdata, nullptr);
+
+    /* Convert data format back if necessary */
+    ConvertBSPFormat(&bspdata, bspdata.loadversion);
+
+    WriteBSPFile(vis_options.sourceMap, &bspdata);
+
+    FinishVis();
+
+    return 0;
+}
+
+int vis_main(const std::vector<std::string> &args, bspdata_t &bspdata, const prtfile_t &prtfile)
+{
+    std::vector<const char *> argPtrs;
+    for (const std::string &arg : args) {
+        argPtrs.push_back(arg.data());
+    }
+
+    InitVis(argPtrs.size(), argPtrs.data());
+
+    VisBSP(bspdata, &prtfile);
+
+    FinishVis();
 
     return 0;
 }